@@ -0,0 +1,2563 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Headless benchmark of MetricsGuiPlot updating and drawing.  ImGui is driven
+// without a renderer: the font atlas is built but never uploaded, and the
+// draw data of each frame is only counted.
+//
+// With --capture, it instead measures the compression of capture file
+// columns and replaying a capture, and with --shared the latency and throughput of values sent
+// from another process through MetricsGuiSharedWriter.  --timer measures
+// the overhead of reading the perf timer and of a timing zone, --reduce the
+// history reductions at each instruction set level, and --format compares
+// quantity labels with snprintf()'s on every float.  --check runs
+// consistency checks of cases that are easy to break, and exits non-zero
+// if any fails.
+#include <imgui.h>
+#include <metrics_gui/capture.h>
+#include <metrics_gui/metrics_gui.h>
+#include <metrics_gui/shared.h>
+#include <metrics_gui/trace.h>
+#include <metrics_gui/value_queue.h>
+#include <metrics_gui/zone_timer.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <math.h>
+#include <new>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../metrics_gui/source/capture_encoding.h"
+#include "../metrics_gui/source/quantity_label.h"
+#include "../metrics_gui/source/reduce.h"
+#include "../portable/countof.h"
+#include "../portable/perf_timer.h"
+
+#ifndef _WIN32
+#include <sched.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+// Count heap allocations, both through operator new and through ImGui's
+// allocator, so that each scenario can report allocations per frame.
+namespace {
+
+uint64_t gAllocationCount = 0;
+
+void* CountedMalloc(
+    size_t size)
+{
+    gAllocationCount += 1;
+    return malloc(size);
+}
+
+}
+
+void* operator new(size_t size)
+{
+    auto p = CountedMalloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    free(p);
+}
+
+namespace {
+
+enum PlotMode {
+    PLOT_MODE_LINE,
+    PLOT_MODE_BAR,
+    PLOT_MODE_STACKED,
+    PLOT_MODE_DISTRIBUTION,     // DrawDistribution() of TRACK_PERCENTILES metrics
+};
+
+char const* const PLOT_MODE_NAMES[] = { "line", "bar", "stacked", "distribution" };
+
+struct Scenario {
+    uint32_t mMetricCount;
+    uint32_t mPlotCount;        // number of DrawHistory() or DrawDistribution() plots; the metrics are split between them
+    uint32_t mHistorySize;
+    PlotMode mMode;
+    bool mDrawList;             // also draw all metrics with DrawList()
+    bool mInlineGraphs;         // show DrawList() inline plots
+    bool mRegistry;             // create the metrics with MetricsGuiRegistry::AddMetric()
+};
+
+struct Options {
+    uint32_t mFrameCount;
+    uint32_t mWarmupFrameCount;
+    float mWindowWidth;
+    float mWindowHeight;
+};
+
+struct Result {
+    double mUpdateNs;           // per frame: adding values and UpdateAxes()
+    double mDrawNs;             // per frame: NewFrame() through Render()
+    double mVertexCount;        // per frame
+    double mIndexCount;         // per frame
+    double mAllocationCount;    // per frame
+};
+
+double GetNanoseconds(
+    uint64_t count,
+    PerfTimerFrequency const& frequency)
+{
+    return (double) count * 1e9 * frequency.Denominator / (double) frequency.Numerator;
+}
+
+Result RunScenario(
+    Scenario const& scenario,
+    Options const& options)
+{
+    // Set up metrics and plots, either as separately allocated metrics or in
+    // a registry.  Each metric's values are generated from its own
+    // pseudo-random sequence and scale.
+    std::vector<MetricsGuiMetric> standaloneMetrics;
+    MetricsGuiRegistry registry;
+    std::vector<MetricsGuiMetric*> metrics;
+    uint32_t flags = MetricsGuiMetric::USE_SI_UNIT_PREFIX;
+    if (scenario.mMode == PLOT_MODE_DISTRIBUTION) {
+        flags |= MetricsGuiMetric::TRACK_PERCENTILES;
+    }
+    standaloneMetrics.reserve(scenario.mRegistry ? 0 : scenario.mMetricCount);
+    metrics.reserve(scenario.mMetricCount);
+    for (uint32_t i = 0; i < scenario.mMetricCount; ++i) {
+        char description[64];
+        snprintf(description, _countof(description), "Metric %u", i);
+        if (scenario.mRegistry) {
+            metrics.emplace_back(registry.GetMetric(registry.AddMetric(description, "s", flags, scenario.mHistorySize)));
+        } else {
+            standaloneMetrics.emplace_back(description, "s", flags, scenario.mHistorySize);
+            metrics.emplace_back(&standaloneMetrics.back());
+        }
+        metrics.back()->mSelected = (i % 4) == 0;
+    }
+
+    std::vector<MetricsGuiPlot> plots(scenario.mPlotCount);
+    for (uint32_t i = 0; i < scenario.mMetricCount && scenario.mPlotCount > 0; ++i) {
+        plots[i % scenario.mPlotCount].AddMetric(metrics[i]);
+    }
+    for (auto& plot : plots) {
+        plot.mBarGraph = scenario.mMode == PLOT_MODE_BAR;
+        plot.mStacked = scenario.mMode == PLOT_MODE_STACKED;
+        plot.mShowLegendAverage = true;
+    }
+
+    MetricsGuiPlot listPlot;
+    listPlot.mShowInlineGraphs = scenario.mInlineGraphs;
+    listPlot.mShowOnlyIfSelected = true;
+    if (scenario.mDrawList) {
+        for (auto metric : metrics) {
+            listPlot.AddMetric(metric);
+        }
+    }
+
+    auto frequency = GetPerfTimerFrequency();
+    uint64_t updateCount = 0;
+    uint64_t drawCount = 0;
+    uint64_t vertexCount = 0;
+    uint64_t indexCount = 0;
+    uint64_t allocationCount = 0;
+    uint32_t seed = 1;
+
+    // A percentile histogram allocates the first time its values reach a
+    // new power of two, so distributions are of values in [0.25, 1.25)
+    // rather than [0, 1), which keeps reaching smaller powers.
+    auto valueOffset = scenario.mMode == PLOT_MODE_DISTRIBUTION ? 0.25f : 0.f;
+    for (uint32_t frame = 0, frameCount = options.mWarmupFrameCount + options.mFrameCount; frame < frameCount; ++frame) {
+        auto measure = frame >= options.mWarmupFrameCount;
+        auto allocationCount0 = gAllocationCount;
+
+        auto t0 = GetPerfTimerCount();
+        for (uint32_t i = 0; i < scenario.mMetricCount; ++i) {
+            seed = seed * 1664525u + 1013904223u;
+            auto scale = (float) (1u << (i % 16)) * 1e-6f;
+            metrics[i]->AddNewValue(((float) (seed >> 8) * (1.f / (1 << 24)) + valueOffset) * scale);
+        }
+        for (auto& plot : plots) {
+            if (!plot.mMetrics.empty()) {
+                plot.UpdateAxes();
+            }
+        }
+        if (scenario.mDrawList) {
+            listPlot.UpdateAxes();
+        }
+
+        auto t1 = GetPerfTimerCount();
+        ImGui::NewFrame();
+        ImGui::SetNextWindowPos(ImVec2(0.f, 0.f));
+        ImGui::SetNextWindowSize(ImVec2(options.mWindowWidth, options.mWindowHeight));
+        ImGui::Begin("Benchmark", nullptr, ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoSavedSettings);
+        for (auto& plot : plots) {
+            if (plot.mMetrics.empty()) {
+                continue;
+            }
+            if (scenario.mMode == PLOT_MODE_DISTRIBUTION) {
+                plot.DrawDistribution();
+            } else {
+                plot.DrawHistory();
+            }
+        }
+        if (scenario.mDrawList) {
+            listPlot.DrawList();
+        }
+        ImGui::End();
+        ImGui::Render();
+        auto t2 = GetPerfTimerCount();
+
+        if (measure) {
+            auto drawData = ImGui::GetDrawData();
+            updateCount += t1 - t0;
+            drawCount += t2 - t1;
+            vertexCount += drawData->TotalVtxCount;
+            indexCount += drawData->TotalIdxCount;
+            allocationCount += gAllocationCount - allocationCount0;
+        }
+    }
+
+    auto n = (double) options.mFrameCount;
+    Result result;
+    result.mUpdateNs = GetNanoseconds(updateCount, frequency) / n;
+    result.mDrawNs = GetNanoseconds(drawCount, frequency) / n;
+    result.mVertexCount = (double) vertexCount / n;
+    result.mIndexCount = (double) indexCount / n;
+    result.mAllocationCount = (double) allocationCount / n;
+    return result;
+}
+
+void PrintResultHeader()
+{
+    printf("%8s %6s %8s %12s %5s %7s %9s %12s %12s %10s %10s %8s\n",
+        "metrics", "plots", "history", "mode", "list", "inline", "registry",
+        "update_ns", "draw_ns", "vertices", "indices", "allocs");
+}
+
+void PrintResult(
+    Scenario const& scenario,
+    Result const& result)
+{
+    printf("%8u %6u %8u %12s %5s %7s %9s %12.0f %12.0f %10.0f %10.0f %8.2f\n",
+        scenario.mMetricCount,
+        scenario.mPlotCount,
+        scenario.mHistorySize,
+        PLOT_MODE_NAMES[scenario.mMode],
+        scenario.mDrawList ? "yes" : "no",
+        scenario.mInlineGraphs ? "yes" : "no",
+        scenario.mRegistry ? "yes" : "no",
+        result.mUpdateNs,
+        result.mDrawNs,
+        result.mVertexCount,
+        result.mIndexCount,
+        result.mAllocationCount);
+}
+
+// Set up ImGui without a renderer.
+void InitializeImGui(
+    Options const& options)
+{
+    auto& io = ImGui::GetIO();
+    io.DisplaySize = ImVec2(options.mWindowWidth, options.mWindowHeight);
+    io.DeltaTime = 1.f / 60.f;
+    io.IniFilename = nullptr;
+    io.RenderDrawListsFn = nullptr;
+    io.MemAllocFn = CountedMalloc;
+    io.MemFreeFn = free;
+
+    unsigned char* pixels = nullptr;
+    int width = 0;
+    int height = 0;
+    io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
+}
+
+// Scenarios run when none is specified on the command line
+Scenario const DEFAULT_SCENARIOS[] = {
+    //  metrics  plots  history  mode                    list   inline registry
+    {       4,      4,     256,  PLOT_MODE_LINE,         false, false, false },
+    {       4,      4,     256,  PLOT_MODE_BAR,          false, false, false },
+    {      32,      4,     256,  PLOT_MODE_STACKED,      false, false, false },
+    {       4,      4,    4096,  PLOT_MODE_LINE,         false, false, false },
+    {       4,      4,   65536,  PLOT_MODE_LINE,         false, false, false },
+    {      32,      4,    4096,  PLOT_MODE_DISTRIBUTION, false, false, false },
+    {    1000,      0,     256,  PLOT_MODE_LINE,         true,  false, false },
+    {    1000,      0,     256,  PLOT_MODE_LINE,         true,  true,  false },
+    {   12000,      0,     256,  PLOT_MODE_LINE,         true,  false, false },
+    {   12000,      0,     256,  PLOT_MODE_LINE,         true,  false, true  },
+    {   12000,      0,     256,  PLOT_MODE_LINE,         true,  true,  false },
+    {     128,      8,     256,  PLOT_MODE_STACKED,      true,  true,  false },
+};
+
+// A path for a temporary file, in $TMPDIR (or /tmp), or %TEMP% on Windows.
+std::string GetTempFilePath(
+    char const* name)
+{
+#ifdef _WIN32
+    auto dir = getenv("TEMP");
+    auto defaultDir = ".";
+    auto separator = "\\";
+#else
+    auto dir = getenv("TMPDIR");
+    auto defaultDir = "/tmp";
+    auto separator = "/";
+#endif
+    return std::string(dir != nullptr && dir[0] != '\0' ? dir : defaultDir) + separator + name;
+}
+
+// Kinds of values generated for the capture benchmark
+enum CaptureSignal {
+    CAPTURE_SIGNAL_TIMING,      // noisy durations, e.g., GPU time in seconds
+    CAPTURE_SIGNAL_COUNTER,     // integers that drift, e.g., draw calls
+    CAPTURE_SIGNAL_STEPPED,     // values that change occasionally, e.g., memory in use
+    CAPTURE_SIGNAL_CONSTANT,
+    CAPTURE_SIGNAL_COUNT,
+};
+
+char const* const CAPTURE_SIGNAL_NAMES[] = { "timing", "counter", "stepped", "constant" };
+
+struct CaptureResult {
+    uint64_t mValueCount;
+    uint64_t mRawBytes;         // column headers and data, as CAPTURE_ENCODING_RAW
+    uint64_t mEncodedBytes;     // column headers and data, as written by MetricsGuiCaptureWriter
+};
+
+// Generate frameCount frames of values for metricCount metrics at 120Hz
+// with some jitter, and encode each metric's values in each block the way
+// MetricsGuiCaptureWriter does.  Reports the compression ratio of each kind
+// of value, and the time taken to encode and decode the values.  The frames
+// are also captured to a file with MetricsGuiCaptureWriter, one
+// WriteValues() call per frame, to measure the cost of each call to the
+// capturing thread and then opening the file and seeking to random times
+// with MetricsGuiCaptureReplay.
+// Returns false if any value doesn't decode to the same bits as it was
+// encoded from.
+bool RunCaptureBenchmark(
+    uint32_t metricCount,
+    uint32_t frameCount)
+{
+    auto frequency = GetPerfTimerFrequency();
+    auto frameCounts = (double) frequency.Numerator / (double) frequency.Denominator / 120.;
+    auto blockFrameCount = std::max(1u, (uint32_t) MetricsGuiCaptureWriter::BLOCK_VALUE_COUNT / metricCount);
+
+    std::vector<uint64_t> timestamps(blockFrameCount);
+    std::vector<float> values((size_t) metricCount * blockFrameCount);
+    std::vector<float> prevValues(metricCount, 0.f);
+    std::vector<uint64_t> firstWords;
+    std::vector<uint64_t> words;
+    std::vector<uint64_t> decodedTimestamps(blockFrameCount);
+    std::vector<float> decodedValues(blockFrameCount);
+    std::vector<float> frameValues(metricCount);
+    std::vector<uint64_t> writeCounts;
+    writeCounts.reserve(frameCount);
+
+    auto path = GetTempFilePath("metrics_gui_benchmark.mgcap");
+    std::vector<MetricsGuiMetric> metrics(metricCount);
+    std::vector<MetricsGuiMetric const*> metricPointers;
+    for (uint32_t i = 0; i < metricCount; ++i) {
+        char description[32];
+        snprintf(description, _countof(description), "Metric %u", i);
+        metrics[i].Initialize(description, "s", MetricsGuiMetric::USE_SI_UNIT_PREFIX);
+        metricPointers.emplace_back(&metrics[i]);
+    }
+    MetricsGuiCaptureWriter writer;
+    if (!writer.Open(path.c_str(), metricPointers.data(), metricCount)) {
+        fprintf(stderr, "error: failed to create %s\n", path.c_str());
+        return false;
+    }
+
+    CaptureResult results[CAPTURE_SIGNAL_COUNT] = {};
+    uint64_t encodeCount = 0;
+    uint64_t decodeCount = 0;
+    uint64_t mismatchCount = 0;
+    uint64_t timestamp = 1000000;
+    uint32_t seed = 1;
+    for (uint32_t frame = 0; frame < frameCount; ) {
+        // Generate the block's values, stored by metric.
+        auto n = std::min(blockFrameCount, frameCount - frame);
+        for (uint32_t j = 0; j < n; ++j) {
+            seed = seed * 1664525u + 1013904223u;
+            timestamps[j] = timestamp;
+            timestamp += (uint64_t) (frameCounts * (0.98 + 0.04 * (seed >> 8) / (1 << 24)));
+        }
+        for (uint32_t i = 0; i < metricCount; ++i) {
+            auto column = &values[(size_t) i * n];
+            auto value = prevValues[i];
+            for (uint32_t j = 0; j < n; ++j) {
+                seed = seed * 1664525u + 1013904223u;
+                auto r = (float) (seed >> 8) * (1.f / (1 << 24));
+                switch (i % CAPTURE_SIGNAL_COUNT) {
+                case CAPTURE_SIGNAL_TIMING:   value = 0.002f + 0.001f * r; break;
+                case CAPTURE_SIGNAL_COUNTER:  value = std::max(0.f, value + (float) (seed >> 30) - 1.f); break;
+                case CAPTURE_SIGNAL_STEPPED:  value = (seed >> 24) == 0 ? (float) (1u << 20) * (float) (seed >> 20 & 0xff) : value; break;
+                case CAPTURE_SIGNAL_CONSTANT: value = 60.f; break;
+                }
+                column[j] = value;
+            }
+            prevValues[i] = value;
+        }
+        // Yield after each frame, as the rest of a frame would give the
+        // background thread time to run.
+        for (uint32_t j = 0; j < n; ++j) {
+            for (uint32_t i = 0; i < metricCount; ++i) {
+                frameValues[i] = values[(size_t) i * n + j];
+            }
+            auto t0 = GetPerfTimerCount();
+            writer.WriteValues(0, metricCount, frameValues.data(), timestamps[j]);
+            writeCounts.emplace_back(GetPerfTimerCount() - t0);
+            std::this_thread::yield();
+        }
+
+        // Every metric has a value each frame, so only the first column of
+        // each block stores the timestamps, and the others share them.
+        CaptureColumnHeader firstHeader = {};
+        CaptureColumnReader firstReader;
+        for (uint32_t i = 0; i < metricCount; ++i) {
+            auto column = &values[(size_t) i * n];
+            auto columnWords = i == 0 ? &firstWords : &words;
+
+            columnWords->clear();
+            auto t0 = GetPerfTimerCount();
+            EncodeCaptureColumn(timestamps.data(), column, n, i == 0, columnWords);
+            auto t1 = GetPerfTimerCount();
+            encodeCount += t1 - t0;
+
+            CaptureColumnHeader header = {};
+            header.mEncoding = CAPTURE_ENCODING_GORILLA;
+            header.mValueCount = n;
+            header.mByteCount = (uint32_t) (columnWords->size() * sizeof(uint64_t));
+            header.mFirstTimestamp = timestamps[0];
+            header.mLastTimestamp = timestamps[n - 1];
+            if (i == 0) {
+                firstHeader = header;
+            }
+
+            CaptureColumnReader reader;
+            reader.Initialize(i == 0 ? &firstHeader : &header, columnWords->data(), i == 0 ? nullptr : &firstReader);
+            if (i == 0) {
+                firstReader = reader;
+            }
+            uint32_t decodedCount = 0;
+            t0 = GetPerfTimerCount();
+            while (decodedCount < n && reader.Read(&decodedTimestamps[decodedCount], &decodedValues[decodedCount])) {
+                decodedCount += 1;
+            }
+            t1 = GetPerfTimerCount();
+            decodeCount += t1 - t0;
+
+            uint64_t t;
+            float v;
+            if (decodedCount != n || reader.Read(&t, &v) ||
+                memcmp(decodedTimestamps.data(), timestamps.data(), n * sizeof(uint64_t)) != 0 ||
+                memcmp(decodedValues.data(), column, n * sizeof(float)) != 0) {
+                if (mismatchCount == 0) {
+                    fprintf(stderr, "error: metric %u's column at frame %u doesn't decode to the values encoded\n", i, frame);
+                }
+                mismatchCount += 1;
+            }
+
+            auto rawBytes = sizeof(CaptureColumnHeader) + AlignCaptureSize(n * (sizeof(uint64_t) + sizeof(float)));
+            auto result = &results[i % CAPTURE_SIGNAL_COUNT];
+            result->mValueCount += n;
+            result->mRawBytes += rawBytes;
+            result->mEncodedBytes += std::min(rawBytes, sizeof(CaptureColumnHeader) + header.mByteCount);
+        }
+        frame += n;
+    }
+
+    printf("%10s %12s %12s %12s %8s %12s\n", "values", "count", "raw_bytes", "encoded", "ratio", "bits/value");
+    CaptureResult total = {};
+    for (uint32_t i = 0; i < CAPTURE_SIGNAL_COUNT; ++i) {
+        auto const& result = results[i];
+        total.mValueCount += result.mValueCount;
+        total.mRawBytes += result.mRawBytes;
+        total.mEncodedBytes += result.mEncodedBytes;
+        if (result.mValueCount > 0) {
+            printf("%10s %12llu %12llu %12llu %8.2f %12.1f\n", CAPTURE_SIGNAL_NAMES[i],
+                (unsigned long long) result.mValueCount,
+                (unsigned long long) result.mRawBytes,
+                (unsigned long long) result.mEncodedBytes,
+                (double) result.mRawBytes / (double) result.mEncodedBytes,
+                8. * result.mEncodedBytes / result.mValueCount);
+        }
+    }
+    printf("%10s %12llu %12llu %12llu %8.2f %12.1f\n", "total",
+        (unsigned long long) total.mValueCount,
+        (unsigned long long) total.mRawBytes,
+        (unsigned long long) total.mEncodedBytes,
+        (double) total.mRawBytes / (double) total.mEncodedBytes,
+        8. * total.mEncodedBytes / total.mValueCount);
+
+    auto encodeNs = GetNanoseconds(encodeCount, frequency) / total.mValueCount;
+    auto decodeNs = GetNanoseconds(decodeCount, frequency) / total.mValueCount;
+    printf("encode %.1f ns/value (%.1f M values/s), decode %.1f ns/value (%.1f M values/s)\n",
+        encodeNs, 1e3 / encodeNs, decodeNs, 1e3 / decodeNs);
+    printf("encoding %u metrics at 120Hz uses %.1f%% of one core, writing %.0f KB/s (%.0f KB/s raw)\n",
+        metricCount, encodeNs * metricCount * 120. * 1e-7,
+        120. * total.mEncodedBytes / frameCount / 1024., 120. * total.mRawBytes / frameCount / 1024.);
+
+    uint64_t writeCount = 0;
+    for (auto count : writeCounts) {
+        writeCount += count;
+    }
+    std::sort(writeCounts.begin(), writeCounts.end());
+    printf("WriteValues() of %u values: %.0f ns/frame on average, p50 %.0f ns, p99 %.0f ns, max %.0f ns; %llu values dropped\n",
+        metricCount, GetNanoseconds(writeCount, frequency) / frameCount,
+        GetNanoseconds(writeCounts[writeCounts.size() / 2], frequency),
+        GetNanoseconds(writeCounts[std::min(writeCounts.size() - 1, writeCounts.size() * 99 / 100)], frequency),
+        GetNanoseconds(writeCounts.back(), frequency),
+        (unsigned long long) writer.GetDroppedValueCount());
+
+    // Open the capture and seek to random times, as a viewer would.
+    enum { SEEK_COUNT = 100 };
+    if (!writer.Close()) {
+        fprintf(stderr, "error: failed to write %s\n", path.c_str());
+        return false;
+    }
+    uint64_t fileSize = 0;
+    if (auto file = fopen(path.c_str(), "rb")) {
+        fseek(file, 0, SEEK_END);
+        fileSize = (uint64_t) ftell(file);
+        fclose(file);
+    }
+    MetricsGuiCaptureReplay replay;
+    auto t0 = GetPerfTimerCount();
+    auto opened = replay.Open(path.c_str());
+    auto t1 = GetPerfTimerCount();
+    for (uint32_t i = 0; i < SEEK_COUNT; ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        replay.Seek(replay.GetDuration() * (seed >> 8) / (1 << 24));
+    }
+    auto t2 = GetPerfTimerCount();
+
+    // Export the whole capture as a trace.
+    auto tracePath = GetTempFilePath("metrics_gui_benchmark.json");
+    MetricsGuiTraceWriter trace;
+    auto traced = opened && trace.Open(tracePath.c_str());
+    auto t3 = GetPerfTimerCount();
+    replay.WriteTrace(&trace);
+    auto eventCount = trace.GetEventCount();
+    traced = trace.Close() && traced;
+    auto t4 = GetPerfTimerCount();
+    uint64_t traceSize = 0;
+    if (auto file = fopen(tracePath.c_str(), "rb")) {
+        fseek(file, 0, SEEK_END);
+        traceSize = (uint64_t) ftell(file);
+        fclose(file);
+    }
+
+    replay.Close();
+    remove(path.c_str());
+    remove(tracePath.c_str());
+    if (!opened) {
+        fprintf(stderr, "error: failed to open %s\n", path.c_str());
+        return false;
+    }
+    printf("replaying the %.1f MB capture: %.2f ms to open, %.2f ms per seek to a random time\n",
+        fileSize / (1024. * 1024.), GetNanoseconds(t1 - t0, frequency) * 1e-6,
+        GetNanoseconds(t2 - t1, frequency) * 1e-6 / SEEK_COUNT);
+    if (!traced) {
+        fprintf(stderr, "error: failed to write %s\n", tracePath.c_str());
+        return false;
+    }
+    printf("exporting it as a %.1f MB trace: %.0f ns per value (%llu events)\n",
+        traceSize / (1024. * 1024.), GetNanoseconds(t4 - t3, frequency) / std::max(eventCount, (uint64_t) 1),
+        (unsigned long long) eventCount);
+    return mismatchCount == 0;
+}
+
+#ifndef _WIN32
+enum {
+    SHARED_PROBE_COUNT          = 10000,    // values sent one at a time to measure latency
+    SHARED_PROBE_INTERVAL_NS    = 100000,
+    SHARED_THROUGHPUT_COUNT     = 20000000, // values sent as fast as possible to measure throughput
+};
+
+// The writer process: publishes a probe metric and metricCount other
+// metrics, waits for the reader to connect, writes SHARED_PROBE_COUNT
+// probe values at SHARED_PROBE_INTERVAL_NS intervals, and then writes
+// SHARED_THROUGHPUT_COUNT values of the other metrics in batches of
+// metricCount as fast as the reader drains them.
+void RunSharedWriter(
+    char const* name,
+    uint32_t metricCount,
+    int readyFd)
+{
+    MetricsGuiSharedWriter writer;
+    if (!writer.Open(name, metricCount + 1)) {
+        fprintf(stderr, "error: failed to create shared memory %s\n", name);
+        return;
+    }
+    auto probe = writer.AddMetric("Latency probe", "", 0);
+    for (uint32_t i = 0; i < metricCount; ++i) {
+        char description[32];
+        snprintf(description, sizeof(description), "Metric %u", i);
+        writer.AddMetric(description, "", 0);
+    }
+
+    char ready = 0;
+    if (read(readyFd, &ready, 1) != 1) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < SHARED_PROBE_COUNT; ++i) {
+        writer.WriteValue(probe, (float) i);
+        timespec t = { 0, SHARED_PROBE_INTERVAL_NS };
+        nanosleep(&t, nullptr);
+    }
+
+    // Wait for room rather than dropping values, and only time the writes.
+    auto frequency = GetPerfTimerFrequency();
+    std::vector<float> values(metricCount, 1.f);
+    uint64_t writeCount = 0;
+    for (uint32_t n = 0; n < SHARED_THROUGHPUT_COUNT; n += metricCount) {
+        auto count = std::min(metricCount, SHARED_THROUGHPUT_COUNT - n);
+        while (writer.GetFreeValueCount() < count) {
+            sched_yield();
+        }
+        auto t0 = GetPerfTimerCount();
+        writer.WriteValues(probe + 1, count, values.data());
+        writeCount += GetPerfTimerCount() - t0;
+    }
+    printf("writer: %.1f ns/value in WriteValues(), %llu values dropped\n",
+        GetNanoseconds(writeCount, frequency) / SHARED_THROUGHPUT_COUNT,
+        (unsigned long long) writer.GetDroppedValueCount());
+    fflush(stdout);
+}
+
+// Fork a writer process and measure, in this process, the time from the
+// writer's WriteValue() to the value being added to a metric by Drain()
+// after Wait() returns, and the rate at which Drain() adds values.
+bool RunSharedBenchmark(
+    uint32_t metricCount)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/metrics_gui_benchmark_%d", (int) getpid());
+
+    int readyPipe[2];
+    if (pipe(readyPipe) != 0) {
+        return false;
+    }
+    fflush(stdout);
+    auto pid = fork();
+    if (pid == -1) {
+        return false;
+    }
+    if (pid == 0) {
+        close(readyPipe[1]);
+        RunSharedWriter(name, metricCount, readyPipe[0]);
+        _exit(0);
+    }
+    close(readyPipe[0]);
+
+    auto frequency = GetPerfTimerFrequency();
+    auto timeout = GetPerfTimerCount() + 10 * frequency.Numerator / frequency.Denominator;
+    MetricsGuiSharedReader reader;
+    for (;;) {
+        if (reader.mState != nullptr || reader.Open(name)) {
+            reader.Drain();
+            if (reader.GetMetricCount() == metricCount + 1) {
+                break;
+            }
+        }
+        if (GetPerfTimerCount() > timeout) {
+            fprintf(stderr, "error: failed to open shared memory %s\n", name);
+            close(readyPipe[1]);
+            waitpid(pid, nullptr, 0);
+            return false;
+        }
+        timespec t = { 0, 1000000 };
+        nanosleep(&t, nullptr);
+    }
+    char ready = 1;
+    if (write(readyPipe[1], &ready, 1) != 1) {
+        return false;
+    }
+    close(readyPipe[1]);
+
+    // Latency: the writer sleeps between probe values, so each one wakes
+    // this process from Wait().
+    auto probe = reader.GetMetric(0);
+    std::vector<double> latencies;
+    latencies.reserve(SHARED_PROBE_COUNT);
+    uint64_t throughputCount = 0;
+    while (probe->mValueCount < SHARED_PROBE_COUNT && GetPerfTimerCount() < timeout) {
+        reader.Wait(100);
+        auto probeCount = probe->mValueCount;
+        throughputCount += reader.Drain();
+        auto now = GetPerfTimerCount();
+        if (probe->mValueCount > probeCount) {
+            auto last = (probe->mHistoryHead + probe->mHistorySize - 1) % probe->mHistorySize;
+            latencies.push_back(GetNanoseconds(now - probe->mTimestamps[last], frequency));
+        }
+    }
+    throughputCount -= probe->mValueCount;
+
+    // Throughput: drain until every value has been added or dropped.
+    auto t0 = GetPerfTimerCount();
+    timeout = t0 + 30 * frequency.Numerator / frequency.Denominator;
+    while (throughputCount + reader.GetDroppedValueCount() < SHARED_THROUGHPUT_COUNT && GetPerfTimerCount() < timeout) {
+        reader.Wait(100);
+        throughputCount += reader.Drain();
+    }
+    auto t1 = GetPerfTimerCount();
+    waitpid(pid, nullptr, 0);
+
+    if (latencies.empty()) {
+        fprintf(stderr, "error: no values received\n");
+        return false;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) {
+        return latencies[std::min(latencies.size() - 1, (size_t) (p * latencies.size()))] * 1e-3;
+    };
+    printf("latency over %zu values: p50 %.1f us, p99 %.1f us, max %.1f us\n",
+        latencies.size(), percentile(0.5), percentile(0.99), latencies.back() * 1e-3);
+    printf("throughput: %llu values added at %.1f ns/value (%.1f M values/s), %llu dropped\n",
+        (unsigned long long) throughputCount,
+        GetNanoseconds(t1 - t0, frequency) / throughputCount,
+        throughputCount * 1e3 / GetNanoseconds(t1 - t0, frequency),
+        (unsigned long long) reader.GetDroppedValueCount());
+    return true;
+}
+#endif
+
+// MetricsGuiCreateQuantityLabel() as it was written with snprintf(), to
+// compare the library's formatter against.
+char const* const SNPRINTF_SI_UNIT_PREFIXES[]     = { "n", "u", "m", "", "k",  "M",  "G",  "T"  };
+char const* const SNPRINTF_BINARY_UNIT_PREFIXES[] = { "",  "",  "",  "", "Ki", "Mi", "Gi", "Ti" };
+
+int CreateQuantityLabelSnprintf(
+    char* memory,
+    size_t memorySize,
+    float quantity,
+    MetricsGuiMetric::UnitInfo const& unitInfo,
+    char const* units,
+    char const* prefix)
+{
+    int unitPrefix = unitInfo.mPrefix;
+    double value = (double) quantity;
+    if (unitInfo.mMinPrefix < unitInfo.mMaxPrefix) {
+        if (value == 0.0) {
+            unitPrefix = 0;
+        } else {
+            auto sign = value < 0.0 ? -1.0 : 1.0;
+            value *= sign;
+            if (unitInfo.mBinaryPrefix) {
+                for (; value >= 1024.0 && unitPrefix < unitInfo.mMaxPrefix; ++unitPrefix) value *= 1.0 / 1024.0;
+                for (; value < 1.0 && unitPrefix > unitInfo.mMinPrefix; --unitPrefix) value *= 1024.0;
+            } else {
+                for (; value > 1000.0 && unitPrefix < unitInfo.mMaxPrefix; ++unitPrefix) value *= 0.001;
+                for (; value < 1.0 && unitPrefix > unitInfo.mMinPrefix; --unitPrefix) value *= 1000.0;
+            }
+            value *= sign;
+        }
+    }
+
+    char numberString[256];
+    int n = snprintf(numberString, 256, " %.3lf", value);
+    auto valueS = &numberString[1];
+    if (n >= 8) {
+        numberString[n - 4] = '\0';
+        if (n == 8) valueS = &numberString[0];
+    } else {
+        if (numberString[1] == '0') {
+            valueS = &numberString[1];
+            if (numberString[3] == '0' &&
+                numberString[4] == '0' &&
+                numberString[5] == '0') {
+                numberString[1] = ' ';
+                numberString[2] = ' ';
+                numberString[3] = ' ';
+            }
+        }
+        valueS[4] = '\0';
+    }
+
+    auto unitPrefixS = (unitInfo.mBinaryPrefix ? SNPRINTF_BINARY_UNIT_PREFIXES : SNPRINTF_SI_UNIT_PREFIXES)[unitPrefix + 3];
+    return snprintf(memory, memorySize, "%s%s %s%s", prefix, valueS, unitPrefixS, units + unitInfo.mBaseUnitsOffset);
+}
+
+// Units, flags, and label prefixes to compare the formatters with.  The
+// first is the common case, which --format compares on every float.
+struct FormatCase {
+    char const* mUnits;
+    uint32_t mFlags;
+    char const* mPrefix;
+};
+
+FormatCase const FORMAT_CASES[] = {
+    { "ms",      MetricsGuiMetric::USE_SI_UNIT_PREFIX,     ""     },
+    { "ms",      MetricsGuiMetric::NONE,                   "Avg " },
+    { "s",       MetricsGuiMetric::USE_SI_UNIT_PREFIX,     "Max " },
+    { "KiB",     MetricsGuiMetric::USE_BINARY_UNIT_PREFIX, ""     },
+    { "B/s",     MetricsGuiMetric::USE_SI_UNIT_PREFIX,     ""     },
+    { "Hz",      MetricsGuiMetric::USE_SI_UNIT_PREFIX,     ""     },
+    { "widgets", MetricsGuiMetric::USE_SI_UNIT_PREFIX,     ""     },
+    { "",        MetricsGuiMetric::NONE,                   ""     },
+};
+
+// Compare the formatters on the float bit patterns i << shift for i =
+// first, first + stride, ... below 2^(32 - shift), with a buffer of
+// memorySize bytes.  Returns the number of mismatches, and reports the
+// first one.
+uint64_t CompareQuantityLabels(
+    FormatCase const& formatCase,
+    uint64_t first,
+    uint64_t stride,
+    uint32_t shift,
+    size_t memorySize)
+{
+    MetricsGuiMetric metric("Format", formatCase.mUnits, formatCase.mFlags, 1);
+    uint64_t mismatchCount = 0;
+    for (auto i = first; i < (1ull << (32 - shift)); i += stride) {
+        auto u = (uint32_t) (i << shift);
+        float quantity;
+        memcpy(&quantity, &u, sizeof(quantity));
+
+        char expected[64];
+        char actual[64];
+        memset(expected, '#', sizeof(expected));
+        memset(actual, '#', sizeof(actual));
+        auto expectedN = CreateQuantityLabelSnprintf(expected, memorySize, quantity, metric.mUnitInfo, formatCase.mUnits, formatCase.mPrefix);
+        auto actualN = MetricsGuiCreateQuantityLabel(actual, memorySize, quantity, metric.mUnitInfo, formatCase.mUnits, formatCase.mPrefix);
+        if (actualN != expectedN || memcmp(actual, expected, sizeof(actual)) != 0) {
+            if (mismatchCount == 0) {
+                fprintf(stderr, "error: %.9g (0x%08x) in \"%s\" with size %zu formatted as \"%.*s\" (%d), expected \"%.*s\" (%d)\n",
+                    quantity, u, formatCase.mUnits, memorySize,
+                    (int) std::min(memorySize, sizeof(actual)), actual, actualN,
+                    (int) std::min(memorySize, sizeof(expected)), expected, expectedN);
+            }
+            mismatchCount += 1;
+        }
+    }
+    return mismatchCount;
+}
+
+// Compare the formatters on every float for the first FORMAT_CASES entry,
+// and on a sample of floats for the others and for truncated buffers, then
+// measure both on typical values.  Returns false if any output differs.
+bool RunFormatBenchmark()
+{
+    enum { SAMPLE_STRIDE = 251, TRUNCATION_STRIDE = 65537 };
+
+    auto frequency = GetPerfTimerFrequency();
+    auto threadCount = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<uint64_t> mismatchCounts(threadCount, 0);
+    std::vector<std::thread> threads;
+    auto t0 = GetPerfTimerCount();
+    for (uint32_t t = 0; t < threadCount; ++t) {
+        threads.emplace_back([t, threadCount, &mismatchCounts]() {
+            mismatchCounts[t] = CompareQuantityLabels(FORMAT_CASES[0], t, threadCount, 0, 64);
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    uint64_t mismatchCount = 0;
+    for (auto n : mismatchCounts) {
+        mismatchCount += n;
+    }
+    printf("every float in \"%s\": %llu mismatches (%.0f s on %u threads)\n",
+        FORMAT_CASES[0].mUnits, (unsigned long long) mismatchCount,
+        GetNanoseconds(GetPerfTimerCount() - t0, frequency) * 1e-9, threadCount);
+
+    for (size_t i = 1; i < _countof(FORMAT_CASES); ++i) {
+        auto n = CompareQuantityLabels(FORMAT_CASES[i], i, SAMPLE_STRIDE, 0, 64) +
+                 CompareQuantityLabels(FORMAT_CASES[i], 0, 1, 16, 64);
+        printf("every %uth float, and those with 7 mantissa bits, in \"%s\": %llu mismatches\n", SAMPLE_STRIDE, FORMAT_CASES[i].mUnits, (unsigned long long) n);
+        mismatchCount += n;
+    }
+    for (size_t memorySize = 0; memorySize < 16; ++memorySize) {
+        mismatchCount += CompareQuantityLabels(FORMAT_CASES[2], memorySize, TRUNCATION_STRIDE, 0, memorySize);
+    }
+    printf("truncated to 0-15 bytes: %s\n", mismatchCount == 0 ? "ok" : "see above");
+
+    // Frame-time-like values in seconds, formatted as in a legend
+    enum { VALUE_COUNT = 4096, REPEAT_COUNT = 256 };
+    MetricsGuiMetric metric("Format", "s", MetricsGuiMetric::USE_SI_UNIT_PREFIX, 1);
+    std::vector<float> values(VALUE_COUNT);
+    uint32_t seed = 1;
+    for (auto& value : values) {
+        seed = seed * 1664525u + 1013904223u;
+        value = (float) (seed >> 8) * (1.f / (1 << 24)) * 0.05f;
+    }
+
+    char label[64];
+    uint64_t lengthSum = 0;
+    auto t1 = GetPerfTimerCount();
+    for (uint32_t r = 0; r < REPEAT_COUNT; ++r) {
+        for (auto value : values) {
+            lengthSum += CreateQuantityLabelSnprintf(label, sizeof(label), value, metric.mUnitInfo, "s", "Avg ");
+        }
+    }
+    auto t2 = GetPerfTimerCount();
+    for (uint32_t r = 0; r < REPEAT_COUNT; ++r) {
+        for (auto value : values) {
+            lengthSum -= MetricsGuiCreateQuantityLabel(label, sizeof(label), value, metric.mUnitInfo, "s", "Avg ");
+        }
+    }
+    auto t3 = GetPerfTimerCount();
+    printf("%12s %10s\n", "formatter", "ns/label");
+    printf("%12s %10.1f\n", "snprintf", GetNanoseconds(t2 - t1, frequency) / (VALUE_COUNT * REPEAT_COUNT));
+    printf("%12s %10.1f\n", "library", GetNanoseconds(t3 - t2, frequency) / (VALUE_COUNT * REPEAT_COUNT));
+    if (lengthSum != 0) {
+        fprintf(stderr, "error: label lengths differ\n");
+        return false;
+    }
+    return mismatchCount == 0;
+}
+
+char const* const REDUCE_LEVEL_NAMES[] = { "scalar", "sse2", "avx2" };
+
+// Measure each history reduction at each MetricsGuiReduceLevel supported by
+// the CPU, over several history sizes, and check that each level's results
+// match the scalar ones (exactly for min and max, and to within rounding
+// for sums, which are added in a different order).  Returns false on a
+// mismatch.
+bool RunReduceBenchmark()
+{
+    enum { VALUES_PER_MEASUREMENT = 64 * 1024 * 1024 };
+    uint32_t const SIZES[] = { 256, 4096, 65536 };
+
+    auto frequency = GetPerfTimerFrequency();
+    auto supportedLevel = MetricsGuiGetReduceLevel();
+    auto passed = true;
+
+    printf("%8s %7s %9s %9s %9s %9s %9s\n", "values", "level", "min_ns", "max_ns", "sum_ns", "sumd_ns", "acc_ns");
+    for (auto size : SIZES) {
+        // Unaligned, so that the vector loops' remainders are exercised too
+        std::vector<float> buffer(size + 1);
+        std::vector<float> totals(size + 1, 0.f);
+        auto values = buffer.data() + 1;
+        uint32_t seed = size;
+        for (uint32_t i = 0; i < size; ++i) {
+            seed = seed * 1664525u + 1013904223u;
+            values[i] = (float) (seed >> 8) * (1.f / (1 << 24)) - 0.25f;
+        }
+
+        auto repeatCount = VALUES_PER_MEASUREMENT / size;
+        float scalarMin = 0.f;
+        float scalarMax = 0.f;
+        double scalarSum = 0.;
+        for (uint32_t level = METRICS_GUI_REDUCE_SCALAR; level <= (uint32_t) supportedLevel; ++level) {
+            MetricsGuiSetReduceLevel((MetricsGuiReduceLevel) level);
+
+            float min = 0.f;
+            float max = 0.f;
+            float sum = 0.f;
+            double sumDouble = 0.;
+            uint64_t t[6];
+            t[0] = GetPerfTimerCount();
+            for (uint32_t r = 0; r < repeatCount; ++r) {
+                min = MetricsGuiReduceMin(values, size);
+            }
+            t[1] = GetPerfTimerCount();
+            for (uint32_t r = 0; r < repeatCount; ++r) {
+                max = MetricsGuiReduceMax(values, size);
+            }
+            t[2] = GetPerfTimerCount();
+            for (uint32_t r = 0; r < repeatCount; ++r) {
+                sum = MetricsGuiReduceSum(values, size);
+            }
+            t[3] = GetPerfTimerCount();
+            for (uint32_t r = 0; r < repeatCount; ++r) {
+                sumDouble = MetricsGuiReduceSumDouble(values, size);
+            }
+            t[4] = GetPerfTimerCount();
+            for (uint32_t r = 0; r < repeatCount; ++r) {
+                MetricsGuiAccumulate(totals.data() + 1, values, size);
+            }
+            t[5] = GetPerfTimerCount();
+
+            printf("%8u %7s %9.1f %9.1f %9.1f %9.1f %9.1f\n", size, REDUCE_LEVEL_NAMES[level],
+                GetNanoseconds(t[1] - t[0], frequency) / repeatCount,
+                GetNanoseconds(t[2] - t[1], frequency) / repeatCount,
+                GetNanoseconds(t[3] - t[2], frequency) / repeatCount,
+                GetNanoseconds(t[4] - t[3], frequency) / repeatCount,
+                GetNanoseconds(t[5] - t[4], frequency) / repeatCount);
+
+            if (level == METRICS_GUI_REDUCE_SCALAR) {
+                scalarMin = min;
+                scalarMax = max;
+                scalarSum = sumDouble;
+            }
+            auto tolerance = 1e-5 * size;
+            if (min != scalarMin || max != scalarMax ||
+                fabs(sum - scalarSum) > tolerance || fabs(sumDouble - scalarSum) > tolerance) {
+                fprintf(stderr, "error: %s results differ from scalar: min %g/%g max %g/%g sum %g/%g/%g\n",
+                    REDUCE_LEVEL_NAMES[level], min, scalarMin, max, scalarMax, sum, sumDouble, scalarSum);
+                passed = false;
+            }
+        }
+    }
+
+    MetricsGuiSetReduceLevel(supportedLevel);
+    return passed;
+}
+
+// Measure the cost of GetPerfTimerCount(), and of a zone's Begin() and End()
+// (two timer reads plus the bookkeeping), in the mode chosen with --tsc.
+void RunTimerBenchmark()
+{
+    enum { CALL_COUNT = 10000000 };
+
+    auto frequency = GetPerfTimerFrequency();
+    uint64_t sum = 0;
+    auto t0 = GetPerfTimerCount();
+    for (uint32_t i = 0; i < CALL_COUNT; ++i) {
+        sum += GetPerfTimerCount();
+    }
+    auto t1 = GetPerfTimerCount();
+
+    MetricsGuiZone zone("Benchmark");
+    for (uint32_t i = 0; i < CALL_COUNT; ++i) {
+        zone.Begin();
+        zone.End();
+    }
+    auto t2 = GetPerfTimerCount();
+
+    printf("%6s %16s %12s %12s\n", "timer", "frequency", "count_ns", "zone_ns");
+    printf("%6s %16llu %12.1f %12.1f\n",
+        frequency.Numerator == 1000000000ull ? "clock" : "tsc",
+        (unsigned long long) (frequency.Numerator / frequency.Denominator),
+        GetNanoseconds(t1 - t0, frequency) / CALL_COUNT,
+        GetNanoseconds(t2 - t1, frequency) / CALL_COUNT);
+
+    // Use the results so that the calls aren't optimized out
+    if (sum == 0 || zone.mTicks == 0) {
+        printf("(no time elapsed)\n");
+    }
+}
+
+// A stacked plot's totals must be rebuilt when its metrics are
+// re-initialized and refilled with as many values as before, as
+// MetricsGuiCaptureReplay does on each seek.
+bool CheckStackedReinitialize()
+{
+    enum { HISTORY_SIZE = 16 };
+    MetricsGuiMetric metrics[2];
+    MetricsGuiPlot plot;
+    plot.mStacked = true;
+    for (auto& metric : metrics) {
+        plot.AddMetric(&metric);
+    }
+
+    for (uint32_t seek = 1; seek <= 2; ++seek) {
+        for (auto& metric : metrics) {
+            metric.Initialize("Stacked", "", MetricsGuiMetric::NONE, HISTORY_SIZE);
+            std::fill(metric.mHistory, metric.mHistory + HISTORY_SIZE, (float) seek);
+            metric.mHistoryCount = HISTORY_SIZE;
+            metric.mValueCount = HISTORY_SIZE;
+            metric.RebuildHistoryStatistics();
+        }
+        plot.UpdateAxes();
+
+        auto const& totals = plot.mStackedHistory.mTotals;
+        for (size_t i = 0; i < totals.size(); ++i) {
+            if (totals[i] != 2.f * seek) {
+                fprintf(stderr, "error: stacked total %zu is %g after refill %u, expected %g\n", i, totals[i], seek, 2.f * seek);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Values recorded concurrently by several threads must each be added exactly
+// once, in the order each thread recorded them and with the time they were
+// recorded, while the queues fill up and are reused by later threads.  Each
+// producer records the sequence 0, 1, 2, ... into its own metric, retrying
+// when its queue is full, and the metric's history is large enough to hold
+// every value.
+bool CheckValueQueueStress()
+{
+    enum {
+        THREAD_COUNT = 4,
+        ROUND_COUNT = 2,                // later rounds reuse the exited threads' queues
+        VALUE_COUNT = 100000,           // per thread and round; exactly representable as floats
+    };
+
+    std::vector<MetricsGuiMetric> metrics(THREAD_COUNT * ROUND_COUNT);
+    for (auto& metric : metrics) {
+        metric.Initialize("Queued", "", MetricsGuiMetric::RECORD_TIMESTAMPS, VALUE_COUNT);
+    }
+
+    auto startTime = GetPerfTimerCount();
+
+    for (uint32_t round = 0; round < ROUND_COUNT; ++round) {
+        std::atomic<uint32_t> runningCount(THREAD_COUNT);
+        std::vector<std::thread> threads;
+        for (uint32_t t = 0; t < THREAD_COUNT; ++t) {
+            auto metric = &metrics[round * THREAD_COUNT + t];
+            threads.emplace_back([metric, &runningCount]() {
+                for (uint32_t i = 0; i < VALUE_COUNT; ++i) {
+                    while (!MetricsGuiRecordValue(metric, (float) i)) {
+                        std::this_thread::yield();
+                    }
+                }
+                runningCount.fetch_sub(1, std::memory_order_release);
+            });
+        }
+
+        // Drain while the producers run, and once more after they are done
+        auto running = true;
+        while (running) {
+            running = runningCount.load(std::memory_order_acquire) != 0;
+            MetricsGuiDrainValues();
+            std::this_thread::yield();
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    auto endTime = GetPerfTimerCount();
+    for (size_t m = 0; m < metrics.size(); ++m) {
+        auto const& metric = metrics[m];
+        if (metric.mValueCount != VALUE_COUNT) {
+            fprintf(stderr, "error: metric %zu has %llu values, expected %u\n", m, (unsigned long long) metric.mValueCount, VALUE_COUNT);
+            return false;
+        }
+        for (uint32_t i = 0; i < VALUE_COUNT; ++i) {
+            auto index = (metric.mHistoryHead + i) % VALUE_COUNT;
+            auto value = metric.mHistory[index];
+            if (value != (float) i) {
+                fprintf(stderr, "error: metric %zu value %u is %g\n", m, i, value);
+                return false;
+            }
+            auto timestamp = metric.mTimestamps[index];
+            auto prevTimestamp = i == 0 ? startTime : metric.mTimestamps[(index + VALUE_COUNT - 1) % VALUE_COUNT];
+            if (timestamp < prevTimestamp || timestamp > endTime) {
+                fprintf(stderr, "error: metric %zu value %u has timestamp %llu, out of order or range\n", m, i, (unsigned long long) timestamp);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// A queued value's timestamp is when it was recorded, not when it was
+// drained.
+bool CheckValueQueueTimestamp()
+{
+    MetricsGuiMetric metric("Queued", "", MetricsGuiMetric::RECORD_TIMESTAMPS, 16);
+    auto t0 = GetPerfTimerCount();
+    MetricsGuiRecordValue(&metric, 1.f);
+    auto t1 = GetPerfTimerCount();
+    while (GetPerfTimerCount() == t1) {
+    }
+    MetricsGuiDrainValues();
+
+    auto timestamp = metric.mTimestamps[0];
+    if (metric.mValueCount != 1 || timestamp < t0 || timestamp > t1) {
+        fprintf(stderr, "error: queued value has timestamp %llu, recorded between %llu and %llu\n",
+            (unsigned long long) timestamp, (unsigned long long) t0, (unsigned long long) t1);
+        return false;
+    }
+    return true;
+}
+
+// Compare two metrics' histories and the statistics kept with them: the
+// head, counts, total, range trees, and percentile histogram.
+bool CompareMetricHistories(
+    MetricsGuiMetric const& metric,
+    MetricsGuiMetric const& expected,
+    char const* what)
+{
+    auto error = [what](char const* field) {
+        fprintf(stderr, "error: %s: %s differs\n", what, field);
+        return false;
+    };
+    if (metric.mHistorySize != expected.mHistorySize ||
+        metric.mHistoryHead != expected.mHistoryHead ||
+        metric.mHistoryCount != expected.mHistoryCount ||
+        metric.mValueCount != expected.mValueCount) {
+        return error("head or count");
+    }
+    if (memcmp(metric.mHistory, expected.mHistory, metric.mHistorySize * sizeof(float)) != 0) {
+        return error("history");
+    }
+    // The totals are summed in a different order.
+    if (fabs(metric.mTotalInHistory - expected.mTotalInHistory) > 1e-6 * (1. + fabs(expected.mTotalInHistory))) {
+        return error("total");
+    }
+    // Node 0 of the range trees is unused.
+    auto treeBytes = (2 * metric.mHistoryTreeSize - 1) * sizeof(float);
+    if (memcmp(metric.mHistoryMinTree + 1, expected.mHistoryMinTree + 1, treeBytes) != 0 ||
+        memcmp(metric.mHistoryMaxTree + 1, expected.mHistoryMaxTree + 1, treeBytes) != 0) {
+        return error("range tree");
+    }
+
+    typedef MetricsGuiMetric::PercentileHistogram PercentileHistogram;
+    auto histogram = metric.mPercentileHistogram;
+    auto expectedHistogram = expected.mPercentileHistogram;
+    if ((histogram == nullptr) != (expectedHistogram == nullptr)) {
+        return error("percentile histogram");
+    }
+    if (histogram == nullptr) {
+        return true;
+    }
+    if (histogram->mCount != expectedHistogram->mCount ||
+        memcmp(histogram->mBucketCounts, expectedHistogram->mBucketCounts, sizeof(histogram->mBucketCounts)) != 0) {
+        return error("percentile histogram");
+    }
+    for (uint32_t bucket = 0; bucket < PercentileHistogram::BUCKET_COUNT; ++bucket) {
+        if (histogram->mBucketCounts[bucket] != 0 && memcmp(
+                &histogram->mSubBucketCounts[(histogram->mSubBucketBlocks[bucket] - 1) * PercentileHistogram::SUB_BUCKET_COUNT],
+                &expectedHistogram->mSubBucketCounts[(expectedHistogram->mSubBucketBlocks[bucket] - 1) * PercentileHistogram::SUB_BUCKET_COUNT],
+                PercentileHistogram::SUB_BUCKET_COUNT * sizeof(uint32_t)) != 0) {
+            return error("percentile sub-buckets");
+        }
+    }
+    return true;
+}
+
+// Adding a batch of values with AddNewValues() must leave a metric as
+// adding them one at a time with AddNewValue() does, for batches that fill
+// part of the history, wrap around the end of its buffer, and replace it
+// several times over, starting from empty, partly full, and full
+// histories.
+bool CheckAddNewValues()
+{
+    uint32_t const HISTORY_SIZES[] = { 1, 2, 3, 5, 16, 17, 64, 255, 256, 257, 1000, 4096 };
+    uint32_t const PREFILL_FRACTIONS[] = { 0, 1, 4 };  // quarters of the history filled before the batches
+
+    std::vector<float> values;
+    uint32_t seed = 1;
+    for (auto historySize : HISTORY_SIZES) {
+        // Every batch size up to 3x small histories, and those around each
+        // multiple of the history size plus a few others for larger ones
+        std::vector<uint32_t> batchSizes;
+        for (uint32_t n = 1; n <= 3 * historySize; ++n) {
+            if (historySize <= 64 || n <= 16 || n % historySize <= 1 || n % historySize == historySize - 1 || n % 97 == 0) {
+                batchSizes.emplace_back(n);
+            }
+        }
+
+        for (auto prefillFraction : PREFILL_FRACTIONS) {
+            for (auto batchSize : batchSizes) {
+                MetricsGuiMetric batched("Batched", "", MetricsGuiMetric::TRACK_PERCENTILES, historySize);
+                MetricsGuiMetric expected("Batched", "", MetricsGuiMetric::TRACK_PERCENTILES, historySize);
+
+                // Values of both signs spanning many powers of two, with
+                // repeats and zeros
+                auto addValues = [&](uint32_t count, bool batch) {
+                    values.resize(count);
+                    for (auto& value : values) {
+                        seed = seed * 1664525u + 1013904223u;
+                        value = (seed >> 28) == 0 ? 0.f : ldexpf((float) (seed >> 16 & 0xff) - 100.f, (int) (seed >> 8 & 0x1f) - 16);
+                    }
+                    if (batch) {
+                        batched.AddNewValues(values.data(), count);
+                    } else {
+                        for (auto value : values) {
+                            batched.AddNewValue(value);
+                        }
+                    }
+                    for (auto value : values) {
+                        expected.AddNewValue(value);
+                    }
+                };
+
+                addValues(prefillFraction * historySize / 4, false);
+                for (uint32_t batch = 0; batch < 3; ++batch) {
+                    addValues(batchSize, true);
+                    char what[64];
+                    snprintf(what, _countof(what), "history %u, batch %u of %u values", historySize, batch, batchSize);
+                    if (!CompareMetricHistories(batched, expected, what)) {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// GetPercentileValue() must be within 0.4% of the nearest-rank percentile
+// of the values in the history, after the history has wrapped around, for
+// values of both signs spanning many powers of two, with repeats and zeros,
+// and after Initialize() and AddNewValues().
+bool CheckPercentiles()
+{
+    float const FRACTIONS[] = { 0.5f, 0.95f, 0.99f };
+
+    MetricsGuiMetric metric("Percentiles", "", MetricsGuiMetric::TRACK_PERCENTILES, 1000);
+    std::vector<float> values;
+    std::vector<float> sorted;
+    uint32_t seed = 1;
+    auto generateValues = [&](uint32_t count, int minExponent, int maxExponent) {
+        values.resize(count);
+        for (auto& value : values) {
+            seed = seed * 1664525u + 1013904223u;
+            auto exponent = minExponent + (int) ((seed >> 8 & 0xffff) % (uint32_t) (maxExponent - minExponent + 1));
+            auto kind = seed >> 28;     // 1/16 zeros, 1/16 repeats, and 1/8 negative
+            seed = seed * 1664525u + 1013904223u;
+            auto magnitude = ldexpf(1.f + (float) (seed >> 8) / (1 << 24), exponent);
+            value = kind == 0 ? 0.f : kind == 1 ? 3.f : kind <= 3 ? -magnitude : magnitude;
+        }
+    };
+    auto check = [&](char const* what) {
+        sorted.resize(metric.mHistoryCount);
+        for (uint32_t i = 0; i < metric.mHistoryCount; ++i) {
+            sorted[i] = metric.GetLastValue(i);
+        }
+        std::sort(sorted.begin(), sorted.end());
+        for (auto fraction : FRACTIONS) {
+            auto rank = (uint32_t) ceil((double) fraction * sorted.size());
+            auto expected = sorted[std::min((uint32_t) sorted.size(), std::max(1u, rank)) - 1];
+            auto value = metric.GetPercentileValue(fraction);
+            if (fabsf(value - expected) > 0.004f * fabsf(expected)) {
+                fprintf(stderr, "error: %s: %g percentile is %g, expected %g\n", what, fraction * 100.f, value, expected);
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // Values added one at a time, checked as the history fills and after
+    // it wraps around
+    for (uint32_t i = 0; i < 25; ++i) {
+        generateValues(100, -40, 40);
+        for (auto value : values) {
+            metric.AddNewValue(value);
+        }
+        if (!check("after AddNewValue()")) {
+            return false;
+        }
+    }
+
+    // Batches of part of the history and of more than the history
+    for (auto count : { 1u, 300u, 999u, 1000u, 2300u }) {
+        generateValues(count, -10, 10);
+        metric.AddNewValues(values.data(), count);
+        if (!check("after AddNewValues()")) {
+            return false;
+        }
+    }
+
+    // Reinitialized with the same and with a different history size
+    for (auto historySize : { 1000u, 300u }) {
+        metric.Initialize("Percentiles", "", MetricsGuiMetric::TRACK_PERCENTILES, historySize);
+        for (uint32_t i = 0; i < 5; ++i) {
+            generateValues(150, -20, 20);
+            metric.AddNewValues(values.data(), (uint32_t) values.size());
+            if (!check("after Initialize()")) {
+                return false;
+            }
+        }
+    }
+
+    // Mostly zeros, of either sign, so that the median is zero
+    metric.Initialize("Percentiles", "", MetricsGuiMetric::TRACK_PERCENTILES, 1000);
+    for (auto zero : { -0.f, 0.f }) {
+        generateValues(300, -20, 20);
+        values.resize(1000, zero);
+        metric.AddNewValues(values.data(), (uint32_t) values.size());
+        if (!check("with mostly zeros")) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// DrawDistribution()'s bins must hold all of each metric's history values,
+// with values outside of the range counted in the first or last bin, for
+// fixed, fitted, and logarithmic ranges, and for histories with negative
+// values and zeros, a single repeated value, and no values.
+bool CheckDistributionBins()
+{
+    struct BinsCase {
+        float mMinValue;
+        float mMaxValue;
+        bool mLogBins;
+        uint32_t mBinCount;
+    };
+    BinsCase const CASES[] = {
+        {     0.f,     0.f, false, 32 },    // fit
+        {     0.f,     0.f, false,  0 },    // fit, with as many bins as fit the plot
+        {     0.f,     0.f, false,  1 },
+        {     1.f,   100.f, false, 32 },    // fixed, within the values
+        {  -1e6f,    1e6f,  false, 10 },    // fixed, beyond the values
+        {     0.f,     0.f, true,  32 },    // log, fit
+        {    0.1f,   100.f, true,  32 },    // log, fixed
+        {    -1.f,    10.f, true,   7 },    // log, with the minimum fit
+    };
+
+    enum { METRIC_COUNT = 5 };
+    MetricsGuiMetric metrics[METRIC_COUNT];
+    for (auto& metric : metrics) {
+        metric.Initialize("Distribution", "", MetricsGuiMetric::TRACK_PERCENTILES, 300);
+    }
+    uint32_t seed = 1;
+    for (uint32_t i = 0; i < 1000; ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        auto magnitude = ldexpf(1.f + (float) (seed >> 8 & 0xffff) / (1 << 16), (int) (seed >> 24 & 0x1f) - 12);
+        metrics[0].AddNewValue(magnitude);                      // positive values spanning many powers of two
+        metrics[1].AddNewValue((seed & 3) == 0 ? 0.f :          // negative and positive values, and zeros
+                               (seed & 3) == 1 ? -magnitude : magnitude);
+        metrics[2].AddNewValue(3.f);                            // a single value
+        if (i < 100) {
+            metrics[3].AddNewValue(magnitude);                  // a history that hasn't filled
+        }
+    }
+    // metrics[4] has no values
+
+    MetricsGuiPlot plot;
+    for (auto& metric : metrics) {
+        plot.AddMetric(&metric);
+    }
+    for (auto const& binsCase : CASES) {
+        plot.mDistributionMinValue = binsCase.mMinValue;
+        plot.mDistributionMaxValue = binsCase.mMaxValue;
+        plot.mDistributionLogBins = binsCase.mLogBins;
+        plot.mDistributionBinCount = binsCase.mBinCount;
+
+        ImGui::NewFrame();
+        ImGui::SetNextWindowPos(ImVec2(0.f, 0.f));
+        ImGui::SetNextWindowSize(ImGui::GetIO().DisplaySize);
+        ImGui::Begin("Distribution", nullptr, ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoSavedSettings);
+        plot.DrawDistribution();
+        ImGui::End();
+        ImGui::Render();
+
+        auto const& binFractions = plot.mDrawScratch.mBinFractions;
+        auto binCount = (uint32_t) (binFractions.size() / METRIC_COUNT);
+        if (binCount == 0 || (binsCase.mBinCount != 0 && binCount != binsCase.mBinCount)) {
+            fprintf(stderr, "error: %u bins were drawn, expected %u\n", binCount, binsCase.mBinCount);
+            return false;
+        }
+        for (uint32_t i = 0; i < METRIC_COUNT; ++i) {
+            auto sum = 0.;
+            for (uint32_t j = 0; j < binCount; ++j) {
+                sum += binFractions[i * binCount + j];
+            }
+            auto count = sum * metrics[i].mPercentileHistogram->mCount;
+            if (fabs(count - metrics[i].mHistoryCount) > 1e-3 * metrics[i].mHistoryCount) {
+                fprintf(stderr, "error: metric %u's %u %s bins in [%g, %g] hold %g values, expected %u\n",
+                    i, binCount, binsCase.mLogBins ? "log" : "linear", binsCase.mMinValue, binsCase.mMaxValue, count, metrics[i].mHistoryCount);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// A sample of MetricsGuiCreateQuantityLabel() outputs must match
+// snprintf()'s, in every FORMAT_CASES case: floats spread over the whole
+// range, and floats with at most 7 mantissa bits, which include the ties in
+// rounding to thousandths.  --format compares them exhaustively.
+bool CheckQuantityLabels()
+{
+    enum { STRIDE = 65521 };
+    uint64_t mismatchCount = 0;
+    for (size_t i = 0; i < _countof(FORMAT_CASES); ++i) {
+        mismatchCount += CompareQuantityLabels(FORMAT_CASES[i], i, STRIDE, 0, 64);
+        mismatchCount += CompareQuantityLabels(FORMAT_CASES[i], 0, 1, 16, 64);
+    }
+    return mismatchCount == 0;
+}
+
+struct CaptureTestColumn {
+    std::vector<uint64_t> mTimestamps;
+    std::vector<float> mValues;
+};
+
+float FloatFromBits(
+    uint32_t bits)
+{
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+// Check that a column reader returns exactly the column's bits, whether read
+// through or after skipping some values.
+bool CheckCaptureColumnReader(
+    char const* name,
+    size_t columnIndex,
+    CaptureTestColumn const& column,
+    CaptureColumnReader const& reader)
+{
+    auto count = (uint32_t) column.mValues.size();
+    for (uint32_t skip = 0; skip < count; skip = skip * 2 + 1) {
+        auto skipReader = reader;
+        skipReader.Skip(skip);
+        for (uint32_t i = skip; i <= count; ++i) {
+            uint64_t timestamp = 0;
+            float value = 0.f;
+            auto read = skipReader.Read(&timestamp, &value);
+            if (read != (i < count) || (read && (
+                timestamp != column.mTimestamps[i] ||
+                memcmp(&value, &column.mValues[i], sizeof(value)) != 0))) {
+                uint32_t bits;
+                memcpy(&bits, &value, sizeof(bits));
+                fprintf(stderr, "error: %s column %zu value %u after skipping %u decoded as (%llu, 0x%08x)\n",
+                    name, columnIndex, i, skip, (unsigned long long) timestamp, bits);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Encode the columns of a block as MetricsGuiCaptureWriter does, sharing
+// timestamps with the previous compressed column and falling back to
+// CAPTURE_ENCODING_RAW when compression doesn't help, and check that each
+// column decodes to exactly the bits it was encoded from.  The compressed
+// data is checked even for columns stored uncompressed.  Returns the
+// number of RAW columns in *rawCount.
+bool RoundTripCaptureColumns(
+    char const* name,
+    std::vector<CaptureTestColumn> const& columns,
+    uint32_t* rawCount)
+{
+    std::vector<std::vector<uint64_t>> words(columns.size());
+    std::vector<CaptureColumnHeader> headers(columns.size());
+    CaptureTestColumn const* prevEncodedColumn = nullptr;
+    CaptureColumnReader prevReader;
+    *rawCount = 0;
+    for (size_t c = 0; c < columns.size(); ++c) {
+        auto const& column = columns[c];
+        auto count = (uint32_t) column.mValues.size();
+        auto storeTimestamps = prevEncodedColumn == nullptr || prevEncodedColumn->mTimestamps != column.mTimestamps;
+        EncodeCaptureColumn(column.mTimestamps.data(), column.mValues.data(), count, storeTimestamps, &words[c]);
+
+        auto header = &headers[c];
+        *header = {};
+        header->mEncoding = CAPTURE_ENCODING_GORILLA;
+        header->mValueCount = count;
+        header->mByteCount = (uint32_t) (words[c].size() * sizeof(uint64_t));
+        header->mFirstTimestamp = column.mTimestamps.front();
+        header->mLastTimestamp = column.mTimestamps.back();
+
+        CaptureColumnReader reader;
+        if (!reader.Initialize(header, words[c].data(), prevEncodedColumn != nullptr ? &prevReader : nullptr)) {
+            fprintf(stderr, "error: %s column %zu failed to initialize\n", name, c);
+            return false;
+        }
+        if (!CheckCaptureColumnReader(name, c, column, reader)) {
+            return false;
+        }
+
+        auto rawByteCount = AlignCaptureSize(count * (sizeof(uint64_t) + sizeof(float)));
+        if (header->mByteCount < rawByteCount) {
+            prevEncodedColumn = &column;
+            prevReader = reader;
+            continue;
+        }
+
+        *rawCount += 1;
+        std::vector<uint64_t> raw(rawByteCount / sizeof(uint64_t), 0);
+        memcpy(raw.data(), column.mTimestamps.data(), count * sizeof(uint64_t));
+        memcpy((char*) raw.data() + count * sizeof(uint64_t), column.mValues.data(), count * sizeof(float));
+        CaptureColumnHeader rawHeader = *header;
+        rawHeader.mEncoding = CAPTURE_ENCODING_RAW;
+        rawHeader.mByteCount = (uint32_t) rawByteCount;
+        if (!reader.Initialize(&rawHeader, raw.data(), nullptr) ||
+            !CheckCaptureColumnReader(name, c, column, reader)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Capture columns must decode to exactly the bits encoded, in the cases the
+// format handles specially: one-value columns (whose timestamp stream is a
+// single zero bit), columns sharing timestamps, delta-of-deltas of every
+// size including the 64-bit escape, a 32-bit wide XOR window, NaN, -0, and
+// denormal values, and a column that falls back to CAPTURE_ENCODING_RAW.
+bool CheckCaptureEncoding()
+{
+    uint32_t rawCount = 0;
+
+    // One-value columns, which are stored uncompressed
+    std::vector<CaptureTestColumn> columns(2);
+    columns[0].mTimestamps.assign(1, 12345);
+    columns[0].mValues.assign(1, FloatFromBits(0x7fc00001));
+    columns[1] = columns[0];
+    columns[1].mValues[0] = -0.f;
+    if (!RoundTripCaptureColumns("one-value", columns, &rawCount)) {
+        return false;
+    }
+    if (rawCount != 2) {
+        fprintf(stderr, "error: %u one-value columns were stored uncompressed, expected 2\n", rawCount);
+        return false;
+    }
+
+    // Timestamps whose deltas-of-deltas take every payload size, in both
+    // directions and at the top of each size.
+    uint64_t const DELTAS[] = {
+        0, 1, 1, 100, 1, 20000, 1, 5000000, 1, 70000, 3, 20000000, 1, 1500000000, 7, 3000000000ull, 7,
+        1ull << 40, 1ull << 40, 1, 1ull << 62, 1ull << 62, 2, 0, 0, 1000,
+    };
+    // Value bits covering NaNs, infinities, signed zeros, denormals,
+    // repeated values, a window of all 32 bits, and windows that the next
+    // XOR fits in or doesn't.
+    uint32_t const VALUE_BITS[] = {
+        0x3f800000, 0xbf800001, 0x3f800000, 0x00000000, 0x80000000, 0x80000000,
+        0x7f800000, 0xff800000, 0x7fc00000, 0x7fa00001, 0xffffffff, 0x00000001,
+        0x00000001, 0x3f800010, 0x3f800020, 0x3f800030, 0x3f801000, 0x40490fdb,
+        0xc0490fdb, 0x00400000, 0x00000002, 0x80000001, 0x3f800001, 0x3f800003,
+        0xbf800003, 0x7f7fffff,
+    };
+    static_assert(_countof(DELTAS) == _countof(VALUE_BITS), "one value per timestamp");
+
+    columns.assign(5, CaptureTestColumn());
+    uint64_t timestamp = 1000;
+    for (size_t i = 0; i < _countof(DELTAS); ++i) {
+        timestamp += DELTAS[i];
+        columns[0].mTimestamps.emplace_back(timestamp);
+        columns[0].mValues.emplace_back(FloatFromBits(VALUE_BITS[i]));
+    }
+
+    // Sharing the first column's timestamps
+    columns[1].mTimestamps = columns[0].mTimestamps;
+    for (size_t i = 0; i < _countof(VALUE_BITS); ++i) {
+        columns[1].mValues.emplace_back(FloatFromBits(VALUE_BITS[_countof(VALUE_BITS) - 1 - i]));
+    }
+
+    // Random timestamps and values, which don't compress, followed by a
+    // long column that compresses, after the RAW column.
+    uint32_t seed = 1;
+    uint64_t randomTimestamp = 0;
+    for (uint32_t i = 0; i < 256; ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        randomTimestamp += (uint64_t) seed << (seed >> 27);
+        columns[2].mTimestamps.emplace_back(randomTimestamp);
+        seed = seed * 1664525u + 1013904223u;
+        columns[2].mValues.emplace_back(FloatFromBits(seed));
+    }
+    float value = 100.f;
+    for (uint32_t i = 0; i < 3000; ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        columns[3].mTimestamps.emplace_back(5000 + i * 8333333ull + (seed >> 20));
+        value += (float) (seed >> 30) - 1.5f;
+        columns[3].mValues.emplace_back(value);
+    }
+
+    // Sharing the long column's timestamps, after the RAW column
+    columns[4].mTimestamps = columns[3].mTimestamps;
+    columns[4].mValues.assign(columns[3].mValues.rbegin(), columns[3].mValues.rend());
+
+    if (!RoundTripCaptureColumns("mixed", columns, &rawCount)) {
+        return false;
+    }
+    if (rawCount != 1) {
+        fprintf(stderr, "error: %u columns were stored uncompressed, expected 1\n", rawCount);
+        return false;
+    }
+    return true;
+}
+
+// Capture values, writing them again if the writer drops them because its
+// background thread is behind, so that every value is captured.
+void WriteEveryValue(
+    MetricsGuiCaptureWriter* writer,
+    uint32_t first,
+    uint32_t count,
+    float const* values,
+    uint64_t timestamp)
+{
+    for (;;) {
+        auto droppedCount = writer->GetDroppedValueCount();
+        writer->WriteValues(first, count, values, timestamp);
+        if (writer->GetDroppedValueCount() == droppedCount) {
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+enum {
+    REPLAY_METRIC_COUNT     = 8,
+    REPLAY_FRAME_COUNT      = 300000,   // about six blocks
+    REPLAY_FRAME_COUNTS     = 1000,     // timer counts between frames
+    REPLAY_AHEAD_FRAMES     = 60000,    // metric 5's values are timestamped this far ahead
+    REPLAY_HISTORY_SIZE     = 300,
+};
+
+// Write a capture of several blocks, with metrics that have a value every
+// frame, every third frame, only in the first and last blocks, ahead of the
+// others so that blocks overlap in time, and never.  Each metric's values
+// are appended to its reference column.
+bool WriteReplayCapture(
+    char const* path,
+    bool compress,
+    std::vector<CaptureTestColumn>* reference)
+{
+    std::vector<MetricsGuiMetric> metrics(REPLAY_METRIC_COUNT);
+    std::vector<MetricsGuiMetric const*> metricPointers;
+    for (uint32_t i = 0; i < REPLAY_METRIC_COUNT; ++i) {
+        char description[32];
+        snprintf(description, _countof(description), "Replay %u", i);
+        metrics[i].Initialize(description, "ms", MetricsGuiMetric::USE_SI_UNIT_PREFIX);
+        metricPointers.emplace_back(&metrics[i]);
+    }
+
+    MetricsGuiCaptureWriter writer;
+    writer.mCompress = compress;
+    if (!writer.Open(path, metricPointers.data(), REPLAY_METRIC_COUNT)) {
+        fprintf(stderr, "error: failed to create %s\n", path);
+        return false;
+    }
+
+    reference->assign(REPLAY_METRIC_COUNT, CaptureTestColumn());
+    auto add = [&writer, reference](uint32_t first, uint32_t count, float const* values, uint64_t timestamp) {
+        WriteEveryValue(&writer, first, count, values, timestamp);
+        for (uint32_t i = 0; i < count; ++i) {
+            (*reference)[first + i].mTimestamps.emplace_back(timestamp);
+            (*reference)[first + i].mValues.emplace_back(values[i]);
+        }
+    };
+    for (uint32_t frame = 0; frame < REPLAY_FRAME_COUNT; ++frame) {
+        auto timestamp = (uint64_t) (frame + 1) * REPLAY_FRAME_COUNTS;
+        float values[5];
+        for (uint32_t i = 0; i < 5; ++i) {
+            values[i] = (float) frame + 0.25f * i;
+        }
+        add(0, 4, values, timestamp);
+        if (frame % 3 == 0) {
+            add(4, 1, &values[4], timestamp);
+        }
+        add(5, 1, &values[1], timestamp + (uint64_t) REPLAY_AHEAD_FRAMES * REPLAY_FRAME_COUNTS);
+        if (frame < 200 || frame >= REPLAY_FRAME_COUNT - 100) {
+            add(6, 1, &values[2], timestamp);
+        }
+    }
+
+    if (!writer.Close()) {
+        fprintf(stderr, "error: failed to write %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+struct TraceEvent {
+    std::string mName;
+    std::string mTimestamp;     // as written, in microseconds
+    std::string mValue;         // as written
+};
+
+// Parse a JSON string at *p into s, checking its escapes, that it has no
+// control characters, and that it is valid UTF-8.
+bool ParseTraceString(
+    char const** p,
+    std::string* s)
+{
+    auto q = *p;
+    if (*q++ != '"') {
+        return false;
+    }
+    s->clear();
+    for (;;) {
+        auto c = (unsigned char) *q++;
+        if (c == '"') {
+            break;
+        }
+        if (c < 0x20) {
+            return false;
+        }
+        if (c != '\\') {
+            s->push_back((char) c);
+            continue;
+        }
+        switch (*q++) {
+        case '"':  s->push_back('"'); break;
+        case '\\': s->push_back('\\'); break;
+        case '/':  s->push_back('/'); break;
+        case 'b':  s->push_back('\b'); break;
+        case 'f':  s->push_back('\f'); break;
+        case 'n':  s->push_back('\n'); break;
+        case 'r':  s->push_back('\r'); break;
+        case 't':  s->push_back('\t'); break;
+        case 'u': {
+            uint32_t u = 0;
+            for (uint32_t i = 0; i < 4; ++i, ++q) {
+                auto d = *q >= '0' && *q <= '9' ? *q - '0' : *q >= 'a' && *q <= 'f' ? *q - 'a' + 10 : *q >= 'A' && *q <= 'F' ? *q - 'A' + 10 : -1;
+                if (d < 0) {
+                    return false;
+                }
+                u = u * 16 + (uint32_t) d;
+            }
+            if (u >= 0x80) {
+                return false;   // only control characters are escaped
+            }
+            s->push_back((char) u);
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+
+    // Check that every UTF-8 sequence is complete.
+    for (size_t i = 0; i < s->size(); ) {
+        auto c = (unsigned char) (*s)[i];
+        auto length = c < 0x80 ? 1u : (c & 0xe0) == 0xc0 ? 2u : (c & 0xf0) == 0xe0 ? 3u : (c & 0xf8) == 0xf0 ? 4u : 0u;
+        if (length == 0 || i + length > s->size()) {
+            return false;
+        }
+        for (size_t j = i + 1; j < i + length; ++j) {
+            if (((unsigned char) (*s)[j] & 0xc0) != 0x80) {
+                return false;
+            }
+        }
+        i += length;
+    }
+    *p = q;
+    return true;
+}
+
+// Parse a JSON number at *p into s, as written.
+bool ParseTraceNumber(
+    char const** p,
+    std::string* s)
+{
+    auto q = *p;
+    auto digits = [&q]() {
+        auto start = q;
+        while (*q >= '0' && *q <= '9') {
+            ++q;
+        }
+        return q > start;
+    };
+    if (*q == '-') {
+        ++q;
+    }
+    if (*q == '0') {
+        ++q;
+    } else if (!digits()) {
+        return false;
+    }
+    if (*q == '.') {
+        ++q;
+        if (!digits()) {
+            return false;
+        }
+    }
+    if (*q == 'e' || *q == 'E') {
+        ++q;
+        if (*q == '+' || *q == '-') {
+            ++q;
+        }
+        if (!digits()) {
+            return false;
+        }
+    }
+    s->assign(*p, q);
+    *p = q;
+    return true;
+}
+
+// Read a trace written by MetricsGuiTraceWriter, checking that it is the
+// expected JSON, and append its counter events to events.
+bool ReadTrace(
+    char const* path,
+    uint32_t processId,
+    std::vector<TraceEvent>* events)
+{
+    std::string text;
+    if (auto file = fopen(path, "rb")) {
+        char buffer[4096];
+        size_t size = 0;
+        while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            text.append(buffer, size);
+        }
+        fclose(file);
+    } else {
+        fprintf(stderr, "error: failed to read %s\n", path);
+        return false;
+    }
+
+    auto p = text.c_str();
+    auto expect = [&p](char const* literal) {
+        auto size = strlen(literal);
+        if (strncmp(p, literal, size) != 0) {
+            return false;
+        }
+        p += size;
+        return true;
+    };
+    char pid[32];
+    snprintf(pid, _countof(pid), ",\"pid\":%u,\"args\":{\"value\":", processId);
+    auto ok = expect("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    for (auto first = true; ok && !expect("\n]}\n"); first = false) {
+        TraceEvent event;
+        ok = (first || expect(",")) &&
+             expect("\n{\"name\":") && ParseTraceString(&p, &event.mName) &&
+             expect(",\"ph\":\"C\",\"ts\":") && ParseTraceNumber(&p, &event.mTimestamp) &&
+             expect(pid) && ParseTraceNumber(&p, &event.mValue) &&
+             expect("}}");
+        events->emplace_back(event);
+    }
+    if (!ok || p != text.c_str() + text.size()) {
+        fprintf(stderr, "error: %s is malformed at byte %zu after %zu events\n", path, (size_t) (p - text.c_str()), events->size());
+        return false;
+    }
+    return true;
+}
+
+// The longest prefix of name, of whole UTF-8 characters, whose JSON escaped
+// size is at most MAX_NAME_BYTES: the name a trace gives the metric.
+std::string GetTraceName(
+    MetricsGuiMetric const& metric)
+{
+    auto name = metric.mDescription;
+    if (!metric.mUnits.empty()) {
+        name += " (" + metric.mUnits + ")";
+    }
+    size_t size = 0;
+    size_t escapedSize = 0;
+    while (size < name.size()) {
+        auto c = (unsigned char) name[size];
+        auto length = c < 0x80 ? 1u : (c & 0xe0) == 0xc0 ? 2u : (c & 0xf0) == 0xe0 ? 3u : 4u;
+        auto escapedLength = c == '"' || c == '\\' ? 2u : c < 0x20 ? 6u : length;
+        if (escapedSize + escapedLength > MetricsGuiTraceWriter::MAX_NAME_BYTES) {
+            break;
+        }
+        size += length;
+        escapedSize += escapedLength;
+    }
+    return name.substr(0, size);
+}
+
+// Compare a trace's events with each metric's values, in order for each
+// metric, skipping the values that aren't finite.
+bool CompareTraceEvents(
+    std::vector<TraceEvent> const& events,
+    std::vector<MetricsGuiMetric const*> const& metrics,
+    std::vector<CaptureTestColumn> const& columns,
+    char const* what)
+{
+    auto frequency = GetPerfTimerFrequency();
+    auto nanosecondsPerCount = 1e9 * (double) frequency.Denominator / (double) frequency.Numerator;
+
+    std::vector<size_t> next(metrics.size(), 0);
+    std::vector<std::string> names;
+    for (auto metric : metrics) {
+        names.emplace_back(GetTraceName(*metric));
+    }
+    for (size_t e = 0; e < events.size(); ++e) {
+        auto const& event = events[e];
+        auto i = (size_t) (std::find(names.begin(), names.end(), event.mName) - names.begin());
+        if (i == names.size()) {
+            fprintf(stderr, "error: %s: event %zu has an unexpected name \"%.40s...\" (%zu bytes)\n", what, e, event.mName.c_str(), event.mName.size());
+            return false;
+        }
+
+        auto const& column = columns[i];
+        auto& j = next[i];
+        while (j < column.mValues.size() && !std::isfinite(column.mValues[j])) {
+            ++j;
+        }
+        if (j == column.mValues.size()) {
+            fprintf(stderr, "error: %s: metric %zu has more events than finite values\n", what, i);
+            return false;
+        }
+
+        char timestamp[32];
+        auto ns = (uint64_t) ((double) column.mTimestamps[j] * nanosecondsPerCount + 0.5);
+        snprintf(timestamp, _countof(timestamp), "%llu.%03u", (unsigned long long) (ns / 1000), (uint32_t) (ns % 1000));
+        auto value = column.mValues[j];
+        auto integer = fabsf(value) < 1e9f && value == truncf(value);
+        if (event.mTimestamp != timestamp ||
+            (float) strtod(event.mValue.c_str(), nullptr) != value ||
+            integer != (event.mValue.find_first_of(".e") == std::string::npos)) {
+            fprintf(stderr, "error: %s: metric %zu's value %zu was written at %s as %s, expected %s and %.9g\n",
+                what, i, j, event.mTimestamp.c_str(), event.mValue.c_str(), timestamp, value);
+            return false;
+        }
+        ++j;
+    }
+    for (size_t i = 0; i < metrics.size(); ++i) {
+        auto const& column = columns[i];
+        auto j = next[i];
+        while (j < column.mValues.size() && !std::isfinite(column.mValues[j])) {
+            ++j;
+        }
+        if (j != column.mValues.size()) {
+            fprintf(stderr, "error: %s: metric %zu has %zu values that weren't written\n", what, i, column.mValues.size() - j);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Traces of metric histories and of a replayed capture must be well-formed
+// JSON with one counter event per finite value, at the values' times, with
+// names that are escaped and truncated without splitting UTF-8 sequences,
+// and integers written without a fraction, including events that straddle
+// buffer flushes.
+bool CheckTrace()
+{
+    enum {
+        HISTORY_SIZE        = 300,
+        HISTORY_VALUE_COUNT = 700,      // wraps around the histories
+        CAPTURE_FRAME_COUNT = 2000,
+    };
+
+    // Names to escape, and names that are truncated in the middle of a
+    // UTF-8 sequence, before an escape, after a UTF-8 sequence that fits
+    // exactly, and that fit exactly.
+    struct TraceMetric {
+        std::string mDescription;
+        std::string mUnits;
+        uint32_t mFlags;
+    };
+    std::vector<TraceMetric> traceMetrics;
+    traceMetrics.push_back({ "Quote \" backslash \\ newline \n tab \t control \x01\x1f del \x7f UTF-8 \xc3\xa9\xe6\xbc\xa2\xf0\x9f\x98\x80", "ms", MetricsGuiMetric::RECORD_TIMESTAMPS });
+    traceMetrics.push_back({ "xx", "s", MetricsGuiMetric::RECORD_TIMESTAMPS });
+    for (uint32_t i = 0; i < 400; ++i) {
+        traceMetrics.back().mDescription += "\xe2\x82\xac";
+    }
+    traceMetrics.push_back({ std::string(1020, 'y') + "\x01z", "", MetricsGuiMetric::RECORD_TIMESTAMPS });
+    traceMetrics.push_back({ std::string(1000, 'w'), "B", MetricsGuiMetric::RECORD_TIMESTAMPS });
+    for (uint32_t i = 0; i < 10; ++i) {
+        traceMetrics.back().mDescription += "\xf0\x9f\x98\x80";
+    }
+    traceMetrics.push_back({ "Fits", std::string(MetricsGuiTraceWriter::MAX_NAME_BYTES - 7, 'u'), MetricsGuiMetric::RECORD_TIMESTAMPS });
+    traceMetrics.push_back({ "No timestamps", "", MetricsGuiMetric::NONE });
+
+    // Integers on either side of the formatting fast path, other values,
+    // and values that aren't finite
+    float const VALUES[] = {
+        0.f, -0.f, 1.f, -1.f, 16777216.f, 999999936.f, 1e9f, -2147483648.f, 2147483648.f,
+        0.5f, -7.25f, 123456.7f, 1.5e-10f, -1e-45f, 3.4e38f, INFINITY, -INFINITY, NAN,
+    };
+
+    auto metricCount = (uint32_t) traceMetrics.size();
+    std::vector<MetricsGuiMetric> metrics(metricCount);
+    std::vector<MetricsGuiMetric const*> metricPointers;
+    for (uint32_t i = 0; i < metricCount; ++i) {
+        metrics[i].Initialize(traceMetrics[i].mDescription.c_str(), traceMetrics[i].mUnits.c_str(), traceMetrics[i].mFlags, HISTORY_SIZE);
+        metricPointers.emplace_back(&metrics[i]);
+    }
+
+    // A writer that isn't open closes successfully.
+    MetricsGuiTraceWriter trace;
+    if (!trace.Close() || trace.Open("") || !trace.Close()) {
+        fprintf(stderr, "error: a trace writer that isn't open didn't close successfully\n");
+        return false;
+    }
+
+    auto start = GetPerfTimerCount();
+    std::vector<CaptureTestColumn> historyColumns(metricCount);
+    for (uint32_t v = 0; v < HISTORY_VALUE_COUNT; ++v) {
+        for (uint32_t i = 0; i < metricCount; ++i) {
+            auto value = VALUES[(v + i) % _countof(VALUES)];
+            auto timestamp = start + (uint64_t) v * 1000003 + i;
+            metrics[i].AddNewValue(value, timestamp);
+            if (v >= HISTORY_VALUE_COUNT - HISTORY_SIZE && metrics[i].mTimestamps != nullptr) {
+                historyColumns[i].mTimestamps.emplace_back(timestamp);
+                historyColumns[i].mValues.emplace_back(value);
+            }
+        }
+    }
+
+    auto tracePath = GetTempFilePath("metrics_gui_check.json");
+    std::vector<TraceEvent> events;
+    if (!trace.Open(tracePath.c_str())) {
+        fprintf(stderr, "error: failed to create %s\n", tracePath.c_str());
+        return false;
+    }
+    trace.WriteHistories(metricPointers.data(), metricCount);
+    auto eventCount = trace.GetEventCount();
+    auto ok = trace.Close() &&
+        ReadTrace(tracePath.c_str(), trace.mProcessId, &events) &&
+        CompareTraceEvents(events, metricPointers, historyColumns, "histories");
+    if (ok && events.size() != eventCount) {
+        fprintf(stderr, "error: histories: %zu events were written, but GetEventCount() is %llu\n", events.size(), (unsigned long long) eventCount);
+        ok = false;
+    }
+
+    // A capture of the same metrics, replayed
+    auto capturePath = GetTempFilePath("metrics_gui_check.mgcap");
+    std::vector<CaptureTestColumn> captureColumns(metricCount);
+    MetricsGuiCaptureWriter writer;
+    ok = ok && writer.Open(capturePath.c_str(), metricPointers.data(), metricCount);
+    std::vector<float> values(metricCount);
+    for (uint32_t frame = 0; ok && frame < CAPTURE_FRAME_COUNT; ++frame) {
+        auto timestamp = start + (uint64_t) frame * 999983;
+        for (uint32_t i = 0; i < metricCount; ++i) {
+            values[i] = VALUES[(frame * 7 + i) % _countof(VALUES)];
+            captureColumns[i].mTimestamps.emplace_back(timestamp);
+            captureColumns[i].mValues.emplace_back(values[i]);
+        }
+        WriteEveryValue(&writer, 0, metricCount, values.data(), timestamp);
+    }
+    MetricsGuiCaptureReplay replay;
+    ok = ok && writer.Close() && replay.Open(capturePath.c_str()) && trace.Open(tracePath.c_str());
+    if (ok) {
+        replay.WriteTrace(&trace);
+        eventCount = trace.GetEventCount();
+        events.clear();
+        ok = trace.Close() &&
+            ReadTrace(tracePath.c_str(), trace.mProcessId, &events) &&
+            CompareTraceEvents(events, metricPointers, captureColumns, "replayed capture");
+        if (ok && events.size() != eventCount) {
+            fprintf(stderr, "error: replayed capture: %zu events were written, but GetEventCount() is %llu\n", events.size(), (unsigned long long) eventCount);
+            ok = false;
+        }
+    }
+    replay.Close();
+    remove(capturePath.c_str());
+    remove(tracePath.c_str());
+    return ok;
+}
+
+// Copy a capture without its index and footer, as if it had not been
+// closed.
+bool CopyUnclosedCapture(
+    char const* path,
+    char const* unclosedPath)
+{
+    std::vector<char> data;
+    auto file = fopen(path, "rb");
+    if (file != nullptr) {
+        char buffer[64 * 1024];
+        for (size_t n; (n = fread(buffer, 1, sizeof(buffer), file)) > 0; ) {
+            data.insert(data.end(), buffer, buffer + n);
+        }
+        fclose(file);
+    }
+
+    CaptureFileFooter footer;
+    if (data.size() < sizeof(footer)) {
+        return false;
+    }
+    memcpy(&footer, data.data() + data.size() - sizeof(footer), sizeof(footer));
+    if (footer.mMagic != CAPTURE_FOOTER_MAGIC || footer.mIndexOffset > data.size()) {
+        return false;
+    }
+
+    file = fopen(unclosedPath, "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    auto ok = fwrite(data.data(), 1, (size_t) footer.mIndexOffset, file) == footer.mIndexOffset;
+    return fclose(file) == 0 && ok;
+}
+
+// Compare a replayed metric's history with the last of the reference values
+// captured at or before time, and its timestamps with the reference's
+// relative to startTime.
+bool CompareReplayHistory(
+    char const* name,
+    uint32_t metricIndex,
+    MetricsGuiMetric const* metric,
+    CaptureTestColumn const& reference,
+    uint64_t startTime,
+    uint64_t time)
+{
+    auto n = (size_t) (std::upper_bound(reference.mTimestamps.begin(), reference.mTimestamps.end(), time) - reference.mTimestamps.begin());
+    auto count = (uint32_t) std::min(n, (size_t) metric->mHistorySize);
+    if (metric->mHistoryCount != count) {
+        fprintf(stderr, "error: %s metric %u at %llu has %u values, expected %u\n",
+            name, metricIndex, (unsigned long long) time, metric->mHistoryCount, count);
+        return false;
+    }
+    for (uint32_t k = 0; k < count; ++k) {
+        auto index = (metric->mHistoryHead + metric->mHistorySize - 1 - k) % metric->mHistorySize;
+        auto expected = n - 1 - k;
+        if (memcmp(&metric->mHistory[index], &reference.mValues[expected], sizeof(float)) != 0 ||
+            metric->mTimestamps[index] != reference.mTimestamps[expected] - startTime) {
+            fprintf(stderr, "error: %s metric %u at %llu has (%llu, %g) %u values back, expected (%llu, %g)\n",
+                name, metricIndex, (unsigned long long) time,
+                (unsigned long long) metric->mTimestamps[index], metric->mHistory[index], k,
+                (unsigned long long) (reference.mTimestamps[expected] - startTime), reference.mValues[expected]);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Advance one replay through the capture, mostly in steps shorter than a
+// block, and another by seeking to each time, and to the previous time and
+// advancing from there.  Compares the replays' histories with the reference
+// values at each time.
+bool CheckReplay(
+    char const* name,
+    char const* path,
+    std::vector<CaptureTestColumn> const& reference)
+{
+    MetricsGuiCaptureReplay advanced;
+    MetricsGuiCaptureReplay seeked;
+    if (!advanced.Open(path, REPLAY_HISTORY_SIZE) || !seeked.Open(path, REPLAY_HISTORY_SIZE)) {
+        fprintf(stderr, "error: failed to open %s capture %s\n", name, path);
+        return false;
+    }
+    if (advanced.GetMetricCount() != reference.size()) {
+        fprintf(stderr, "error: %s capture has %u metrics, expected %zu\n", name, advanced.GetMetricCount(), reference.size());
+        return false;
+    }
+
+    // Convert times as the replay does.
+    auto frequency = GetPerfTimerFrequency();
+    auto countsPerSecond = (double) frequency.Numerator / (double) frequency.Denominator;
+    auto startTime = (uint64_t) REPLAY_FRAME_COUNTS;
+    auto duration = advanced.GetDuration();
+
+    auto compare = [&](char const* replayName, MetricsGuiCaptureReplay const& replay, double seconds) {
+        auto time = startTime + (uint64_t) (seconds * countsPerSecond);
+        for (uint32_t i = 0; i < reference.size(); ++i) {
+            if (!CompareReplayHistory(replayName, i, replay.GetMetric(i), reference[i], startTime, time)) {
+                fprintf(stderr, "error: in %s capture\n", name);
+                return false;
+            }
+        }
+        return true;
+    };
+
+    uint32_t seed = 1;
+    double prevSeconds = 0.;
+    for (double seconds = 0.; ; ) {
+        seconds = std::min(seconds, duration);
+        advanced.Advance(seconds);
+        seeked.Seek(prevSeconds);
+        seeked.Advance(seconds);
+        if (!compare("advanced", advanced, seconds) || !compare("seeked and advanced", seeked, seconds)) {
+            return false;
+        }
+        seeked.Seek(seconds);
+        if (!compare("seeked", seeked, seconds)) {
+            return false;
+        }
+        if (seconds == duration) {
+            break;
+        }
+
+        // Occasionally skip more than a block, which Advance() does by
+        // seeking.
+        seed = seed * 1664525u + 1013904223u;
+        auto frameCount = (seed >> 8) % 32 == 0 ? 100000 : (seed >> 8) % 4000;
+        prevSeconds = seconds;
+        seconds += (double) (frameCount * REPLAY_FRAME_COUNTS + REPLAY_FRAME_COUNTS / 2) / countsPerSecond;
+    }
+    return true;
+}
+
+// Replayed captures must match the values written, whether seeking or
+// advancing, in compressed, uncompressed, and unclosed captures whose
+// blocks overlap in time and don't all contain every metric.
+bool CheckCaptureReplay()
+{
+    auto path = GetTempFilePath("metrics_gui_check.mgcap");
+    auto unclosedPath = GetTempFilePath("metrics_gui_check_unclosed.mgcap");
+    std::vector<CaptureTestColumn> reference;
+    auto passed =
+        WriteReplayCapture(path.c_str(), false, &reference) &&
+        CheckReplay("uncompressed", path.c_str(), reference) &&
+        WriteReplayCapture(path.c_str(), true, &reference) &&
+        CheckReplay("compressed", path.c_str(), reference) &&
+        CopyUnclosedCapture(path.c_str(), unclosedPath.c_str()) &&
+        CheckReplay("unclosed", unclosedPath.c_str(), reference);
+    remove(path.c_str());
+    remove(unclosedPath.c_str());
+    return passed;
+}
+
+struct Check {
+    char const* mName;
+    bool (*mFn)();
+};
+
+Check const CHECKS[] = {
+    { "stacked totals after Initialize()", CheckStackedReinitialize },
+    { "AddNewValues() matches AddNewValue()", CheckAddNewValues },
+    { "percentiles match the sorted history", CheckPercentiles },
+    { "distribution bins hold every value", CheckDistributionBins },
+    { "value queues with concurrent producers", CheckValueQueueStress },
+    { "value queue timestamps", CheckValueQueueTimestamp },
+    { "quantity labels match snprintf()", CheckQuantityLabels },
+    { "capture columns decode to the values encoded", CheckCaptureEncoding },
+    { "capture replay matches the values captured", CheckCaptureReplay },
+    { "traces hold every finite value", CheckTrace },
+};
+
+bool RunChecks()
+{
+    auto passed = true;
+    for (auto const& check : CHECKS) {
+        auto ok = check.mFn();
+        printf("%-50s %s\n", check.mName, ok ? "ok" : "FAILED");
+        passed = passed && ok;
+    }
+    return passed;
+}
+
+bool ParseUInt(
+    char const* s,
+    uint32_t* value)
+{
+    char* end = nullptr;
+    auto v = strtoul(s, &end, 10);
+    if (end == s || *end != '\0') {
+        return false;
+    }
+    *value = (uint32_t) v;
+    return true;
+}
+
+}
+
+int main(
+    int argc,
+    char** argv)
+{
+    Scenario scenario = { 64, 4, MetricsGuiMetric::NUM_HISTORY_SAMPLES, PLOT_MODE_LINE, false, false, false };
+    Options options = { 1000, 100, 1280.f, 720.f };
+    auto customScenario = false;
+    auto customMetricCount = false;
+    auto capture = false;
+    auto shared = false;
+    auto check = false;
+    auto timer = false;
+    auto format = false;
+    auto reduce = false;
+    auto tsc = false;
+
+    // Parse command line
+    for (int i = 1; i < argc; ++i) {
+        auto arg = argv[i];
+        auto value = i + 1 < argc ? argv[i + 1] : "";
+        uint32_t u = 0;
+        if (strcmp(arg, "--metrics") == 0 && ParseUInt(value, &u) && u > 0) {
+            scenario.mMetricCount = u;
+            customScenario = true;
+            customMetricCount = true;
+            ++i;
+            continue;
+        }
+        if (strcmp(arg, "--plots") == 0 && ParseUInt(value, &u)) {
+            scenario.mPlotCount = u;
+            customScenario = true;
+            ++i;
+            continue;
+        }
+        if (strcmp(arg, "--history") == 0 && ParseUInt(value, &u) && u > 0) {
+            scenario.mHistorySize = u;
+            customScenario = true;
+            ++i;
+            continue;
+        }
+        if (strcmp(arg, "--mode") == 0) {
+            auto found = false;
+            for (uint32_t mode = 0; mode < _countof(PLOT_MODE_NAMES); ++mode) {
+                if (strcmp(value, PLOT_MODE_NAMES[mode]) == 0) {
+                    scenario.mMode = (PlotMode) mode;
+                    found = true;
+                }
+            }
+            if (found) {
+                customScenario = true;
+                ++i;
+                continue;
+            }
+        }
+        if (strcmp(arg, "--list") == 0) {
+            scenario.mDrawList = true;
+            customScenario = true;
+            continue;
+        }
+        if (strcmp(arg, "--inline") == 0) {
+            scenario.mDrawList = true;
+            scenario.mInlineGraphs = true;
+            customScenario = true;
+            continue;
+        }
+        if (strcmp(arg, "--registry") == 0) {
+            scenario.mRegistry = true;
+            customScenario = true;
+            continue;
+        }
+        if (strcmp(arg, "--frames") == 0 && ParseUInt(value, &u) && u > 0) {
+            options.mFrameCount = u;
+            ++i;
+            continue;
+        }
+        if (strcmp(arg, "--warmup") == 0 && ParseUInt(value, &u)) {
+            options.mWarmupFrameCount = u;
+            ++i;
+            continue;
+        }
+        if (strcmp(arg, "--capture") == 0) {
+            capture = true;
+            continue;
+        }
+        if (strcmp(arg, "--check") == 0) {
+            check = true;
+            continue;
+        }
+        if (strcmp(arg, "--timer") == 0) {
+            timer = true;
+            continue;
+        }
+        if (strcmp(arg, "--reduce") == 0) {
+            reduce = true;
+            continue;
+        }
+        if (strcmp(arg, "--format") == 0) {
+            format = true;
+            continue;
+        }
+        if (strcmp(arg, "--tsc") == 0) {
+            tsc = true;
+            continue;
+        }
+#ifndef _WIN32
+        if (strcmp(arg, "--shared") == 0) {
+            shared = true;
+            continue;
+        }
+#endif
+        uint32_t u2 = 0;
+        if (strcmp(arg, "--size") == 0 && i + 2 < argc &&
+            ParseUInt(value, &u) && u > 0 &&
+            ParseUInt(argv[i + 2], &u2) && u2 > 0) {
+            options.mWindowWidth = (float) u;
+            options.mWindowHeight = (float) u2;
+            i += 2;
+            continue;
+        }
+
+        fprintf(stderr, "error: unrecognized or invalid argument '%s'\n", arg);
+        fprintf(stderr, "usage: metrics_gui_benchmark [options]\n");
+        fprintf(stderr, "options:\n");
+        fprintf(stderr, "    --metrics N               number of metrics (default 64)\n");
+        fprintf(stderr, "    --plots N                 number of plots sharing the metrics (default 4)\n");
+        fprintf(stderr, "    --history N               history size of each metric (default 256)\n");
+        fprintf(stderr, "    --mode line|bar|stacked   DrawHistory() plot mode (default line), or distribution for\n");
+        fprintf(stderr, "                              DrawDistribution() of TRACK_PERCENTILES metrics\n");
+        fprintf(stderr, "    --list                    also draw all metrics with DrawList()\n");
+        fprintf(stderr, "    --inline                  --list, with inline plots of selected metrics\n");
+        fprintf(stderr, "    --registry                create the metrics in a MetricsGuiRegistry\n");
+        fprintf(stderr, "    --frames N                number of measured frames (default 1000)\n");
+        fprintf(stderr, "    --warmup N                number of frames to run before measuring (default 100)\n");
+        fprintf(stderr, "    --size W H                window size in pixels (default 1280 720)\n");
+        fprintf(stderr, "    --tsc                     time with the x86 TSC rather than clock_gettime() (Linux)\n");
+        fprintf(stderr, "    --check                   run consistency checks instead, and exit non-zero if any fails\n");
+        fprintf(stderr, "    --timer                   measure the overhead of the perf timer and of a zone instead\n");
+        fprintf(stderr, "    --reduce                  measure the history reductions at each supported instruction\n");
+        fprintf(stderr, "                              set level instead; exits non-zero if the results differ\n");
+        fprintf(stderr, "    --format                  compare quantity labels with snprintf() on every float, and\n");
+        fprintf(stderr, "                              measure both, instead; exits non-zero on any difference\n");
+        fprintf(stderr, "    --capture                 measure capture compression and replay of --frames frames of\n");
+        fprintf(stderr, "                              --metrics metrics (default 5000) instead; exits non-zero if\n");
+        fprintf(stderr, "                              any value doesn't decode to the value encoded\n");
+#ifndef _WIN32
+        fprintf(stderr, "    --shared                  measure the latency and throughput of values sent by another\n");
+        fprintf(stderr, "                              process, in batches of --metrics values (default 64), instead\n");
+#endif
+        fprintf(stderr, "If no scenario options are given, a default set of scenarios is run.  The benchmark\n");
+        fprintf(stderr, "exits non-zero if any frame after the warm-up frames allocates memory.\n");
+        return 1;
+    }
+
+    // The timer mode is process-wide and fixed on first use, so it must be
+    // chosen before anything is timed
+    if (tsc && !SetPerfTimerUseTsc(true)) {
+        fprintf(stderr, "warning: the TSC is not supported; using the default timer\n");
+    }
+
+    if (check) {
+        InitializeImGui(options);
+        auto passed = RunChecks();
+        ImGui::Shutdown();
+        return passed ? 0 : 1;
+    }
+    if (timer) {
+        RunTimerBenchmark();
+        return 0;
+    }
+    if (format) {
+        return RunFormatBenchmark() ? 0 : 1;
+    }
+    if (reduce) {
+        return RunReduceBenchmark() ? 0 : 1;
+    }
+    if (capture) {
+        return RunCaptureBenchmark(customMetricCount ? scenario.mMetricCount : 5000, options.mFrameCount) ? 0 : 1;
+    }
+#ifndef _WIN32
+    if (shared) {
+        return RunSharedBenchmark(scenario.mMetricCount) ? 0 : 1;
+    }
+#endif
+
+    InitializeImGui(options);
+
+    // Frames are expected not to allocate once warmed up, so any allocation
+    // in a measured frame fails the benchmark
+    auto allocationFree = true;
+    PrintResultHeader();
+    if (customScenario) {
+        auto result = RunScenario(scenario, options);
+        PrintResult(scenario, result);
+        allocationFree = result.mAllocationCount == 0.;
+    } else {
+        for (auto const& defaultScenario : DEFAULT_SCENARIOS) {
+            auto result = RunScenario(defaultScenario, options);
+            PrintResult(defaultScenario, result);
+            allocationFree = allocationFree && result.mAllocationCount == 0.;
+        }
+    }
+
+    ImGui::Shutdown();
+
+    if (!allocationFree && options.mWarmupFrameCount > 0) {
+        fprintf(stderr, "error: heap allocations were made after %u warm-up frames\n", options.mWarmupFrameCount);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,173 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#ifndef METRICS_GUI_CAPTURE_H
+#define METRICS_GUI_CAPTURE_H
+
+#include "metrics_gui.h"
+
+struct MetricsGuiTraceWriter;
+
+// A MetricsGuiCaptureWriter streams metric values to a file, so that they
+// can be inspected after they have scrolled out of the metrics' histories:
+//
+//   MetricsGuiCaptureWriter capture;
+//   capture.Open("session.mgcap", registry);
+//
+//   // Each frame, along with adding the values to the metrics:
+//   for (uint32_t i = 0; i < metricCount; ++i) {
+//       registry.GetMetric(i)->AddNewValue(values[i]);
+//   }
+//   capture.WriteValues(0, metricCount, values);
+//
+//   capture.Close();
+//
+// WriteValues() only copies the values into a buffer.  Full buffers are
+// handed to a background thread, which sorts the values into blocks of
+// BLOCK_VALUE_COUNT values stored by metric (each with its timestamps) and
+// appends them to the file.  If mCompress is set, each metric's values in a
+// block are compressed by storing the differences between successive
+// timestamps' deltas and the XOR of successive values, which takes 1-2 bits
+// for steady timestamps and repeated values.  Closing the capture writes an
+// index of the blocks' file offsets and time ranges, so that a reader can
+// seek to a time without reading the whole file.
+//
+// If the background thread falls MAX_BUFFER_COUNT buffers behind, values
+// are dropped rather than blocking the caller.  WriteValues() must only be
+// called from one thread at a time, and each metric's timestamps must not
+// decrease.
+struct MetricsGuiCaptureWriter {
+    enum {
+        BUFFER_BYTES        = 1024 * 1024,  // size of the buffers handed to the background thread
+        MAX_BUFFER_COUNT    = 16,
+        BLOCK_VALUE_COUNT   = 256 * 1024,   // values per block, which is the granularity of seeking
+    };
+
+    struct State;
+    State* mState;      // nullptr if not open
+    bool mCompress;     // compress the values, set before Open() (default true)
+
+    MetricsGuiCaptureWriter();
+    ~MetricsGuiCaptureWriter();
+
+    // Create the file and start the background thread.  Metrics are
+    // identified by their index in metrics (or by their registry handle),
+    // and their descriptions, units, and flags are written to the file.
+    bool Open(char const* path, MetricsGuiMetric const* const* metrics, uint32_t metricCount);
+    bool Open(char const* path, MetricsGuiRegistry const& registry);
+
+    // Capture values[i] as a value of metric first+i, at the given
+    // GetPerfTimerCount() time or the current time.
+    void WriteValues(uint32_t first, uint32_t count, float const* values);
+    void WriteValues(uint32_t first, uint32_t count, float const* values, uint64_t timestamp);
+
+    // Hand the values captured so far to the background thread rather than
+    // waiting for the buffer to fill.
+    void Flush();
+
+    // Write the remaining values and the index, and close the file.
+    // Returns false if the file could not be written.
+    bool Close();
+
+    // Number of values dropped because the background thread fell behind.
+    uint64_t GetDroppedValueCount() const;
+
+private:
+    MetricsGuiCaptureWriter(MetricsGuiCaptureWriter const&);
+    MetricsGuiCaptureWriter& operator=(MetricsGuiCaptureWriter const&);
+};
+
+// A MetricsGuiCaptureReplay maps a capture file and adds its values to one
+// metric per captured metric, as if they were being captured live, so they
+// can be shown with the usual MetricsGuiPlot functions:
+//
+//   MetricsGuiCaptureReplay replay;
+//   replay.Open("session.mgcap");
+//   for (uint32_t i = 0, N = replay.GetMetricCount(); i < N; ++i) {
+//       plot.AddMetric(replay.GetMetric(i));
+//   }
+//   plot.mTimeWindow = 2.f;
+//
+//   // Each frame:
+//   replay.Update(elapsedSeconds);
+//   replay.DrawControls();
+//   plot.UpdateAxes();
+//
+// The metrics have RECORD_TIMESTAMPS, with the capture's timestamps
+// converted to this process's GetPerfTimerCount() units.
+//
+// Only the parts of the file around the replay time are read.  Seek() finds
+// the block containing the time in the index and walks back at most
+// SEEK_BLOCK_COUNT blocks to fill the metrics' histories, so opening and
+// seeking a large capture doesn't depend on its size.  A capture that was
+// not closed is indexed by walking its block headers.
+struct MetricsGuiCaptureReplay {
+    enum {
+        SEEK_BLOCK_COUNT    = 16,   // maximum number of blocks read to fill the histories when seeking
+    };
+
+    struct State;
+    State* mState;  // nullptr if not open
+    float mSpeed;   // playback rate relative to real time
+    bool mPlaying;
+
+    MetricsGuiCaptureReplay();
+    ~MetricsGuiCaptureReplay();
+
+    // Map the file and create its metrics, with histories of historySize
+    // values.  The replay starts paused at the beginning of the capture.
+    bool Open(char const* path, uint32_t historySize = MetricsGuiMetric::NUM_HISTORY_SAMPLES);
+    void Close();
+
+    uint32_t GetMetricCount() const;
+    MetricsGuiMetric* GetMetric(uint32_t index) const;
+
+    // Times are in seconds since the first captured value.
+    double GetDuration() const;
+    double GetTime() const;
+
+    // Replace the metrics' histories with the values captured up to time.
+    void Seek(double time);
+
+    // Add the values captured between the current time and time.  Seeking
+    // backwards, or too far ahead, falls back to Seek().
+    void Advance(double time);
+
+    // If playing, advance by elapsedSeconds * mSpeed, and pause at the end
+    // of the capture.
+    void Update(float elapsedSeconds);
+
+    // Draw play/pause, time, and speed controls.
+    void DrawControls();
+
+    // Write every captured value to trace, at the captured times converted
+    // to GetPerfTimerCount() units (rather than relative to the start of the
+    // capture like the metrics' timestamps).  The capture is decoded a
+    // column at a time, so this doesn't change the metrics and its memory
+    // use doesn't depend on the capture's size.
+    void WriteTrace(MetricsGuiTraceWriter* trace) const;
+
+private:
+    MetricsGuiCaptureReplay(MetricsGuiCaptureReplay const&);
+    MetricsGuiCaptureReplay& operator=(MetricsGuiCaptureReplay const&);
+};
+
+#endif // ifndef METRICS_GUI_CAPTURE_H
@@ -32,33 +32,173 @@ struct MetricsGuiMetric {
         USE_SI_UNIT_PREFIX      = 1u << 1,
         KNOWN_MIN_VALUE         = 1u << 2,
         KNOWN_MAX_VALUE         = 1u << 3,
+        USE_BINARY_UNIT_PREFIX  = 1u << 4,  // scale by 1024 using Ki, Mi, Gi, Ti prefixes
+        RECORD_TIMESTAMPS       = 1u << 5,  // record when each value was added, see mTimestamps
+        TRACK_PERCENTILES       = 1u << 6,  // maintain mPercentileHistogram, see GetPercentileValue() and MetricsGuiPlot::DrawDistribution()
     };
 
-    enum { NUM_HISTORY_SAMPLES = 256 };
+    // mUnits and the unit prefix flags as parsed by Initialize().  Labels
+    // scale values by powers of 1000 (or 1024 for binary prefixes) from
+    // mPrefix, limited to [mMinPrefix, mMaxPrefix], and append the new
+    // prefix and the units starting at mBaseUnitsOffset.  E.g., "ms" with
+    // USE_SI_UNIT_PREFIX has mPrefix -1 (milli), scales between -3 (nano)
+    // and 4 (tera), and has base units "s".  Without a prefix flag,
+    // mMinPrefix == mMaxPrefix == mPrefix == 0 and mUnits is shown as is.
+    // mUnitsId is different for each Initialize() call, so that cached
+    // labels can tell units apart without comparing strings.
+    struct UnitInfo {
+        uint32_t mUnitsId;
+        uint32_t mBaseUnitsOffset;
+        int8_t mPrefix;
+        int8_t mMinPrefix;
+        int8_t mMaxPrefix;
+        bool mBinaryPrefix;
+    };
+
+    // A log-linear histogram of the values in the history, updated as values
+    // are added and replaced so that percentiles can be estimated without
+    // sorting the history.  A value's bucket is selected by its sign and
+    // exponent, and its sub-bucket by the top SUB_BUCKET_BITS bits of its
+    // mantissa, so each sub-bucket spans less than 1% of its values.
+    // Sub-buckets are only allocated for buckets that have been used, which
+    // for most metrics is a handful.
+    struct PercentileHistogram {
+        enum {
+            BUCKET_COUNT        = 512,
+            SUB_BUCKET_BITS     = 7,
+            SUB_BUCKET_COUNT    = 1 << SUB_BUCKET_BITS,
+        };
+        std::vector<uint32_t> mSubBucketCounts;     // SUB_BUCKET_COUNT counts per allocated bucket
+        uint32_t mBucketCounts[BUCKET_COUNT];
+        uint16_t mSubBucketBlocks[BUCKET_COUNT];    // 1 + the index of the bucket's sub-bucket counts, or 0 if not allocated
+        uint32_t mCount;
+        PercentileHistogram();
+    };
+
+    enum { NUM_HISTORY_SAMPLES = 256 };    // default history size
 
     std::string mDescription;
     std::string mUnits;
+    UnitInfo mUnitInfo;     // call Initialize() if you change mUnits or the unit prefix flags
     double mTotalInHistory; // needs to be double for precision reasons (accumulating small deltas)
     uint32_t mHistoryCount;
+    uint32_t mHistorySize;  // capacity of mHistory
+    uint32_t mHistoryHead;  // index of the oldest value in mHistory (i.e., where the next value will be written)
+    uint32_t mHistoryTreeSize;
+    uint32_t mModifyCount;  // number of times history values have been changed other than by AddNewValue(), including by Initialize()
+    uint64_t mValueCount;   // number of values added since Initialize()
     float mColor[4];
-    float mHistory[NUM_HISTORY_SAMPLES];    // Don't forget to update mTotalInHistory if you modify this outside of AddNewValue()
+    float* mHistory;        // Circular buffer of mHistorySize values starting at mHistoryHead.  Call RebuildHistoryStatistics() if you modify this outside of AddNewValue()/SetLastValue()
+    float* mHistoryMinTree; // min/max/sum of mHistory ranges, used to summarize the history without scanning it
+    float* mHistoryMaxTree;
+    float* mHistorySumTree;
+    uint64_t* mTimestamps;  // Circular buffer of the GetPerfTimerCount() time of each mHistory value if RECORD_TIMESTAMPS, otherwise nullptr
+    PercentileHistogram* mPercentileHistogram;  // histogram of the last mHistoryCount values if TRACK_PERCENTILES, otherwise nullptr
     float mKnownMinValue;
     float mKnownMaxValue;
     uint32_t mFlags;
     bool mSelected;
+    bool mRegistryHistory;  // mHistory and the trees are owned by a MetricsGuiRegistry
 
     MetricsGuiMetric();
-    MetricsGuiMetric(char const* description, char const* units, uint32_t flags);
-    void Initialize(char const* description, char const* units, uint32_t flags);
+    MetricsGuiMetric(char const* description, char const* units, uint32_t flags, uint32_t historySize = NUM_HISTORY_SAMPLES);
+    MetricsGuiMetric(MetricsGuiMetric const& copy);
+    ~MetricsGuiMetric();
+    MetricsGuiMetric& operator=(MetricsGuiMetric const& copy);
+
+    // History storage is allocated from a pool shared by all metrics, so
+    // small histories only cost what they use.  Calling Initialize() clears
+    // the history.
+    void Initialize(char const* description, char const* units, uint32_t flags, uint32_t historySize = NUM_HISTORY_SAMPLES);
 
     void AddNewValue(float value);
+
+    // Add a value with an explicit timestamp, e.g., one recorded when the
+    // value was measured.  Timestamps are GetPerfTimerCount() values and
+    // must not decrease.  AddNewValue(value) uses the current time.
+    void AddNewValue(float value, uint64_t timestamp);
+
+    // Add valueCount values, oldest first.  Equivalent to calling
+    // AddNewValue() for each value, but the history statistics are updated
+    // once for the whole batch (and the values share one timestamp).
+    void AddNewValues(float const* values, uint32_t valueCount);
     float GetAverageValue() const;
 
+    // Get the smallest/largest value in the history buffer.
+    float GetHistoryMinValue() const;
+    float GetHistoryMaxValue() const;
+
+    // Estimate the value below which the given fraction (e.g., 0.95f) of the
+    // values in the history fall, to within 0.4%.  Requires
+    // TRACK_PERCENTILES; returns 0 otherwise or if the history is empty.
+    float GetPercentileValue(float fraction) const;
+
+    // Recompute mTotalInHistory, the history min/max, and the percentile
+    // histogram after modifying mHistory directly.
+    void RebuildHistoryStatistics();
+
     // Get and set values in the history buffer.  prevIndex==0 gets/sets last
-    // value added, prevIndex==NUM_HISTORY_SAMPLES-1 gets/sets the oldest
-    // stored value.
+    // value added, prevIndex==mHistorySize-1 gets/sets the oldest stored
+    // value.
     void SetLastValue(float value, uint32_t prevIndex = 0);
     float GetLastValue(uint32_t prevIndex = 0) const;
+
+private:
+    friend struct MetricsGuiRegistry;
+
+    // Construct with the history and range trees in storage owned by a
+    // MetricsGuiRegistry, without allocating either of them.
+    MetricsGuiMetric(char const* description, char const* units, uint32_t flags, uint32_t historySize, float* registryHistory, float* registryTrees);
+};
+
+// A MetricsGuiRegistry owns metrics in contiguous storage: metrics are
+// allocated in blocks of METRIC_BLOCK_SIZE, and their histories and range
+// trees are allocated from large slabs, in the order metrics are added.
+// Updating all of a registry's metrics in order therefore walks memory
+// linearly, rather than visiting separately allocated metrics and
+// histories.  The trees are allocated from their own slabs rather than
+// next to each history: every new value updates its metric's tree, and
+// packed together the trees of many metrics stay in cache.
+//
+// Metrics are never moved or removed, so their handles and pointers remain
+// valid for the lifetime of the registry.  If a registry metric is
+// re-Initialize()d with a different history size, its history is moved to
+// the shared history pool.
+typedef uint32_t MetricsGuiMetricHandle;
+
+struct MetricsGuiRegistry {
+    enum {
+        METRIC_BLOCK_SIZE   = 256,
+        HISTORY_SLAB_BYTES  = 1024 * 1024,
+        HISTORY_ALIGNMENT   = 64,
+    };
+
+    std::vector<MetricsGuiMetric*> mMetricBlocks;
+    std::vector<void*> mHistorySlabs;   // holds both history and tree slabs
+    uintptr_t mHistorySlabCursor;
+    uintptr_t mHistorySlabEnd;
+    uintptr_t mTreeSlabCursor;
+    uintptr_t mTreeSlabEnd;
+    uint32_t mMetricCount;
+
+    MetricsGuiRegistry();
+    ~MetricsGuiRegistry();
+
+    MetricsGuiMetricHandle AddMetric(char const* description, char const* units, uint32_t flags, uint32_t historySize = MetricsGuiMetric::NUM_HISTORY_SAMPLES);
+
+    MetricsGuiMetric* GetMetric(MetricsGuiMetricHandle handle) const
+    {
+        return &mMetricBlocks[handle / METRIC_BLOCK_SIZE][handle % METRIC_BLOCK_SIZE];
+    }
+
+    uint32_t GetMetricCount() const
+    {
+        return mMetricCount;
+    }
+
+private:
+    MetricsGuiRegistry(MetricsGuiRegistry const&);
+    MetricsGuiRegistry& operator=(MetricsGuiRegistry const&);
 };
 
 struct MetricsGuiPlot {
@@ -72,11 +212,93 @@ struct MetricsGuiPlot {
         void Initialize();
     };
 
+    // Running per-position totals of the stacked series, which are updated
+    // as values are added to the metrics so that UpdateAxes() doesn't have
+    // to re-sum every history.
+    struct StackedHistory {
+        struct MetricState {
+            MetricsGuiMetric const* mMetric;
+            uint64_t mValueCount;
+            uint32_t mModifyCount;
+        };
+        std::vector<MetricState> mMetricState;  // metric state when last updated
+        std::vector<float> mTotals;             // circular buffer starting at mHead
+        std::vector<float> mMinTree;
+        std::vector<float> mMaxTree;
+        uint32_t mHead;
+        uint32_t mTreeSize;
+        StackedHistory();
+    };
+
+    // The last text drawn for a quantity label and its size.  The label is
+    // only formatted again when its quantity, units (by UnitInfo::mUnitsId),
+    // or prefix (by address) change, and only measured again when its text
+    // or the font change.
+    struct QuantityLabel {
+        std::string mText;
+        char const* mPrefix;
+        uint32_t mUnitsId;
+        void const* mFont;
+        float mFontSize;
+        float mWidth;
+        float mHeight;
+        uint32_t mQuantityBits;
+        bool mFormatted;
+        QuantityLabel();
+    };
+
+    // Percentiles that can be shown in legends and drawn as lines, see
+    // mShowLegendPercentiles and mShowPercentiles.  They are computed for
+    // metrics with TRACK_PERCENTILES.
+    enum Percentiles {
+        PERCENTILE_50       = 1u << 0,
+        PERCENTILE_95       = 1u << 1,
+        PERCENTILE_99       = 1u << 2,
+    };
+    enum { PERCENTILE_COUNT = 3 };
+
+    // A metric's labels in a plot legend.
+    struct LegendLabels {
+        QuantityLabel mAvg;
+        QuantityLabel mPercentiles[PERCENTILE_COUNT];   // highest percentile first
+    };
+
+    struct MetricLabels {
+        QuantityLabel mValue;       // DrawList() value
+        QuantityLabel mInlineMax;   // DrawList() inline plot legend
+        QuantityLabel mInlineMin;
+        LegendLabels mInlineLegend;
+        LegendLabels mLegend;       // DrawHistory() legend
+    };
+
+    // Buffers reused by DrawList() and DrawHistory(), so that drawing
+    // doesn't allocate once they have grown to fit.
+    struct DrawScratch {
+        std::vector<MetricsGuiMetric*> mInlineMetrics;  // the metric of a DrawList() inline plot
+        std::vector<LegendLabels*> mLegendLabels;       // legend labels of each metric being drawn
+        std::vector<uint32_t> mLegendOrder;             // metric indices in legend order
+        std::vector<float> mBaseValues;                 // stacked value below each plot point
+        std::vector<float> mPoints;                     // ImVec2 positions of the series being drawn
+        std::vector<float> mRanges;                     // ImVec2 min/max extents of the series being drawn
+        std::vector<float> mBinFractions;               // DrawDistribution() bin values of each metric
+    };
+
     std::vector<MetricsGuiMetric*> mMetrics;
     std::vector<std::pair<float, float> > mMetricRange;
+    std::vector<MetricLabels> mMetricLabels;    // resized to match mMetrics when drawn
+    QuantityLabel mLegendMaxLabel;
+    QuantityLabel mLegendMinLabel;
+    QuantityLabel mDistributionMaxLabel;
+    QuantityLabel mDistributionMinLabel;
+    StackedHistory mStackedHistory;
+    DrawScratch mDrawScratch;
     WidthInfo* mWidthInfo;
     float mMinValue;
     float mMaxValue;
+    uint64_t mTimeAxisBegin;        // GetPerfTimerCount() range of the time axis, set by UpdateAxes()
+    uint64_t mTimeAxisEnd;
+    float mListRowHeight;           // height of a DrawList() row, measured when drawn (0 until then)
+    float mListInlineRowHeight;     // height of a DrawList() row with an inline plot
     bool mRangeInitialized;
 
     // Draw/update options:
@@ -86,6 +308,12 @@ struct MetricsGuiPlot {
     uint32_t mPlotRowCount;         // height of DrawHistory() plots, in text rows
     uint32_t mVBarMinWidth;         // min width of bar graph bar in pixels
     uint32_t mVBarGapWidth;         // width of bar graph inter-bar gap in pixels
+    uint32_t mShowPercentiles;      // draw horizontal lines at these series percentiles (PERCENTILE_* flags)
+    uint32_t mShowLegendPercentiles; // show these series percentiles in legend (PERCENTILE_* flags)
+    uint32_t mDistributionBinCount; // number of DrawDistribution() bins, or 0 to fit mVBarMinWidth bars
+    float mDistributionMinValue;    // range of DrawDistribution() bins, or fit to the values if mDistributionMinValue >= mDistributionMaxValue
+    float mDistributionMaxValue;
+    float mTimeWindow;              // if > 0 and every metric has RECORD_TIMESTAMPS, plot the last mTimeWindow seconds rather than the last mHistorySize values
     bool mShowAverage;              // draw horizontal line at series average
     bool mShowInlineGraphs;         // show history plot in DrawList()
     bool mShowOnlyIfSelected;       // draw show selected metrics
@@ -99,6 +327,8 @@ struct MetricsGuiPlot {
     bool mStacked;                  // stack series when drawing history
     bool mSharedAxis;               // use first series' axis range
     bool mFilterHistory;            // allow single plot point to represent more than on history value
+    bool mShowFilteredRange;        // when a plot point represents multiple history values, also draw their min/max range (not stacked)
+    bool mDistributionLogBins;      // space DrawDistribution() bins logarithmically (values <= 0 are counted in the first bin)
 
     MetricsGuiPlot();
     MetricsGuiPlot(MetricsGuiPlot const& copy);
@@ -129,6 +359,20 @@ struct MetricsGuiPlot {
     // | ........................................| Min: quantity units |
     // -----------------------------------------------------------------
     void DrawHistory();
+
+    // -----------------------------------------------------------------
+    // | histogram...............................| Max: quantity units |
+    // | ........................................| Description         |
+    // | ........................................|                     |
+    // | ........................................| Min: quantity units |
+    // -----------------------------------------------------------------
+    //
+    // Each bar is the fraction of a metric's history values in a bin, with
+    // bins spanning Min to Max from left to right.  Values outside the bins
+    // are counted in the first or last bin.  Bin counts are taken from the
+    // metrics' percentile histograms, so only metrics with
+    // TRACK_PERCENTILES are drawn.
+    void DrawDistribution();
 };
 
 #endif // ifndef METRICS_GUI_H
@@ -0,0 +1,158 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#ifndef METRICS_GUI_SHARED_H
+#define METRICS_GUI_SHARED_H
+
+#include "metrics_gui.h"
+
+// A MetricsGuiSharedWriter publishes metrics and their values through a
+// named shared memory object, so that a MetricsGuiSharedReader in another
+// process can show them:
+//
+//   // Producer process:
+//   MetricsGuiSharedWriter writer;
+//   writer.Open("/game_metrics", 64);
+//   auto tickTime = writer.AddMetric("Tick time", "s", MetricsGuiMetric::USE_SI_UNIT_PREFIX);
+//
+//   // Each tick:
+//   writer.WriteValue(tickTime, seconds);
+//
+//   // GUI process:
+//   MetricsGuiSharedReader reader;
+//   reader.Open("/game_metrics");
+//
+//   // Each frame, before UpdateAxes():
+//   reader.Drain();
+//   for (auto N = reader.GetMetricCount(); plottedCount < N; ++plottedCount) {
+//       plot.AddMetric(reader.GetMetric(plottedCount));
+//   }
+//
+// The shared memory holds the metrics' descriptions, units, and flags, and
+// a single-producer/single-consumer ring of (metric, timestamp, value)
+// samples like the per-thread queues of MetricsGuiRecordValue().  The
+// reader adds samples to its metrics straight from the mapped ring, so
+// nothing is copied or serialized in between.  Timestamps are the writer's
+// GetPerfTimerCount() times, which the reader converts to its own timer
+// through a reference clock (CLOCK_MONOTONIC_RAW, or QueryPerformanceCounter()
+// on Windows) read by each side when it opens the object.  If both sides use
+// the same clock, timestamps are passed through unchanged.
+//
+// Writing never blocks: if the ring is full, values are dropped and counted
+// by GetDroppedValueCount().  On Linux, a reader can block in Wait() until
+// values arrive, and the writer only makes a futex wake call when a reader
+// is waiting.  On machines with more than one hardware thread, Wait() spins
+// briefly before blocking, so a steady stream of values doesn't cost a wake
+// call per value.  Elsewhere Wait() polls.
+//
+// Names are passed to shm_open() (e.g., "/game_metrics") or, on Windows,
+// CreateFileMapping() (e.g., "Local\\game_metrics").  Each side must only
+// be used from one thread at a time, and each object must have at most one
+// writer and one reader.
+struct MetricsGuiSharedWriter {
+    enum {
+        DEFAULT_RING_SIZE       = 64 * 1024,    // samples in the ring (power of two)
+        MAX_DESCRIPTION_BYTES   = 128,          // including the terminating null; longer strings are truncated
+        MAX_UNITS_BYTES         = 32,
+        INVALID_METRIC_INDEX    = 0xffffffffu,
+    };
+
+    struct State;
+    State* mState;  // nullptr if not open
+
+    MetricsGuiSharedWriter();
+    ~MetricsGuiSharedWriter();
+
+    // Create the shared memory object, replacing any existing object with
+    // the same name, with room for maxMetricCount metrics.
+    bool Open(char const* name, uint32_t maxMetricCount, uint32_t ringSize = DEFAULT_RING_SIZE);
+
+    // Remove the shared memory object.  A reader that has it open can still
+    // drain the remaining values.
+    void Close();
+
+    // Publish a metric.  Returns its index, for WriteValue(), or
+    // INVALID_METRIC_INDEX if maxMetricCount metrics have been added.
+    uint32_t AddMetric(char const* description, char const* units, uint32_t flags, float knownMinValue = 0.f, float knownMaxValue = 0.f);
+
+    // Write a value of a metric at the given GetPerfTimerCount() time or
+    // the current time.
+    void WriteValue(uint32_t metricIndex, float value);
+    void WriteValue(uint32_t metricIndex, float value, uint64_t timestamp);
+
+    // Write values[i] as a value of metric first+i, all at the same time.
+    // The values are published together, which is cheaper than writing them
+    // one at a time.
+    void WriteValues(uint32_t first, uint32_t count, float const* values);
+    void WriteValues(uint32_t first, uint32_t count, float const* values, uint64_t timestamp);
+
+    // Number of values that can be written before the ring is full, e.g.,
+    // for a writer that would rather wait than drop values.
+    uint32_t GetFreeValueCount();
+
+    // Number of values dropped because the ring was full.
+    uint64_t GetDroppedValueCount() const;
+
+private:
+    MetricsGuiSharedWriter(MetricsGuiSharedWriter const&);
+    MetricsGuiSharedWriter& operator=(MetricsGuiSharedWriter const&);
+};
+
+struct MetricsGuiSharedReader {
+    enum {
+        WAIT_SPIN_COUNT = 4096,     // checks for values in Wait() before blocking
+    };
+
+    struct State;
+    State* mState;  // nullptr if not open
+
+    MetricsGuiSharedReader();
+    ~MetricsGuiSharedReader();
+
+    // Map an object created by a MetricsGuiSharedWriter.  Its metrics are
+    // created with histories of historySize values and RECORD_TIMESTAMPS.
+    // Fails if the object doesn't exist or is not initialized yet.
+    bool Open(char const* name, uint32_t historySize = MetricsGuiMetric::NUM_HISTORY_SAMPLES);
+    void Close();
+
+    // Create the metrics added since the last call, and add the values
+    // written since the last call to them.  Returns the number of values
+    // added.
+    uint32_t Drain();
+
+    // Wait until there are values to drain, or timeoutMilliseconds have
+    // passed.  Returns whether there are values to drain.
+    bool Wait(uint32_t timeoutMilliseconds);
+
+    // Metrics are created by Drain(), and are not moved by later calls, so
+    // they can be added to plots.
+    uint32_t GetMetricCount() const;
+    MetricsGuiMetric* GetMetric(uint32_t index) const;
+
+    // Number of values the writer dropped because the ring was full.
+    uint64_t GetDroppedValueCount() const;
+
+private:
+    MetricsGuiSharedReader(MetricsGuiSharedReader const&);
+    MetricsGuiSharedReader& operator=(MetricsGuiSharedReader const&);
+};
+
+#endif // ifndef METRICS_GUI_SHARED_H
@@ -0,0 +1,83 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#ifndef METRICS_GUI_TRACE_H
+#define METRICS_GUI_TRACE_H
+
+#include "metrics_gui.h"
+
+// A MetricsGuiTraceWriter writes metric values as counter events in the
+// Chrome Trace Event JSON format, so that they can be viewed alongside CPU
+// traces in chrome://tracing or Perfetto:
+//
+//   MetricsGuiTraceWriter trace;
+//   trace.Open("metrics.json");
+//   trace.WriteHistories(registry);
+//   trace.Close();
+//
+// Each metric is a counter track named after its description and units,
+// e.g., "Frame time (s)".  Event times are the values' GetPerfTimerCount()
+// times in microseconds, so they line up with traces recorded with the
+// same clock (QueryPerformanceCounter() on Windows, CLOCK_MONOTONIC_RAW on
+// Linux).  Non-finite values can't be represented in JSON and are skipped.
+//
+// Events are formatted into a BUFFER_BYTES buffer that is written to the
+// file whenever it fills, so memory use doesn't depend on the number of
+// values written.  A capture can be written with
+// MetricsGuiCaptureReplay::WriteTrace().
+struct MetricsGuiTraceWriter {
+    enum {
+        BUFFER_BYTES    = 64 * 1024,
+        MAX_NAME_BYTES  = 1024,     // longer track names are truncated
+    };
+
+    struct State;
+    State* mState;          // nullptr if not open
+    uint32_t mProcessId;    // "pid" of the events, set before Open() (default this process's id)
+
+    MetricsGuiTraceWriter();
+    ~MetricsGuiTraceWriter();
+
+    bool Open(char const* path);
+
+    // Write the values in the metrics' histories, oldest first.  Only
+    // metrics with RECORD_TIMESTAMPS know when their values were added, so
+    // other metrics are skipped.
+    void WriteHistory(MetricsGuiMetric const* metric);
+    void WriteHistories(MetricsGuiMetric const* const* metrics, uint32_t metricCount);
+    void WriteHistories(MetricsGuiRegistry const& registry);
+
+    // Write values[i] as a value of metric at GetPerfTimerCount() time
+    // timestamps[i].
+    void WriteValues(MetricsGuiMetric const* metric, float const* values, uint64_t const* timestamps, uint32_t count);
+
+    // Finish the JSON and close the file.  Returns false if the file could
+    // not be written, and true if the writer isn't open.
+    bool Close();
+
+    uint64_t GetEventCount() const;
+
+private:
+    MetricsGuiTraceWriter(MetricsGuiTraceWriter const&);
+    MetricsGuiTraceWriter& operator=(MetricsGuiTraceWriter const&);
+};
+
+#endif // ifndef METRICS_GUI_TRACE_H
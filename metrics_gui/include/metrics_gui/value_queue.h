@@ -0,0 +1,58 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#ifndef METRICS_GUI_VALUE_QUEUE_H
+#define METRICS_GUI_VALUE_QUEUE_H
+
+#include "metrics_gui.h"
+
+// MetricsGuiMetric is not thread-safe, so values produced on other threads
+// are recorded into per-thread queues and added to their metrics by the
+// thread that draws them:
+//
+//   // Any thread:
+//   MetricsGuiRecordValue(&jobTimeMetric, jobTime);
+//
+//   // Once per frame, on the GUI thread, before UpdateAxes():
+//   MetricsGuiDrainValues();
+//
+// Each thread records into its own single-producer/single-consumer ring, so
+// recording never takes a lock.  Values recorded by one thread are added in
+// the order they were recorded, with the time they were recorded as their
+// timestamp (see MetricsGuiMetric::RECORD_TIMESTAMPS).  A thread's queue is
+// reused by a later thread once it exits, and queues are never freed.
+
+enum { METRICS_GUI_VALUE_QUEUE_SIZE = 4096 };   // values per thread between drains (power of two)
+
+// Record a value to be added to metric, at the current time, by the next
+// MetricsGuiDrainValues() call.  Returns false, and the value is dropped, if
+// this thread has recorded METRICS_GUI_VALUE_QUEUE_SIZE values since the last
+// drain.
+bool MetricsGuiRecordValue(MetricsGuiMetric* metric, float value);
+
+// Add all recorded values to their metrics.  Must only be called from one
+// thread at a time.
+void MetricsGuiDrainValues();
+
+// Number of values dropped because a queue was full.
+uint64_t MetricsGuiGetDroppedValueCount();
+
+#endif // ifndef METRICS_GUI_VALUE_QUEUE_H
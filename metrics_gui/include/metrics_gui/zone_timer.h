@@ -0,0 +1,118 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#ifndef METRICS_GUI_ZONE_TIMER_H
+#define METRICS_GUI_ZONE_TIMER_H
+
+#include "metrics_gui.h"
+#include "../../../portable/perf_timer.h"
+
+// Zones accumulate the CPU time spent in scopes of code over a frame, and
+// add the total (in seconds) to their metric when committed:
+//
+//   void UpdatePhysics()
+//   {
+//       METRICS_GUI_ZONE("Physics");
+//       ...
+//   }
+//
+//   // Once per frame:
+//   MetricsGuiCommitZones();
+//   physicsPlot.AddMetric(&MetricsGuiGetZone("Physics")->mMetric);
+//
+// Zones may be nested, in which case each zone's time includes the time of
+// the zones nested within it.  A zone that is re-entered while active (e.g.,
+// by a recursive call) is only timed by its outermost scope.
+//
+// Zones are not thread-safe, and should only be used on the thread that
+// calls MetricsGuiCommitZones().
+//
+// Zones are timed with portable/perf_timer.h, so SetPerfTimerUseTsc() must
+// be called before the first zone is used if the TSC is wanted.
+struct MetricsGuiZone {
+    MetricsGuiMetric mMetric;   // time spent in the zone per frame, in seconds
+    uint64_t mTicks;            // perf timer ticks accumulated since the last commit
+    uint64_t mStart;            // perf timer count when the outermost active scope started
+    uint32_t mDepth;            // number of active scopes
+
+    explicit MetricsGuiZone(char const* description);
+
+    void Begin()
+    {
+        if (mDepth++ == 0) {
+            mStart = GetPerfTimerCount();
+        }
+    }
+
+    void End()
+    {
+        if (--mDepth == 0) {
+            mTicks += GetPerfTimerCount() - mStart;
+        }
+    }
+
+    // Add the accumulated time to mMetric and reset it.  The time of a scope
+    // that is still active is split between the frames.
+    void Commit(double secondsPerTick);
+};
+
+struct MetricsGuiZoneScope {
+    MetricsGuiZone* mZone;
+
+    explicit MetricsGuiZoneScope(MetricsGuiZone* zone)
+        : mZone(zone)
+    {
+        zone->Begin();
+    }
+
+    ~MetricsGuiZoneScope()
+    {
+        mZone->End();
+    }
+
+private:
+    MetricsGuiZoneScope(MetricsGuiZoneScope const&);
+    MetricsGuiZoneScope& operator=(MetricsGuiZoneScope const&);
+};
+
+// Get the zone with the given description, creating it on first use.  Zones
+// are never destroyed, so the returned pointer (and its metric) remains
+// valid.
+MetricsGuiZone* MetricsGuiGetZone(char const* description);
+
+// Get all zones, in order of creation.
+size_t MetricsGuiGetZoneCount();
+MetricsGuiZone* const* MetricsGuiGetZones();
+
+// Commit the time accumulated by all zones since the last call.  Call once
+// per frame, before updating the plot axes.
+void MetricsGuiCommitZones();
+
+#define METRICS_GUI_ZONE_CONCAT_(a, b) a##b
+#define METRICS_GUI_ZONE_CONCAT(a, b) METRICS_GUI_ZONE_CONCAT_(a, b)
+
+// Time the enclosing scope into the zone with the given description.  The
+// zone is looked up once per call site.
+#define METRICS_GUI_ZONE(description) \
+    static MetricsGuiZone* const METRICS_GUI_ZONE_CONCAT(metricsGuiZone_, __LINE__) = MetricsGuiGetZone(description); \
+    MetricsGuiZoneScope METRICS_GUI_ZONE_CONCAT(metricsGuiZoneScope_, __LINE__)(METRICS_GUI_ZONE_CONCAT(metricsGuiZone_, __LINE__))
+
+#endif // ifndef METRICS_GUI_ZONE_TIMER_H
@@ -0,0 +1,454 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "../include/metrics_gui/capture.h"
+#include "../../portable/perf_timer.h"
+#include "capture_encoding.h"
+#include "capture_format.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+namespace {
+
+// Buffers hold a sequence of records, each a CaptureRecord followed by
+// mCount float values.
+struct CaptureRecord {
+    uint64_t mTimestamp;
+    uint32_t mFirst;
+    uint32_t mCount;
+};
+
+struct CaptureBuffer {
+    char* mData;
+    size_t mSize;
+    size_t mCapacity;
+};
+
+struct CaptureColumn {
+    std::vector<uint64_t> mTimestamps;
+    std::vector<float> mValues;
+    std::vector<uint64_t> mEncoded;     // CAPTURE_ENCODING_GORILLA data, if smaller than the raw values
+};
+
+}
+
+struct MetricsGuiCaptureWriter::State {
+    FILE* mFile;
+    uint32_t mMetricCount;
+    bool mCompress;
+
+    // Owned by the capturing thread.
+    CaptureBuffer* mBuffer;
+    uint64_t mDroppedValueCount;
+
+    // Protected by mMutex.
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::deque<CaptureBuffer*> mFullBuffers;
+    std::vector<CaptureBuffer*> mFreeBuffers;
+    uint32_t mBufferCount;
+    bool mClosing;
+
+    // Owned by the background thread.
+    std::thread mThread;
+    std::vector<CaptureColumn> mColumns;
+    std::vector<CaptureColumnHeader> mColumnHeaders;
+    std::vector<CaptureIndexEntry> mIndex;
+    uint64_t mBlockValueCount;
+    uint64_t mFileOffset;
+    bool mFailed;
+};
+
+namespace {
+
+typedef MetricsGuiCaptureWriter::State CaptureState;
+
+void WriteFile(
+    CaptureState* state,
+    void const* data,
+    size_t size)
+{
+    if (!state->mFailed && size > 0 && fwrite(data, 1, size, state->mFile) != size) {
+        state->mFailed = true;
+    }
+    state->mFileOffset += size;
+}
+
+void WritePadding(
+    CaptureState* state,
+    size_t size)
+{
+    static char const zeros[CAPTURE_ALIGNMENT] = {};
+    WriteFile(state, zeros, (size_t) (AlignCaptureSize(size) - size));
+}
+
+// Write the values gathered in the columns as a block, and add it to the
+// index.
+void WriteBlock(
+    CaptureState* state)
+{
+    if (state->mBlockValueCount == 0) {
+        return;
+    }
+
+    CaptureBlockHeader block = {};
+    block.mMagic = CAPTURE_BLOCK_MAGIC;
+    block.mFirstTimestamp = UINT64_MAX;
+    block.mLastTimestamp = 0;
+    block.mValueCount = state->mBlockValueCount;
+
+    // The previous CAPTURE_ENCODING_GORILLA column, whose timestamps the
+    // next one can share.
+    CaptureColumn const* prevEncodedColumn = nullptr;
+
+    auto headers = &state->mColumnHeaders;
+    headers->clear();
+    for (uint32_t i = 0; i < state->mMetricCount; ++i) {
+        auto const& column = state->mColumns[i];
+        auto valueCount = (uint32_t) column.mValues.size();
+        if (valueCount == 0) {
+            continue;
+        }
+
+        CaptureColumnHeader header = {};
+        header.mMetricIndex = i;
+        header.mEncoding = CAPTURE_ENCODING_RAW;
+        header.mValueCount = valueCount;
+        header.mByteCount = (uint32_t) AlignCaptureSize(valueCount * (sizeof(uint64_t) + sizeof(float)));
+        if (state->mCompress) {
+            auto storeTimestamps = prevEncodedColumn == nullptr || prevEncodedColumn->mTimestamps != column.mTimestamps;
+            auto encoded = &state->mColumns[i].mEncoded;
+            encoded->clear();
+            EncodeCaptureColumn(column.mTimestamps.data(), column.mValues.data(), valueCount, storeTimestamps, encoded);
+            if (encoded->size() * sizeof(uint64_t) < header.mByteCount) {
+                header.mEncoding = CAPTURE_ENCODING_GORILLA;
+                header.mByteCount = (uint32_t) (encoded->size() * sizeof(uint64_t));
+                prevEncodedColumn = &column;
+            }
+        }
+        header.mFirstTimestamp = column.mTimestamps.front();
+        header.mLastTimestamp = column.mTimestamps.back();
+        headers->emplace_back(header);
+
+        block.mByteCount += sizeof(CaptureColumnHeader) + header.mByteCount;
+        block.mFirstTimestamp = std::min(block.mFirstTimestamp, header.mFirstTimestamp);
+        block.mLastTimestamp = std::max(block.mLastTimestamp, header.mLastTimestamp);
+    }
+    block.mColumnCount = (uint32_t) headers->size();
+
+    CaptureIndexEntry entry = {};
+    entry.mOffset = state->mFileOffset;
+    entry.mFirstTimestamp = block.mFirstTimestamp;
+    entry.mLastTimestamp = block.mLastTimestamp;
+    entry.mValueCount = block.mValueCount;
+    state->mIndex.emplace_back(entry);
+
+    WriteFile(state, &block, sizeof(block));
+    WriteFile(state, headers->data(), headers->size() * sizeof(CaptureColumnHeader));
+    for (auto const& header : *headers) {
+        auto column = &state->mColumns[header.mMetricIndex];
+        if (header.mEncoding == CAPTURE_ENCODING_GORILLA) {
+            WriteFile(state, column->mEncoded.data(), header.mByteCount);
+        } else {
+            WriteFile(state, column->mTimestamps.data(), header.mValueCount * sizeof(uint64_t));
+            WriteFile(state, column->mValues.data(), header.mValueCount * sizeof(float));
+            WritePadding(state, header.mValueCount * (sizeof(uint64_t) + sizeof(float)));
+        }
+        column->mTimestamps.clear();
+        column->mValues.clear();
+    }
+    state->mBlockValueCount = 0;
+}
+
+// Sort the buffer's values into the metrics' columns, writing a block each
+// time BLOCK_VALUE_COUNT values have been gathered.
+void AddBufferValues(
+    CaptureState* state,
+    CaptureBuffer const* buffer)
+{
+    for (size_t offset = 0; offset < buffer->mSize; ) {
+        CaptureRecord record;
+        memcpy(&record, buffer->mData + offset, sizeof(record));
+        auto values = buffer->mData + offset + sizeof(record);
+        offset += sizeof(record) + record.mCount * sizeof(float);
+
+        for (uint32_t i = 0; i < record.mCount; ++i) {
+            float value;
+            memcpy(&value, values + i * sizeof(float), sizeof(value));
+            auto column = &state->mColumns[record.mFirst + i];
+            column->mTimestamps.emplace_back(record.mTimestamp);
+            column->mValues.emplace_back(value);
+        }
+
+        state->mBlockValueCount += record.mCount;
+        if (state->mBlockValueCount >= MetricsGuiCaptureWriter::BLOCK_VALUE_COUNT) {
+            WriteBlock(state);
+        }
+    }
+}
+
+void WriteIndex(
+    CaptureState* state)
+{
+    CaptureFileFooter footer = {};
+    footer.mIndexOffset = state->mFileOffset;
+    footer.mBlockCount = (uint32_t) state->mIndex.size();
+    footer.mMagic = CAPTURE_FOOTER_MAGIC;
+    WriteFile(state, state->mIndex.data(), state->mIndex.size() * sizeof(CaptureIndexEntry));
+    WriteFile(state, &footer, sizeof(footer));
+}
+
+void CaptureThread(
+    CaptureState* state)
+{
+    std::unique_lock<std::mutex> lock(state->mMutex);
+    for (;;) {
+        state->mCondition.wait(lock, [state] { return !state->mFullBuffers.empty() || state->mClosing; });
+        if (state->mFullBuffers.empty()) {
+            break;
+        }
+
+        auto buffer = state->mFullBuffers.front();
+        state->mFullBuffers.pop_front();
+        lock.unlock();
+
+        AddBufferValues(state, buffer);
+        buffer->mSize = 0;
+
+        lock.lock();
+        state->mFreeBuffers.emplace_back(buffer);
+    }
+    lock.unlock();
+
+    WriteBlock(state);
+    WriteIndex(state);
+}
+
+// Hand the current buffer (if it isn't empty) to the background thread, and
+// make a buffer with room for at least size bytes current.  If the
+// background thread has fallen too far behind, there is no current buffer
+// and false is returned.
+bool SwapBuffer(
+    CaptureState* state,
+    size_t size)
+{
+    auto buffer = state->mBuffer;
+    {
+        std::lock_guard<std::mutex> lock(state->mMutex);
+        if (buffer != nullptr && buffer->mSize > 0) {
+            state->mFullBuffers.emplace_back(buffer);
+            state->mCondition.notify_one();
+            buffer = nullptr;
+        }
+        if (buffer == nullptr) {
+            if (!state->mFreeBuffers.empty()) {
+                buffer = state->mFreeBuffers.back();
+                state->mFreeBuffers.pop_back();
+            } else if (state->mBufferCount < MetricsGuiCaptureWriter::MAX_BUFFER_COUNT) {
+                buffer = new CaptureBuffer();
+                buffer->mData = nullptr;
+                buffer->mSize = 0;
+                buffer->mCapacity = 0;
+                state->mBufferCount += 1;
+            }
+        }
+    }
+
+    state->mBuffer = buffer;
+    if (buffer == nullptr) {
+        return false;
+    }
+    if (buffer->mCapacity < size) {
+        buffer->mCapacity = std::max(size, (size_t) MetricsGuiCaptureWriter::BUFFER_BYTES);
+        buffer->mData = (char*) realloc(buffer->mData, buffer->mCapacity);
+    }
+    return true;
+}
+
+}
+
+MetricsGuiCaptureWriter::MetricsGuiCaptureWriter()
+    : mState(nullptr)
+    , mCompress(true)
+{
+}
+
+MetricsGuiCaptureWriter::~MetricsGuiCaptureWriter()
+{
+    Close();
+}
+
+bool MetricsGuiCaptureWriter::Open(
+    char const* path,
+    MetricsGuiMetric const* const* metrics,
+    uint32_t metricCount)
+{
+    Close();
+
+    auto file = fopen(path, "wb");
+    if (file == nullptr) {
+        return false;
+    }
+
+    auto state = new State();
+    state->mFile = file;
+    state->mMetricCount = metricCount;
+    state->mCompress = mCompress;
+    state->mBuffer = nullptr;
+    state->mDroppedValueCount = 0;
+    state->mBufferCount = 0;
+    state->mClosing = false;
+    state->mColumns.resize(metricCount);
+    state->mBlockValueCount = 0;
+    state->mFileOffset = 0;
+    state->mFailed = false;
+
+    auto f = GetPerfTimerFrequency();
+    CaptureFileHeader header = {};
+    header.mMagic = CAPTURE_FILE_MAGIC;
+    header.mVersion = CAPTURE_VERSION;
+    header.mMetricCount = metricCount;
+    header.mTimerNumerator = f.Numerator;
+    header.mTimerDenominator = f.Denominator;
+    WriteFile(state, &header, sizeof(header));
+
+    for (uint32_t i = 0; i < metricCount; ++i) {
+        auto metric = metrics[i];
+        CaptureMetricHeader metricHeader = {};
+        metricHeader.mFlags = metric->mFlags;
+        metricHeader.mDescriptionLength = (uint32_t) metric->mDescription.size();
+        metricHeader.mUnitsLength = (uint32_t) metric->mUnits.size();
+        WriteFile(state, &metricHeader, sizeof(metricHeader));
+        WriteFile(state, metric->mDescription.data(), metricHeader.mDescriptionLength);
+        WriteFile(state, metric->mUnits.data(), metricHeader.mUnitsLength);
+        WritePadding(state, metricHeader.mDescriptionLength + metricHeader.mUnitsLength);
+    }
+
+    state->mThread = std::thread(CaptureThread, state);
+    mState = state;
+    return true;
+}
+
+bool MetricsGuiCaptureWriter::Open(
+    char const* path,
+    MetricsGuiRegistry const& registry)
+{
+    std::vector<MetricsGuiMetric const*> metrics(registry.GetMetricCount());
+    for (uint32_t i = 0, N = registry.GetMetricCount(); i < N; ++i) {
+        metrics[i] = registry.GetMetric(i);
+    }
+    return Open(path, metrics.data(), (uint32_t) metrics.size());
+}
+
+void MetricsGuiCaptureWriter::WriteValues(
+    uint32_t first,
+    uint32_t count,
+    float const* values)
+{
+    WriteValues(first, count, values, GetPerfTimerCount());
+}
+
+void MetricsGuiCaptureWriter::WriteValues(
+    uint32_t first,
+    uint32_t count,
+    float const* values,
+    uint64_t timestamp)
+{
+    auto state = mState;
+    if (state == nullptr || count == 0) {
+        return;
+    }
+    assert(first < state->mMetricCount && count <= state->mMetricCount - first);
+
+    auto size = sizeof(CaptureRecord) + count * sizeof(float);
+    auto buffer = state->mBuffer;
+    if (buffer == nullptr || buffer->mSize + size > buffer->mCapacity) {
+        if (!SwapBuffer(state, size)) {
+            state->mDroppedValueCount += count;
+            return;
+        }
+        buffer = state->mBuffer;
+    }
+
+    CaptureRecord record;
+    record.mTimestamp = timestamp;
+    record.mFirst = first;
+    record.mCount = count;
+    memcpy(buffer->mData + buffer->mSize, &record, sizeof(record));
+    memcpy(buffer->mData + buffer->mSize + sizeof(record), values, count * sizeof(float));
+    buffer->mSize += size;
+}
+
+void MetricsGuiCaptureWriter::Flush()
+{
+    auto state = mState;
+    if (state == nullptr || state->mBuffer == nullptr || state->mBuffer->mSize == 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(state->mMutex);
+    state->mFullBuffers.emplace_back(state->mBuffer);
+    state->mCondition.notify_one();
+    state->mBuffer = nullptr;
+}
+
+bool MetricsGuiCaptureWriter::Close()
+{
+    auto state = mState;
+    if (state == nullptr) {
+        return true;
+    }
+
+    Flush();
+    {
+        std::lock_guard<std::mutex> lock(state->mMutex);
+        state->mClosing = true;
+        state->mCondition.notify_one();
+    }
+    state->mThread.join();
+
+    auto ok = fclose(state->mFile) == 0 && !state->mFailed;
+
+    if (state->mBuffer != nullptr) {
+        state->mFreeBuffers.emplace_back(state->mBuffer);
+    }
+    for (auto buffer : state->mFreeBuffers) {
+        free(buffer->mData);
+        delete buffer;
+    }
+    delete state;
+    mState = nullptr;
+    return ok;
+}
+
+uint64_t MetricsGuiCaptureWriter::GetDroppedValueCount() const
+{
+    return mState == nullptr ? 0 : mState->mDroppedValueCount;
+}
@@ -0,0 +1,327 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "capture_encoding.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+
+// x must be non-zero
+uint32_t CountLeadingZeros(
+    uint32_t x)
+{
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanReverse(&i, x);
+    return 31 - i;
+#else
+    return (uint32_t) __builtin_clz(x);
+#endif
+}
+
+uint32_t CountTrailingZeros(
+    uint32_t x)
+{
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward(&i, x);
+    return i;
+#else
+    return (uint32_t) __builtin_ctz(x);
+#endif
+}
+
+struct BitWriter {
+    std::vector<uint64_t>* mWords;
+    uint64_t mBits;             // pending bits, most significant first
+    uint32_t mBitCount;
+};
+
+// Write the low bitCount (1 to 64) bits of bits.
+void WriteBits(
+    BitWriter* writer,
+    uint64_t bits,
+    uint32_t bitCount)
+{
+    assert(bitCount > 0 && bitCount <= 64);
+    assert(bitCount == 64 || (bits >> bitCount) == 0);
+    auto space = 64 - writer->mBitCount;
+    if (bitCount < space) {
+        writer->mBits |= bits << (space - bitCount);
+        writer->mBitCount += bitCount;
+        return;
+    }
+
+    bitCount -= space;
+    writer->mWords->emplace_back(writer->mBits | (bits >> bitCount));
+    writer->mBits = bitCount == 0 ? 0 : (bits << (64 - bitCount));
+    writer->mBitCount = bitCount;
+}
+
+void FlushBits(
+    BitWriter* writer)
+{
+    if (writer->mBitCount > 0) {
+        writer->mWords->emplace_back(writer->mBits);
+        writer->mBits = 0;
+        writer->mBitCount = 0;
+    }
+}
+
+// Get the next 64 bits of the stream without consuming them, with zeros
+// past the end of the data.
+uint64_t PeekBits(
+    CaptureBitStream const* stream)
+{
+    auto wordIndex = stream->mBitIndex / 64;
+    auto shift = (uint32_t) (stream->mBitIndex % 64);
+    auto word0 = wordIndex < stream->mWordCount ? stream->mWords[wordIndex] : 0;
+    if (shift == 0) {
+        return word0;
+    }
+    auto word1 = wordIndex + 1 < stream->mWordCount ? stream->mWords[wordIndex + 1] : 0;
+    return (word0 << shift) | (word1 >> (64 - shift));
+}
+
+// Get bitCount (1 to 64) bits starting offset bits into bits.
+uint64_t ExtractBits(
+    uint64_t bits,
+    uint32_t offset,
+    uint32_t bitCount)
+{
+    assert(bitCount > 0 && offset + bitCount <= 64);
+    return (bits << offset) >> (64 - bitCount);
+}
+
+// Timestamp delta-of-delta payload sizes, by the number of leading ones in
+// the prefix.
+uint32_t const TIMESTAMP_BIT_COUNTS[] = { 0, 8, 16, 24, 32, 64 };
+
+}
+
+void EncodeCaptureColumn(
+    uint64_t const* timestamps,
+    float const* values,
+    uint32_t count,
+    bool storeTimestamps,
+    std::vector<uint64_t>* words)
+{
+    assert(count > 0);
+
+    // The timestamp stream's size is stored first, so that it can be
+    // skipped to the values.
+    auto sizeIndex = words->size();
+    words->emplace_back(0);
+
+    BitWriter writer = { words, 0, 0 };
+    if (storeTimestamps) {
+        // Zigzag encode the deltas-of-deltas so that small negative
+        // differences also take few bits.
+        auto prevTimestamp = timestamps[0];
+        uint64_t prevDelta = 0;
+        for (uint32_t i = 1; i < count; ++i) {
+            auto delta = timestamps[i] - prevTimestamp;
+            auto deltaOfDelta = delta - prevDelta;
+            auto zigzag = (deltaOfDelta << 1) ^ (uint64_t) ((int64_t) deltaOfDelta >> 63);
+            if (zigzag == 0) {
+                WriteBits(&writer, 0, 1);
+            } else if (zigzag < (1ull << 8)) {
+                WriteBits(&writer, (0x2ull << 8) | zigzag, 2 + 8);
+            } else if (zigzag < (1ull << 16)) {
+                WriteBits(&writer, (0x6ull << 16) | zigzag, 3 + 16);
+            } else if (zigzag < (1ull << 24)) {
+                WriteBits(&writer, (0xeull << 24) | zigzag, 4 + 24);
+            } else if (zigzag < (1ull << 32)) {
+                WriteBits(&writer, (0x1eull << 32) | zigzag, 5 + 32);
+            } else {
+                WriteBits(&writer, 0x1f, 5);
+                WriteBits(&writer, zigzag, 64);
+            }
+            prevTimestamp = timestamps[i];
+            prevDelta = delta;
+        }
+
+        // A column with one value still stores a (zero) timestamp stream
+        // so that it isn't mistaken for one sharing timestamps.
+        WriteBits(&writer, 0, 1);
+        FlushBits(&writer);
+        (*words)[sizeIndex] = words->size() - sizeIndex - 1;
+    }
+
+    uint32_t prevValue;
+    memcpy(&prevValue, &values[0], sizeof(prevValue));
+    WriteBits(&writer, prevValue, 32);
+
+    // No window yet, so the first non-zero XOR starts one.
+    uint32_t prevLeading = 32;
+    uint32_t prevTrailing = 32;
+    for (uint32_t i = 1; i < count; ++i) {
+        uint32_t value;
+        memcpy(&value, &values[i], sizeof(value));
+        auto x = value ^ prevValue;
+        prevValue = value;
+        if (x == 0) {
+            WriteBits(&writer, 0, 1);
+            continue;
+        }
+
+        auto leading = CountLeadingZeros(x);
+        auto trailing = CountTrailingZeros(x);
+        if (leading >= prevLeading && trailing >= prevTrailing) {
+            auto bitCount = 32 - prevLeading - prevTrailing;
+            WriteBits(&writer, (0x2ull << bitCount) | (x >> prevTrailing), 2 + bitCount);
+        } else {
+            auto bitCount = 32 - leading - trailing;
+            WriteBits(&writer, (0x3ull << 10) | (leading << 5) | (bitCount - 1), 2 + 5 + 5);
+            WriteBits(&writer, x >> trailing, bitCount);
+            prevLeading = leading;
+            prevTrailing = trailing;
+        }
+    }
+    FlushBits(&writer);
+}
+
+bool CaptureColumnReader::Initialize(
+    CaptureColumnHeader const* header,
+    void const* data,
+    CaptureColumnReader const* prevReader)
+{
+    mHeader = header;
+    mData = (char const*) data;
+    mIndex = 0;
+    mTimestamp = header->mFirstTimestamp;
+    mDelta = 0;
+    mValue = 0;
+    mLeading = 0;
+    mTrailing = 0;
+
+    switch (header->mEncoding) {
+    case CAPTURE_ENCODING_RAW:
+        return header->mByteCount / (sizeof(uint64_t) + sizeof(float)) >= header->mValueCount;
+
+    case CAPTURE_ENCODING_GORILLA: {
+        auto words = (uint64_t const*) data;
+        auto wordCount = header->mByteCount / sizeof(uint64_t);
+        if (header->mValueCount == 0 || wordCount == 0 || words[0] >= wordCount) {
+            return false;
+        }
+
+        auto timestampWordCount = words[0];
+        if (timestampWordCount > 0) {
+            mTimestampBits.mWords = words + 1;
+            mTimestampBits.mWordCount = timestampWordCount;
+        } else if (prevReader != nullptr && prevReader->mHeader->mEncoding == CAPTURE_ENCODING_GORILLA) {
+            mTimestampBits.mWords = prevReader->mTimestampBits.mWords;
+            mTimestampBits.mWordCount = prevReader->mTimestampBits.mWordCount;
+        } else {
+            return false;
+        }
+        mTimestampBits.mBitIndex = 0;
+        mValueBits.mWords = words + 1 + timestampWordCount;
+        mValueBits.mWordCount = wordCount - 1 - timestampWordCount;
+        mValueBits.mBitIndex = 0;
+        return true;
+    }
+
+    default:
+        return false;
+    }
+}
+
+bool CaptureColumnReader::Read(
+    uint64_t* timestamp,
+    float* value)
+{
+    if (mIndex == mHeader->mValueCount) {
+        return false;
+    }
+
+    if (mHeader->mEncoding == CAPTURE_ENCODING_RAW) {
+        memcpy(timestamp, mData + mIndex * sizeof(uint64_t), sizeof(uint64_t));
+        memcpy(value, mData + mHeader->mValueCount * sizeof(uint64_t) + mIndex * sizeof(float), sizeof(float));
+        mIndex += 1;
+        return true;
+    }
+
+    auto bits = PeekBits(&mValueBits);
+    if (mIndex == 0) {
+        mValue = (uint32_t) (bits >> 32);
+        mValueBits.mBitIndex += 32;
+    } else {
+        // The number of leading ones (at most 5) selects the payload size.
+        auto timestampBits = PeekBits(&mTimestampBits);
+        auto ones = CountLeadingZeros(~(uint32_t) (timestampBits >> 32) | (1u << 26));
+        auto prefixBitCount = ones == 5 ? 5 : ones + 1;
+        auto payloadBitCount = TIMESTAMP_BIT_COUNTS[ones];
+        mTimestampBits.mBitIndex += prefixBitCount;
+        if (payloadBitCount == 64) {
+            auto zigzag = PeekBits(&mTimestampBits);
+            mDelta += (zigzag >> 1) ^ (0 - (zigzag & 1));
+        } else if (payloadBitCount > 0) {
+            auto zigzag = ExtractBits(timestampBits, prefixBitCount, payloadBitCount);
+            mDelta += (zigzag >> 1) ^ (0 - (zigzag & 1));
+        }
+        mTimestampBits.mBitIndex += payloadBitCount;
+        mTimestamp += mDelta;
+
+        // The value takes at most 2 + 10 + 32 bits.
+        if ((bits >> 63) == 0) {
+            mValueBits.mBitIndex += 1;
+        } else if (((bits >> 62) & 1) == 0) {
+            auto bitCount = 32 - mLeading - mTrailing;
+            mValue ^= (uint32_t) ExtractBits(bits, 2, bitCount) << mTrailing;
+            mValueBits.mBitIndex += 2 + bitCount;
+        } else {
+            mLeading = (uint32_t) (bits >> 57) & 0x1f;
+            auto bitCount = std::min(((uint32_t) (bits >> 52) & 0x1f) + 1, 32 - mLeading);
+            mTrailing = 32 - mLeading - bitCount;
+            mValue ^= (uint32_t) ExtractBits(bits, 12, bitCount) << mTrailing;
+            mValueBits.mBitIndex += 12 + bitCount;
+        }
+    }
+
+    *timestamp = mTimestamp;
+    memcpy(value, &mValue, sizeof(mValue));
+    mIndex += 1;
+    return true;
+}
+
+void CaptureColumnReader::Skip(
+    uint32_t count)
+{
+    if (mHeader->mEncoding == CAPTURE_ENCODING_RAW) {
+        mIndex += std::min(count, mHeader->mValueCount - mIndex);
+        return;
+    }
+
+    uint64_t timestamp;
+    float value;
+    for (uint32_t i = 0; i < count && Read(&timestamp, &value); ++i) {
+    }
+}
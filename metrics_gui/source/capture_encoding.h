@@ -0,0 +1,71 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#ifndef METRICS_GUI_CAPTURE_ENCODING_H
+#define METRICS_GUI_CAPTURE_ENCODING_H
+
+#include "capture_format.h"
+
+#include <stdint.h>
+#include <vector>
+
+// Encode count (> 0) values as CAPTURE_ENCODING_GORILLA column data,
+// appending it to words (which is not cleared first).  If storeTimestamps
+// is false, the timestamps must equal those of the block's previous
+// CAPTURE_ENCODING_GORILLA column and aren't stored again.
+void EncodeCaptureColumn(uint64_t const* timestamps, float const* values, uint32_t count, bool storeTimestamps, std::vector<uint64_t>* words);
+
+// A bit stream stored most significant bit first in 64-bit words.
+struct CaptureBitStream {
+    uint64_t const* mWords;
+    uint64_t mWordCount;
+    uint64_t mBitIndex;         // position of the next unread bit
+};
+
+// Reads a column's values oldest first, decoding them as it goes so that a
+// column can be read a few values at a time.  Reading past the end of
+// invalid column data returns zeros rather than reading out of bounds.
+struct CaptureColumnReader {
+    CaptureColumnHeader const* mHeader;
+    char const* mData;
+    uint32_t mIndex;            // number of values read
+
+    // CAPTURE_ENCODING_GORILLA state
+    CaptureBitStream mTimestampBits;
+    CaptureBitStream mValueBits;
+    uint64_t mTimestamp;
+    uint64_t mDelta;
+    uint32_t mValue;
+    uint32_t mLeading;
+    uint32_t mTrailing;
+
+    // prevReader is a reader of the block's previous
+    // CAPTURE_ENCODING_GORILLA column (or nullptr), whose timestamps are
+    // used if the column doesn't store its own.  Returns false if the
+    // column's encoding isn't known or its data is too small.
+    bool Initialize(CaptureColumnHeader const* header, void const* data, CaptureColumnReader const* prevReader);
+
+    // Returns false if all of the column's values have been read.
+    bool Read(uint64_t* timestamp, float* value);
+    void Skip(uint32_t count);
+};
+
+#endif // ifndef METRICS_GUI_CAPTURE_ENCODING_H
@@ -0,0 +1,155 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#ifndef METRICS_GUI_CAPTURE_FORMAT_H
+#define METRICS_GUI_CAPTURE_FORMAT_H
+
+#include <stdint.h>
+
+// Layout of a capture file written by MetricsGuiCaptureWriter.  All values
+// are in native byte order, and all structures and column data start at
+// 8-byte aligned file offsets so that a mapped file can be read in place.
+//
+//   CaptureFileHeader
+//   For each metric: CaptureMetricHeader, description, units (padded)
+//   For each block:
+//       CaptureBlockHeader
+//       CaptureColumnHeader for each metric with values in the block
+//       Column data for each of those metrics, in the same order
+//   CaptureIndexEntry for each block
+//   CaptureFileFooter
+//
+// Blocks are appended as values are captured, and the index and footer are
+// written when the capture is closed.  A capture that wasn't closed (e.g.,
+// because the application crashed) can still be read up to its last
+// complete block by walking the block headers.
+//
+// Each column holds one metric's values in the block, in the order they
+// were captured.  CAPTURE_ENCODING_RAW column data is the column's
+// timestamps (uint64_t) followed by its values (float).
+//
+// CAPTURE_ENCODING_GORILLA column data is a uint64_t holding the size in
+// words of a timestamp bit stream, the timestamp bit stream, and a value bit
+// stream.  Bit streams are stored most significant bit first in uint64_t
+// words (see capture_encoding.h).
+//
+//   Timestamps: the first is the column's mFirstTimestamp and takes no
+//   bits.  Later timestamps store the difference between their delta from
+//   the previous timestamp and the previous delta (the first delta is
+//   relative to a delta of 0), zigzag encoded:
+//       '0'                     same delta
+//       '10'    + 8 bits
+//       '110'   + 16 bits
+//       '1110'  + 24 bits
+//       '11110' + 32 bits
+//       '11111' + 64 bits
+//   If the timestamp stream's size is 0, the column's timestamps are the
+//   same as those of the block's previous CAPTURE_ENCODING_GORILLA column.
+//   This is the usual case, since metrics captured together share
+//   timestamps.
+//
+//   Values: the first value's 32 bits.  Later values are XORed with the
+//   previous value:
+//       '0'                     same value
+//       '10' + bits             the XOR's non-zero bits fit in the previous
+//                               window of meaningful bits
+//       '11' + 5 bits leading zero count + 5 bits (meaningful bit count - 1)
+//            + meaningful bits, which become the new window
+
+enum {
+    CAPTURE_FILE_MAGIC      = 0x5041434d,   // "MCAP"
+    CAPTURE_BLOCK_MAGIC     = 0x4b4c424d,   // "MBLK"
+    CAPTURE_FOOTER_MAGIC    = 0x58444e4d,   // "MNDX"
+    CAPTURE_VERSION         = 2,            // 2 added CAPTURE_ENCODING_GORILLA
+    CAPTURE_MIN_VERSION     = 1,            // oldest version that can be read (1 only has raw columns)
+    CAPTURE_ALIGNMENT       = 8,
+};
+
+enum CaptureEncoding {
+    CAPTURE_ENCODING_RAW        = 0,
+    CAPTURE_ENCODING_GORILLA    = 1,    // delta-of-delta timestamps and XORed values, see above
+};
+
+// Timestamps are GetPerfTimerCount() values of the capturing process;
+// seconds = timestamp * mTimerDenominator / mTimerNumerator.
+struct CaptureFileHeader {
+    uint32_t mMagic;
+    uint32_t mVersion;
+    uint32_t mMetricCount;
+    uint32_t mReserved;
+    uint64_t mTimerNumerator;
+    uint64_t mTimerDenominator;
+};
+
+// Followed by mDescriptionLength + mUnitsLength bytes of text, padded to
+// CAPTURE_ALIGNMENT.
+struct CaptureMetricHeader {
+    uint32_t mFlags;
+    uint32_t mDescriptionLength;
+    uint32_t mUnitsLength;
+    uint32_t mReserved;
+};
+
+struct CaptureBlockHeader {
+    uint32_t mMagic;
+    uint32_t mColumnCount;
+    uint64_t mByteCount;        // size of the column headers and data following this header
+    uint64_t mFirstTimestamp;   // time range of the values in the block
+    uint64_t mLastTimestamp;
+    uint64_t mValueCount;
+};
+
+struct CaptureColumnHeader {
+    uint32_t mMetricIndex;
+    uint32_t mEncoding;         // CaptureEncoding
+    uint32_t mValueCount;
+    uint32_t mByteCount;        // size of the column data, including padding
+    uint64_t mFirstTimestamp;
+    uint64_t mLastTimestamp;
+};
+
+struct CaptureIndexEntry {
+    uint64_t mOffset;           // file offset of the CaptureBlockHeader
+    uint64_t mFirstTimestamp;
+    uint64_t mLastTimestamp;
+    uint64_t mValueCount;
+};
+
+struct CaptureFileFooter {
+    uint64_t mIndexOffset;
+    uint32_t mBlockCount;
+    uint32_t mMagic;
+};
+
+static_assert(sizeof(CaptureFileHeader)   == 32, "Unexpected CaptureFileHeader padding");
+static_assert(sizeof(CaptureMetricHeader) == 16, "Unexpected CaptureMetricHeader padding");
+static_assert(sizeof(CaptureBlockHeader)  == 40, "Unexpected CaptureBlockHeader padding");
+static_assert(sizeof(CaptureColumnHeader) == 32, "Unexpected CaptureColumnHeader padding");
+static_assert(sizeof(CaptureIndexEntry)   == 32, "Unexpected CaptureIndexEntry padding");
+static_assert(sizeof(CaptureFileFooter)   == 16, "Unexpected CaptureFileFooter padding");
+
+inline uint64_t AlignCaptureSize(
+    uint64_t size)
+{
+    return (size + CAPTURE_ALIGNMENT - 1) & ~(uint64_t) (CAPTURE_ALIGNMENT - 1);
+}
+
+#endif // ifndef METRICS_GUI_CAPTURE_FORMAT_H
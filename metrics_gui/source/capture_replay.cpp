@@ -0,0 +1,711 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "../../imgui/imgui.h"
+#include "../include/metrics_gui/capture.h"
+#include "../include/metrics_gui/trace.h"
+#include "../../portable/perf_timer.h"
+#include "capture_encoding.h"
+#include "capture_format.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Reads a metric's column in the latest opened block, holding the next
+// value so that values can be added up to a time.
+struct ReplayCursor {
+    CaptureColumnReader mReader;
+    std::vector<CaptureColumnReader> mPendingReaders;  // columns to read after mReader, in order
+    uint64_t mNextTimestamp;
+    float mNextValue;
+    bool mHasNext;
+};
+
+}
+
+struct MetricsGuiCaptureReplay::State {
+    char const* mData;
+    uint64_t mSize;
+
+    std::vector<MetricsGuiMetric> mMetrics;
+    std::vector<ReplayCursor> mCursors;
+    std::vector<CaptureIndexEntry> mIndex;
+
+    uint64_t mStartTime;        // capture timer counts
+    uint64_t mEndTime;
+    uint64_t mTime;             // values up to and including mTime have been added
+    uint32_t mNextBlock;        // the cursors have read the blocks before mNextBlock
+    double mCountsPerSecond;    // capture timer frequency
+    double mTimeScale;          // local timer counts per capture timer count
+};
+
+namespace {
+
+typedef MetricsGuiCaptureReplay::State ReplayState;
+
+bool MapFile(
+    ReplayState* state,
+    char const* path)
+{
+#ifdef _WIN32
+    auto file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size = {};
+    void* data = nullptr;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+        auto mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping != nullptr) {
+            data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping);
+        }
+    }
+    CloseHandle(file);
+    if (data == nullptr) {
+        return false;
+    }
+    state->mSize = (uint64_t) size.QuadPart;
+#else
+    auto fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        data = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    state->mSize = (uint64_t) st.st_size;
+#endif
+    state->mData = (char const*) data;
+    return true;
+}
+
+void UnmapFile(
+    ReplayState* state)
+{
+#ifdef _WIN32
+    UnmapViewOfFile(state->mData);
+#else
+    munmap((void*) state->mData, (size_t) state->mSize);
+#endif
+}
+
+// Read the metric headers and create the metrics.  Returns the file offset
+// of the first block, or 0 if the headers are invalid.
+uint64_t ReadMetricHeaders(
+    ReplayState* state,
+    uint32_t historySize)
+{
+    if (state->mSize < sizeof(CaptureFileHeader)) {
+        return 0;
+    }
+    auto fileHeader = (CaptureFileHeader const*) state->mData;
+    if (fileHeader->mMagic != CAPTURE_FILE_MAGIC ||
+        fileHeader->mVersion < CAPTURE_MIN_VERSION ||
+        fileHeader->mVersion > CAPTURE_VERSION ||
+        fileHeader->mTimerNumerator == 0 ||
+        fileHeader->mTimerDenominator == 0) {
+        return 0;
+    }
+
+    auto f = GetPerfTimerFrequency();
+    state->mCountsPerSecond = (double) fileHeader->mTimerNumerator / (double) fileHeader->mTimerDenominator;
+    state->mTimeScale = (double) f.Numerator / (double) f.Denominator / state->mCountsPerSecond;
+
+    // Each metric has a header, so a larger count than fits in the file is
+    // rejected before the metrics are allocated.
+    uint64_t offset = sizeof(CaptureFileHeader);
+    if (fileHeader->mMetricCount > (state->mSize - offset) / sizeof(CaptureMetricHeader)) {
+        return 0;
+    }
+    state->mMetrics.resize(fileHeader->mMetricCount);
+    state->mCursors.resize(fileHeader->mMetricCount);
+    for (auto& metric : state->mMetrics) {
+        if (state->mSize - offset < sizeof(CaptureMetricHeader)) {
+            return 0;
+        }
+        auto header = (CaptureMetricHeader const*) (state->mData + offset);
+        auto text = state->mData + offset + sizeof(CaptureMetricHeader);
+        auto textSize = AlignCaptureSize((uint64_t) header->mDescriptionLength + header->mUnitsLength);
+        offset += sizeof(CaptureMetricHeader);
+        if (state->mSize - offset < textSize) {
+            return 0;
+        }
+        offset += textSize;
+
+        // The capture doesn't record known min/max values.
+        auto flags = header->mFlags;
+        flags &= ~(MetricsGuiMetric::KNOWN_MIN_VALUE | MetricsGuiMetric::KNOWN_MAX_VALUE);
+        flags |= MetricsGuiMetric::RECORD_TIMESTAMPS;
+
+        std::string description(text, header->mDescriptionLength);
+        std::string units(text + header->mDescriptionLength, header->mUnitsLength);
+        metric.Initialize(description.c_str(), units.c_str(), flags, historySize);
+    }
+    return offset;
+}
+
+bool IsValidBlock(
+    ReplayState const* state,
+    uint64_t offset,
+    uint64_t end)
+{
+    if (offset > end || end - offset < sizeof(CaptureBlockHeader) || offset % CAPTURE_ALIGNMENT != 0) {
+        return false;
+    }
+    auto block = (CaptureBlockHeader const*) (state->mData + offset);
+    return block->mMagic == CAPTURE_BLOCK_MAGIC &&
+           block->mByteCount <= end - offset - sizeof(CaptureBlockHeader) &&
+           block->mColumnCount <= block->mByteCount / sizeof(CaptureColumnHeader);
+}
+
+// Use the index written when the capture was closed, or walk the block
+// headers if the capture wasn't closed.
+bool ReadIndex(
+    ReplayState* state,
+    uint64_t firstBlockOffset)
+{
+    auto index = &state->mIndex;
+    auto end = state->mSize;
+
+    CaptureFileFooter const* footer = nullptr;
+    if (state->mSize - firstBlockOffset >= sizeof(CaptureFileFooter) && state->mSize % CAPTURE_ALIGNMENT == 0) {
+        footer = (CaptureFileFooter const*) (state->mData + state->mSize - sizeof(CaptureFileFooter));
+        end = state->mSize - sizeof(CaptureFileFooter);
+    }
+    if (footer != nullptr &&
+        footer->mMagic == CAPTURE_FOOTER_MAGIC &&
+        footer->mIndexOffset >= firstBlockOffset &&
+        footer->mIndexOffset <= end &&
+        (end - footer->mIndexOffset) / sizeof(CaptureIndexEntry) == footer->mBlockCount) {
+        auto entries = (CaptureIndexEntry const*) (state->mData + footer->mIndexOffset);
+        index->assign(entries, entries + footer->mBlockCount);
+        for (auto const& entry : *index) {
+            if (!IsValidBlock(state, entry.mOffset, footer->mIndexOffset)) {
+                return false;
+            }
+        }
+    } else {
+        for (auto offset = firstBlockOffset; IsValidBlock(state, offset, state->mSize); ) {
+            auto block = (CaptureBlockHeader const*) (state->mData + offset);
+            CaptureIndexEntry entry = {};
+            entry.mOffset = offset;
+            entry.mFirstTimestamp = block->mFirstTimestamp;
+            entry.mLastTimestamp = block->mLastTimestamp;
+            entry.mValueCount = block->mValueCount;
+            index->emplace_back(entry);
+            offset += sizeof(CaptureBlockHeader) + block->mByteCount;
+        }
+    }
+
+    state->mStartTime = index->empty() ? 0 : index->front().mFirstTimestamp;
+    state->mEndTime = state->mStartTime;
+    for (auto const& entry : *index) {
+        state->mEndTime = std::max(state->mEndTime, entry.mLastTimestamp);
+    }
+    return true;
+}
+
+// Call fn(reader) with a reader for each of the block's columns.  Columns
+// that are invalid, or use an unknown encoding, are skipped.
+template<typename Fn>
+void ForEachColumn(
+    ReplayState const* state,
+    uint32_t blockIndex,
+    Fn fn)
+{
+    auto block = (CaptureBlockHeader const*) (state->mData + state->mIndex[blockIndex].mOffset);
+    auto headers = (CaptureColumnHeader const*) (block + 1);
+    auto data = (char const*) (headers + block->mColumnCount);
+    auto end = (char const*) (block + 1) + block->mByteCount;
+    CaptureColumnReader prevReader;
+    auto hasPrevReader = false;
+    for (uint32_t i = 0; i < block->mColumnCount; ++i) {
+        auto header = &headers[i];
+        if (header->mByteCount > (uint64_t) (end - data)) {
+            break;
+        }
+        CaptureColumnReader reader;
+        if (reader.Initialize(header, data, hasPrevReader ? &prevReader : nullptr)) {
+            if (header->mEncoding == CAPTURE_ENCODING_GORILLA) {
+                prevReader = reader;
+                hasPrevReader = true;
+            }
+            if (header->mMetricIndex < state->mMetrics.size()) {
+                fn(&reader);
+            }
+        }
+        data += header->mByteCount;
+    }
+}
+
+// Number of the column's values captured at or before time.
+uint32_t CountColumnValues(
+    CaptureColumnReader const* reader,
+    uint64_t time)
+{
+    auto header = reader->mHeader;
+    if (header->mLastTimestamp <= time) {
+        return header->mValueCount;
+    }
+    if (header->mFirstTimestamp > time) {
+        return 0;
+    }
+    if (header->mEncoding == CAPTURE_ENCODING_RAW) {
+        auto timestamps = (uint64_t const*) reader->mData;
+        return (uint32_t) (std::upper_bound(timestamps, timestamps + header->mValueCount, time) - timestamps);
+    }
+
+    auto countReader = *reader;
+    uint32_t count = 0;
+    uint64_t timestamp;
+    float value;
+    while (countReader.Read(&timestamp, &value) && timestamp <= time) {
+        count += 1;
+    }
+    return count;
+}
+
+// Number of blocks that start at or before time.
+uint32_t CountBlocks(
+    ReplayState const* state,
+    uint64_t time)
+{
+    auto const& index = state->mIndex;
+    return (uint32_t) (std::upper_bound(index.begin(), index.end(), time,
+        [](uint64_t t, CaptureIndexEntry const& entry) { return t < entry.mFirstTimestamp; }) - index.begin());
+}
+
+// Convert a capture timestamp to GetPerfTimerCount() units, relative to the
+// start of the capture.
+uint64_t GetLocalTime(
+    ReplayState const* state,
+    uint64_t timestamp)
+{
+    return (uint64_t) ((double) (timestamp - state->mStartTime) * state->mTimeScale);
+}
+
+void ReadCursor(
+    ReplayCursor* cursor)
+{
+    while (!(cursor->mHasNext = cursor->mReader.Read(&cursor->mNextTimestamp, &cursor->mNextValue)) &&
+           !cursor->mPendingReaders.empty()) {
+        cursor->mReader = cursor->mPendingReaders.front();
+        cursor->mPendingReaders.erase(cursor->mPendingReaders.begin());
+    }
+}
+
+// Queue a column to be read once the cursor's remaining values have been
+// added.  Blocks can overlap in time, so a metric's previous column may
+// still have values after the time its next column's block starts.
+void PushCursorColumn(
+    ReplayCursor* cursor,
+    CaptureColumnReader const* reader)
+{
+    if (cursor->mHasNext) {
+        cursor->mPendingReaders.push_back(*reader);
+    } else {
+        cursor->mReader = *reader;
+        ReadCursor(cursor);
+    }
+}
+
+// Add the metric's values captured at or before time.
+void AddCursorValues(
+    ReplayState* state,
+    uint32_t metricIndex,
+    uint64_t time)
+{
+    auto cursor = &state->mCursors[metricIndex];
+    auto metric = &state->mMetrics[metricIndex];
+    while (cursor->mHasNext && cursor->mNextTimestamp <= time) {
+        metric->AddNewValue(cursor->mNextValue, GetLocalTime(state, cursor->mNextTimestamp));
+        ReadCursor(cursor);
+    }
+}
+
+// Start reading the block's columns.  Values left in the metrics' previous
+// columns are added up to time first; any after time stay ahead of the new
+// column, to keep each metric's values in order.
+void OpenCursors(
+    ReplayState* state,
+    uint32_t blockIndex,
+    uint64_t time)
+{
+    ForEachColumn(state, blockIndex, [state, time](CaptureColumnReader const* reader) {
+        auto metricIndex = reader->mHeader->mMetricIndex;
+        AddCursorValues(state, metricIndex, time);
+        PushCursorColumn(&state->mCursors[metricIndex], reader);
+    });
+}
+
+// Write a value to a history being filled by SeekTime(), at the given
+// index of mHistory.
+void SetHistoryValue(
+    ReplayState const* state,
+    MetricsGuiMetric* metric,
+    uint32_t index,
+    uint64_t timestamp,
+    float value)
+{
+    if (metric->mTimestamps != nullptr) {
+        metric->mTimestamps[index] = GetLocalTime(state, timestamp);
+    }
+    metric->mHistory[index] = value;
+}
+
+// Clear the metrics' histories, keeping any settings changed by the
+// application.
+void ClearMetrics(
+    ReplayState* state)
+{
+    for (auto& metric : state->mMetrics) {
+        auto description = metric.mDescription;
+        auto units = metric.mUnits;
+        float color[4];
+        memcpy(color, metric.mColor, sizeof(color));
+        auto knownMinValue = metric.mKnownMinValue;
+        auto knownMaxValue = metric.mKnownMaxValue;
+        auto selected = metric.mSelected;
+
+        metric.Initialize(description.c_str(), units.c_str(), metric.mFlags, metric.mHistorySize);
+
+        memcpy(metric.mColor, color, sizeof(color));
+        metric.mKnownMinValue = knownMinValue;
+        metric.mKnownMaxValue = knownMaxValue;
+        metric.mSelected = selected;
+    }
+    for (auto& cursor : state->mCursors) {
+        cursor.mHasNext = false;
+        cursor.mPendingReaders.clear();
+    }
+}
+
+void SeekTime(
+    ReplayState* state,
+    uint64_t time)
+{
+    ClearMetrics(state);
+    state->mTime = time;
+    state->mNextBlock = 0;
+
+    auto blockCount = CountBlocks(state, time);
+    if (blockCount == 0) {
+        return;
+    }
+    auto lastBlock = blockCount - 1;
+    state->mNextBlock = blockCount;
+
+    // Earlier blocks that overlap time have columns with values after time;
+    // leave the cursors at the first of them.
+    for (uint32_t block = 0; block < lastBlock; ++block) {
+        if (state->mIndex[block].mLastTimestamp <= time) {
+            continue;
+        }
+        ForEachColumn(state, block, [state, time](CaptureColumnReader* reader) {
+            if (reader->mHeader->mLastTimestamp > time) {
+                reader->Skip(CountColumnValues(reader, time));
+                PushCursorColumn(&state->mCursors[reader->mHeader->mMetricIndex], reader);
+            }
+        });
+    }
+
+    // Read the block containing time into the histories (wrapping around
+    // if a column has more values than fit), leaving the cursors at the
+    // first value after time.  A metric with values left in an earlier
+    // column has none at or before time in this one.
+    ForEachColumn(state, lastBlock, [state, time](CaptureColumnReader const* reader) {
+        auto metric = &state->mMetrics[reader->mHeader->mMetricIndex];
+        auto cursor = &state->mCursors[reader->mHeader->mMetricIndex];
+        if (cursor->mHasNext) {
+            cursor->mPendingReaders.push_back(*reader);
+            return;
+        }
+        cursor->mReader = *reader;
+        for (ReadCursor(cursor); cursor->mHasNext && cursor->mNextTimestamp <= time; ReadCursor(cursor)) {
+            SetHistoryValue(state, metric, metric->mHistoryHead, cursor->mNextTimestamp, cursor->mNextValue);
+            metric->mHistoryHead = metric->mHistoryHead + 1 == metric->mHistorySize ? 0 : metric->mHistoryHead + 1;
+            metric->mHistoryCount = std::min(metric->mHistoryCount + 1, metric->mHistorySize);
+        }
+    });
+
+    // Walk back through up to SEEK_BLOCK_COUNT blocks to fill the rest of
+    // the histories, putting each column's values in front of the values
+    // already read.  These columns end before time, so their value counts
+    // are known without decoding them.
+    uint32_t unfilledCount = 0;
+    for (auto const& metric : state->mMetrics) {
+        unfilledCount += metric.mHistoryCount < metric.mHistorySize ? 1 : 0;
+    }
+    for (auto block = lastBlock; unfilledCount > 0 && block > 0 && lastBlock - block + 1 < MetricsGuiCaptureReplay::SEEK_BLOCK_COUNT; ) {
+        block -= 1;
+        ForEachColumn(state, block, [state, time, &unfilledCount](CaptureColumnReader* reader) {
+            auto metric = &state->mMetrics[reader->mHeader->mMetricIndex];
+            auto historyCount = metric->mHistoryCount;
+            auto historySize = metric->mHistorySize;
+            if (historyCount == historySize) {
+                return;
+            }
+
+            auto count = CountColumnValues(reader, time);
+            auto readCount = std::min(count, historySize - historyCount);
+            reader->Skip(count - readCount);
+
+            auto index = (metric->mHistoryHead + historySize - historyCount - readCount) % historySize;
+            for (uint32_t i = 0; i < readCount; ++i) {
+                uint64_t timestamp;
+                float value;
+                reader->Read(&timestamp, &value);
+                SetHistoryValue(state, metric, index, timestamp, value);
+                index = index + 1 == historySize ? 0 : index + 1;
+            }
+
+            metric->mHistoryCount += readCount;
+            if (metric->mHistoryCount == historySize) {
+                unfilledCount -= 1;
+            }
+        });
+    }
+
+    // Update the history statistics once per metric rather than once per
+    // value.
+    for (auto& metric : state->mMetrics) {
+        if (metric.mHistoryCount > 0) {
+            metric.mValueCount = metric.mHistoryCount;
+            metric.RebuildHistoryStatistics();
+        }
+    }
+}
+
+void AdvanceTime(
+    ReplayState* state,
+    uint64_t time)
+{
+    if (time <= state->mTime) {
+        if (time < state->mTime) {
+            SeekTime(state, time);
+        }
+        return;
+    }
+
+    // Adding every value of a skipped block costs more than seeking, which
+    // only adds the values that fit in the histories.
+    auto blockCount = CountBlocks(state, time);
+    if (blockCount > state->mNextBlock + 1) {
+        SeekTime(state, time);
+        return;
+    }
+
+    for (;;) {
+        for (uint32_t i = 0, N = (uint32_t) state->mMetrics.size(); i < N; ++i) {
+            AddCursorValues(state, i, time);
+        }
+        if (state->mNextBlock == blockCount) {
+            break;
+        }
+        OpenCursors(state, state->mNextBlock, time);
+        state->mNextBlock += 1;
+    }
+    state->mTime = time;
+}
+
+uint64_t GetCaptureTime(
+    ReplayState const* state,
+    double time)
+{
+    time = std::max(0., std::min(time, (double) (state->mEndTime - state->mStartTime) / state->mCountsPerSecond));
+    return state->mStartTime + (uint64_t) (time * state->mCountsPerSecond);
+}
+
+}
+
+MetricsGuiCaptureReplay::MetricsGuiCaptureReplay()
+    : mState(nullptr)
+    , mSpeed(1.f)
+    , mPlaying(false)
+{
+}
+
+MetricsGuiCaptureReplay::~MetricsGuiCaptureReplay()
+{
+    Close();
+}
+
+bool MetricsGuiCaptureReplay::Open(
+    char const* path,
+    uint32_t historySize)
+{
+    Close();
+
+    auto state = new State();
+    if (!MapFile(state, path)) {
+        delete state;
+        return false;
+    }
+
+    auto firstBlockOffset = ReadMetricHeaders(state, historySize);
+    if (firstBlockOffset == 0 || !ReadIndex(state, firstBlockOffset)) {
+        UnmapFile(state);
+        delete state;
+        return false;
+    }
+
+    mState = state;
+    mPlaying = false;
+    SeekTime(state, state->mStartTime);
+    return true;
+}
+
+void MetricsGuiCaptureReplay::Close()
+{
+    if (mState != nullptr) {
+        UnmapFile(mState);
+        delete mState;
+        mState = nullptr;
+    }
+    mPlaying = false;
+}
+
+uint32_t MetricsGuiCaptureReplay::GetMetricCount() const
+{
+    return mState == nullptr ? 0 : (uint32_t) mState->mMetrics.size();
+}
+
+MetricsGuiMetric* MetricsGuiCaptureReplay::GetMetric(
+    uint32_t index) const
+{
+    assert(index < GetMetricCount());
+    return &mState->mMetrics[index];
+}
+
+double MetricsGuiCaptureReplay::GetDuration() const
+{
+    return mState == nullptr ? 0. : (double) (mState->mEndTime - mState->mStartTime) / mState->mCountsPerSecond;
+}
+
+double MetricsGuiCaptureReplay::GetTime() const
+{
+    return mState == nullptr ? 0. : (double) (mState->mTime - mState->mStartTime) / mState->mCountsPerSecond;
+}
+
+void MetricsGuiCaptureReplay::Seek(
+    double time)
+{
+    if (mState != nullptr) {
+        SeekTime(mState, GetCaptureTime(mState, time));
+    }
+}
+
+void MetricsGuiCaptureReplay::Advance(
+    double time)
+{
+    if (mState != nullptr) {
+        AdvanceTime(mState, GetCaptureTime(mState, time));
+    }
+}
+
+void MetricsGuiCaptureReplay::Update(
+    float elapsedSeconds)
+{
+    if (mState == nullptr || !mPlaying) {
+        return;
+    }
+
+    auto time = GetTime() + elapsedSeconds * mSpeed;
+    if (time >= GetDuration()) {
+        time = GetDuration();
+        mPlaying = false;
+    }
+    Advance(time);
+}
+
+void MetricsGuiCaptureReplay::DrawControls()
+{
+    ImGui::PushID(this);
+
+    if (ImGui::Button(mPlaying ? "Pause" : "Play")) {
+        if (!mPlaying && GetTime() >= GetDuration()) {
+            Seek(0.);
+        }
+        mPlaying = !mPlaying;
+    }
+
+    ImGui::SameLine();
+    auto time = (float) GetTime();
+    if (ImGui::SliderFloat("Time", &time, 0.f, (float) GetDuration(), "%.3f s")) {
+        Seek(time);
+    }
+
+    ImGui::SliderFloat("Speed", &mSpeed, 1.f / 16.f, 16.f, "%.3fx", 3.f);
+
+    ImGui::PopID();
+}
+
+void MetricsGuiCaptureReplay::WriteTrace(
+    MetricsGuiTraceWriter* trace) const
+{
+    if (mState == nullptr) {
+        return;
+    }
+
+    // Decode a column at a time, in chunks, so that only one chunk of
+    // values is held however large the capture is.
+    enum { CHUNK_VALUE_COUNT = 256 };
+    auto state = mState;
+    for (uint32_t i = 0, N = (uint32_t) state->mIndex.size(); i < N; ++i) {
+        ForEachColumn(state, i, [state, trace](CaptureColumnReader* reader) {
+            auto metric = &state->mMetrics[reader->mHeader->mMetricIndex];
+            uint64_t timestamps[CHUNK_VALUE_COUNT];
+            float values[CHUNK_VALUE_COUNT];
+            uint32_t count = 0;
+            uint64_t timestamp = 0;
+            float value = 0.f;
+            while (reader->Read(&timestamp, &value)) {
+                timestamps[count] = (uint64_t) ((double) timestamp * state->mTimeScale);
+                values[count] = value;
+                if (++count == CHUNK_VALUE_COUNT) {
+                    trace->WriteValues(metric, values, timestamps, count);
+                    count = 0;
+                }
+            }
+            trace->WriteValues(metric, values, timestamps, count);
+        });
+    }
+}
@@ -25,10 +25,17 @@ SOFTWARE.
 #include "../../imgui/imgui_internal.h"
 #include "../include/metrics_gui/metrics_gui.h"
 #include "../../portable/countof.h"
+#include "../../portable/perf_timer.h"
 #include "../../portable/snprintf.h"
+#include "quantity_label.h"
+#include "reduce.h"
 
 #include <algorithm>
 #include <assert.h>
+#include <math.h>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
 
 namespace {
 
@@ -41,54 +48,206 @@ static float const LEGEND_TEXT_VERTICAL_SPACING =  2.f;
 
 uint32_t gConstructedMetricIndex = 0;
 
-int CreateQuantityLabel(
+// Equivalent to snprintf(s, size, " %.3lf", value), i.e., rounding to the
+// nearest thousandth with ties to even, but without the overhead of
+// snprintf.  s must hold at least 32 characters.  Values that aren't
+// finite or whose magnitude is at least 1e15 are passed to snprintf.
+int FormatThousandths(
+    char* s,
+    size_t size,
+    double value)
+{
+    if (!(value > -1e15 && value < 1e15)) {
+        return snprintf(s, size, " %.3lf", value);
+    }
+
+    // value = mantissa * 2^-shift, where shift > 0 since |value| < 2^50.
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    auto negative = (bits >> 63) != 0;
+    auto exponent = (int) ((bits >> 52) & 0x7ff);
+    auto mantissa = bits & ((1ull << 52) - 1);
+    if (exponent == 0) {
+        exponent = 1;
+    } else {
+        mantissa |= 1ull << 52;
+    }
+    auto shift = 1075 - exponent;
+
+    // Compute the number of thousandths, q = round(mantissa * 1000 / 2^shift).
+    // mantissa * 1000 < 2^63, so it fits and if shift >= 64 it is less than
+    // half of 2^shift.
+    uint64_t q = 0;
+    if (shift < 64) {
+        auto p = mantissa * 1000;
+        auto r = p & ((1ull << shift) - 1);
+        auto half = 1ull << (shift - 1);
+        q = p >> shift;
+        if (r > half || (r == half && (q & 1) != 0)) {
+            q += 1;
+        }
+    }
+
+    // Write the digits backwards from the end of a buffer
+    char digits[32];
+    auto d = digits + sizeof(digits);
+    auto integer = q / 1000;
+    auto fraction = (uint32_t) (q % 1000);
+    *--d = (char) ('0' + fraction % 10);
+    *--d = (char) ('0' + fraction / 10 % 10);
+    *--d = (char) ('0' + fraction / 100);
+    *--d = '.';
+    do {
+        *--d = (char) ('0' + integer % 10);
+        integer /= 10;
+    } while (integer != 0);
+    if (negative) {
+        *--d = '-';
+    }
+    *--d = ' ';
+
+    auto n = (int) (digits + sizeof(digits) - d);
+    assert((size_t) n < size);
+    memcpy(s, d, n);
+    s[n] = '\0';
+    return n;
+}
+
+// Append src to dst, like strncat() but limited by the total size of dst
+// and keeping track of the length.  Returns the length that the result
+// would have had without truncation, like snprintf().
+size_t AppendString(
+    char* dst,
+    size_t dstSize,
+    size_t dstLength,
+    char const* src)
+{
+    auto n = strlen(src);
+    if (dstLength + 1 < dstSize) {
+        auto copyCount = std::min(n, dstSize - 1 - dstLength);
+        memcpy(dst + dstLength, src, copyCount);
+        dst[dstLength + copyCount] = '\0';
+    }
+    return dstLength + n;
+}
+
+// Unit prefixes, indexed by their power of 1000 (or 1024) minus
+// MIN_UNIT_PREFIX.
+enum {
+    MIN_UNIT_PREFIX = -3,   // nano
+    MAX_UNIT_PREFIX =  4,   // tera
+};
+
+char const* const SI_UNIT_PREFIXES[]     = { "n", "u", "m", "", "k",  "M",  "G",  "T"  };
+char const* const BINARY_UNIT_PREFIXES[] = { "",  "",  "",  "", "Ki", "Mi", "Gi", "Ti" };
+
+// The unit info of empty units, e.g., for plots that don't show units.
+// Initialize() gives each metric's units a non-zero mUnitsId.
+MetricsGuiMetric::UnitInfo const NO_UNIT_INFO = { 0, 0, 0, 0, 0, false };
+
+uint32_t gLastUnitsId = 0;
+
+// Units whose prefix is recognized.  Fractional units can be scaled below
+// one (e.g., to ms), and the others can also take binary prefixes.  Units
+// that aren't listed are scaled over the whole SI range, with the prefix
+// prepended to the units as given.
+struct BaseUnits {
+    char const* mUnits;
+    bool mFractional;
+};
+
+BaseUnits const BASE_UNITS[] = {
+    { "s",     true  },
+    { "Hz",    true  },
+    { "B",     false },
+    { "B/s",   false },
+    { "bit",   false },
+    { "bit/s", false },
+};
+
+BaseUnits const* FindBaseUnits(
+    char const* units)
+{
+    for (auto const& baseUnits : BASE_UNITS) {
+        if (strcmp(units, baseUnits.mUnits) == 0) {
+            return &baseUnits;
+        }
+    }
+    return nullptr;
+}
+
+MetricsGuiMetric::UnitInfo ParseUnits(
+    char const* units,
+    uint32_t flags)
+{
+    auto unitInfo = NO_UNIT_INFO;
+    auto binaryPrefix = (flags & MetricsGuiMetric::USE_BINARY_UNIT_PREFIX) != 0;
+    if (!binaryPrefix && (flags & MetricsGuiMetric::USE_SI_UNIT_PREFIX) == 0) {
+        return unitInfo;
+    }
+
+    // Look for a binary prefix, then an SI prefix, on recognized units
+    auto baseUnits = FindBaseUnits(units);
+    for (int prefix = 1; baseUnits == nullptr && prefix <= MAX_UNIT_PREFIX; ++prefix) {
+        auto prefixS = BINARY_UNIT_PREFIXES[prefix - MIN_UNIT_PREFIX];
+        if (strncmp(units, prefixS, 2) == 0) {
+            baseUnits = FindBaseUnits(units + 2);
+            if (baseUnits != nullptr && !baseUnits->mFractional) {
+                unitInfo.mBaseUnitsOffset = 2;
+                unitInfo.mPrefix = (int8_t) prefix;
+                binaryPrefix = true;
+            } else {
+                baseUnits = nullptr;
+            }
+        }
+    }
+    for (int prefix = MIN_UNIT_PREFIX; baseUnits == nullptr && prefix <= MAX_UNIT_PREFIX; ++prefix) {
+        auto prefixS = SI_UNIT_PREFIXES[prefix - MIN_UNIT_PREFIX];
+        if (prefixS[0] != '\0' && units[0] == prefixS[0]) {
+            baseUnits = FindBaseUnits(units + 1);
+            if (baseUnits != nullptr && (baseUnits->mFractional || prefix > 0)) {
+                unitInfo.mBaseUnitsOffset = 1;
+                unitInfo.mPrefix = (int8_t) prefix;
+                binaryPrefix = false;
+            } else {
+                baseUnits = nullptr;
+            }
+        }
+    }
+
+    unitInfo.mBinaryPrefix = binaryPrefix;
+    unitInfo.mMinPrefix = (int8_t) (binaryPrefix || (baseUnits != nullptr && !baseUnits->mFractional) ? 0 : MIN_UNIT_PREFIX);
+    unitInfo.mMaxPrefix = (int8_t) MAX_UNIT_PREFIX;
+    return unitInfo;
+}
+
+}
+
+int MetricsGuiCreateQuantityLabel(
     char* memory,
     size_t memorySize,
     float quantity,
+    MetricsGuiMetric::UnitInfo const& unitInfo,
     char const* units,
-    char const* prefix,
-    bool useSiUnitPrefix)
-{
-    enum {
-        NANO,
-        MICRO,
-        MILLI,
-        NONE,
-        KILO,
-        MEGA,
-        GIGA,
-        TERA,
-        NUM_SI_PREFIXES,
-    };
-    char const* siPrefixChar = "num kMGT";
-    uint32_t siPrefix = NONE;
+    char const* prefix)
+{
+    int unitPrefix = unitInfo.mPrefix;
     double value = (double) quantity;
 
-    // Adjust SI magnitude if requested
-    if (useSiUnitPrefix) {
-        if (units[0] != '\0' && (
-            strcmp(units + 1, "Hz") == 0 ||
-            strcmp(units + 1, "s") == 0)) {
-            switch (units[0]) {
-            case 'n': siPrefix = NANO; break;
-            case 'u': siPrefix = MICRO; break;
-            case 'm': siPrefix = MILLI; break;
-            case 'k': siPrefix = KILO; break;
-            case 'M': siPrefix = MEGA; break;
-            case 'G': siPrefix = GIGA; break;
-            case 'T': siPrefix = TERA; break;
-            default: assert(false); break;
-            }
-            units = units + 1;
-        }
-
+    // Adjust the unit prefix if allowed
+    if (unitInfo.mMinPrefix < unitInfo.mMaxPrefix) {
         if (value == 0.0) { // If the value is zero, prevent 0 nUnits
-            siPrefix = NONE;
+            unitPrefix = 0;
         } else {
             auto sign = value < 0.0 ? -1.0 : 1.0;
             value *= sign;
-            for (; value > 1000.0 && siPrefix < NUM_SI_PREFIXES - 1; ++siPrefix) value *= 0.001;
-            for (; value < 1.0 && siPrefix > 0; --siPrefix) value *= 1000.0;
+            if (unitInfo.mBinaryPrefix) {
+                for (; value >= 1024.0 && unitPrefix < unitInfo.mMaxPrefix; ++unitPrefix) value *= 1.0 / 1024.0;
+                for (; value < 1.0 && unitPrefix > unitInfo.mMinPrefix; --unitPrefix) value *= 1024.0;
+            } else {
+                for (; value > 1000.0 && unitPrefix < unitInfo.mMaxPrefix; ++unitPrefix) value *= 0.001;
+                for (; value < 1.0 && unitPrefix > unitInfo.mMinPrefix; --unitPrefix) value *= 1000.0;
+            }
             value *= sign;
         }
     }
@@ -100,7 +259,7 @@ int CreateQuantityLabel(
     //     4.123YYY       => " 4.123"       (6) => "4.12"
     //     0.123YYY       => " 0.123"       (6) => ".123"
     char numberString[256];
-    int n = snprintf(numberString, 256, " %.3lf", value);
+    int n = FormatThousandths(numberString, 256, value);
     auto valueS = &numberString[1];
 
     if (n >= 8) {
@@ -123,27 +282,673 @@ int CreateQuantityLabel(
     }
 
     // Output final string
-    char siPrefixS[] = {
-        siPrefix == NONE ? '\0' : siPrefixChar[siPrefix],
-        '\0'
-    };
-    return snprintf(memory, memorySize, "%s%s %s%s", prefix, valueS, siPrefixS, units);
+    auto unitPrefixS = (unitInfo.mBinaryPrefix ? BINARY_UNIT_PREFIXES : SI_UNIT_PREFIXES)[unitPrefix - MIN_UNIT_PREFIX];
+    if (memorySize > 0) {
+        memory[0] = '\0';
+    }
+    size_t length = 0;
+    length = AppendString(memory, memorySize, length, prefix);
+    length = AppendString(memory, memorySize, length, valueS);
+    length = AppendString(memory, memorySize, length, " ");
+    length = AppendString(memory, memorySize, length, unitPrefixS);
+    length = AppendString(memory, memorySize, length, units + unitInfo.mBaseUnitsOffset);
+    return (int) length;
+}
+
+namespace {
+
+// Convert an index relative to the oldest history value (i.e., 0 is the
+// oldest value and mHistorySize-1 is the newest) into an index into the
+// circular mHistory buffer.
+inline size_t GetHistoryIndex(
+    MetricsGuiMetric const* metric,
+    size_t index)
+{
+    index += metric->mHistoryHead;
+    return index < metric->mHistorySize ? index : (index - metric->mHistorySize);
+}
+
+uint32_t GetMaxHistorySize(
+    std::vector<MetricsGuiMetric*> const& metrics)
+{
+    uint32_t historySize = 0;
+    for (auto metric : metrics) {
+        historySize = std::max(historySize, metric->mHistorySize);
+    }
+    return historySize;
+}
+
+// History storage is pooled by power-of-two size class, with blocks carved
+// out of larger slabs that are kept for the lifetime of the process.  This
+// keeps metric creation cheap and avoids fragmenting the heap when many
+// small histories are created and destroyed.  Histories larger than the
+// largest size class are allocated directly.
+enum {
+    HISTORY_POOL_MIN_SIZE_CLASS = 4,    // 16 values
+    HISTORY_POOL_MAX_SIZE_CLASS = 16,   // 64K values
+    HISTORY_POOL_SLAB_BYTES     = 64 * 1024,
+};
+
+struct HistoryPoolBlock {
+    HistoryPoolBlock* mNext;
+};
+
+HistoryPoolBlock* gHistoryPoolFreeList[HISTORY_POOL_MAX_SIZE_CLASS + 1] = {};
+
+uint32_t GetHistorySizeClass(
+    uint32_t historySize)
+{
+    uint32_t sizeClass = HISTORY_POOL_MIN_SIZE_CLASS;
+    while (sizeClass <= HISTORY_POOL_MAX_SIZE_CLASS && (1u << sizeClass) < historySize) {
+        ++sizeClass;
+    }
+    return sizeClass;
+}
+
+float* AllocateHistory(
+    uint32_t historySize)
+{
+    auto sizeClass = GetHistorySizeClass(historySize);
+    if (sizeClass > HISTORY_POOL_MAX_SIZE_CLASS) {
+        return (float*) malloc(historySize * sizeof(float));
+    }
+
+    auto freeList = &gHistoryPoolFreeList[sizeClass];
+    if (*freeList == nullptr) {
+        size_t blockBytes = sizeof(float) << sizeClass;
+        size_t blockCount = std::max((size_t) 1, HISTORY_POOL_SLAB_BYTES / blockBytes);
+        auto slab = (char*) malloc(blockCount * blockBytes);
+        for (size_t i = blockCount; i-- > 0; ) {
+            auto block = (HistoryPoolBlock*) (slab + i * blockBytes);
+            block->mNext = *freeList;
+            *freeList = block;
+        }
+    }
+
+    auto block = *freeList;
+    *freeList = block->mNext;
+    return (float*) block;
+}
+
+void FreeHistory(
+    float* history,
+    uint32_t historySize)
+{
+    if (history == nullptr) {
+        return;
+    }
+
+    auto sizeClass = GetHistorySizeClass(historySize);
+    if (sizeClass > HISTORY_POOL_MAX_SIZE_CLASS) {
+        free(history);
+        return;
+    }
+
+    auto block = (HistoryPoolBlock*) history;
+    block->mNext = gHistoryPoolFreeList[sizeClass];
+    gHistoryPoolFreeList[sizeClass] = block;
+}
+
+// The min, max, and sum of a history is maintained in a range tree so that
+// it can be updated in O(log N) when a value changes, the whole-history
+// range can be queried in O(1), and the range of any span of the history
+// can be queried in O(log N).  The tree is stored as an implicit binary heap
+// of size leaves (node 1 is the root, node i has children 2i and 2i+1),
+// where leaf node size+b summarizes values [b*RANGE_TREE_BLOCK_SIZE,
+// (b+1)*RANGE_TREE_BLOCK_SIZE).  Grouping values into blocks keeps the tree
+// small compared to the history, and blocks are scanned with SIMD so they
+// can be fairly large.
+//
+// Each tree level is effectively a decimated copy of the history, which
+// DrawMetrics() uses to draw long histories at a cost proportional to the
+// plot width rather than the history size.
+//
+// The tree is built over buffer indices rather than history order.
+enum { RANGE_TREE_BLOCK_SIZE = 32 };
+
+struct RangeTree {
+    float* mMin;
+    float* mMax;
+    float* mSum;    // optional
+    uint32_t mSize;
+};
+
+struct ValueRange {
+    float mMin;
+    float mMax;
+    float mSum;
+
+    ValueRange()
+        : mMin(FLT_MAX)
+        , mMax(-FLT_MAX)
+        , mSum(0.f)
+    {
+    }
+
+    void Add(
+        float minValue,
+        float maxValue,
+        float sum)
+    {
+        mMin = std::min(mMin, minValue);
+        mMax = std::max(mMax, maxValue);
+        mSum += sum;
+    }
+
+    void Add(
+        RangeTree const& tree,
+        uint32_t node)
+    {
+        Add(tree.mMin[node], tree.mMax[node], tree.mSum == nullptr ? 0.f : tree.mSum[node]);
+    }
+
+    void Add(
+        float const* values,
+        uint32_t valueCount,
+        bool computeSum)
+    {
+        if (valueCount > 0) {
+            Add(MetricsGuiReduceMin(values, valueCount),
+                MetricsGuiReduceMax(values, valueCount),
+                computeSum ? MetricsGuiReduceSum(values, valueCount) : 0.f);
+        }
+    }
+};
+
+uint32_t GetRangeTreeSize(
+    uint32_t valueCount)
+{
+    uint32_t blockCount = (valueCount + RANGE_TREE_BLOCK_SIZE - 1) / RANGE_TREE_BLOCK_SIZE;
+    uint32_t treeSize = 1;
+    while (treeSize < blockCount) {
+        treeSize <<= 1;
+    }
+    return treeSize;
+}
+
+RangeTree GetHistoryTree(
+    MetricsGuiMetric const* metric)
+{
+    RangeTree tree;
+    tree.mMin  = metric->mHistoryMinTree;
+    tree.mMax  = metric->mHistoryMaxTree;
+    tree.mSum  = metric->mHistorySumTree;
+    tree.mSize = metric->mHistoryTreeSize;
+    return tree;
+}
+
+void SetRangeTreeLeaf(
+    RangeTree const& tree,
+    float const* values,
+    uint32_t valueCount,
+    uint32_t block)
+{
+    auto i = std::min(block * RANGE_TREE_BLOCK_SIZE, valueCount);
+    auto end = std::min(i + RANGE_TREE_BLOCK_SIZE, valueCount);
+
+    ValueRange range;
+    range.Add(values + i, end - i, tree.mSum != nullptr);
+
+    auto node = tree.mSize + block;
+    tree.mMin[node] = range.mMin;
+    tree.mMax[node] = range.mMax;
+    if (tree.mSum != nullptr) {
+        tree.mSum[node] = range.mSum;
+    }
+}
+
+void SetRangeTreeNode(
+    RangeTree const& tree,
+    uint32_t node)
+{
+    tree.mMin[node] = std::min(tree.mMin[2 * node], tree.mMin[2 * node + 1]);
+    tree.mMax[node] = std::max(tree.mMax[2 * node], tree.mMax[2 * node + 1]);
+    if (tree.mSum != nullptr) {
+        tree.mSum[node] = tree.mSum[2 * node] + tree.mSum[2 * node + 1];
+    }
+}
+
+void BuildRangeTree(
+    RangeTree const& tree,
+    float const* values,
+    uint32_t valueCount)
+{
+    for (uint32_t block = 0; block < tree.mSize; ++block) {
+        SetRangeTreeLeaf(tree, values, valueCount, block);
+    }
+    for (uint32_t node = tree.mSize - 1; node > 0; --node) {
+        SetRangeTreeNode(tree, node);
+    }
+}
+
+// Update the tree after values[index] has changed.
+void UpdateRangeTree(
+    RangeTree const& tree,
+    float const* values,
+    uint32_t valueCount,
+    uint32_t index)
+{
+    auto node = tree.mSize + index / RANGE_TREE_BLOCK_SIZE;
+    SetRangeTreeLeaf(tree, values, valueCount, node - tree.mSize);
+    for (node >>= 1; node > 0; node >>= 1) {
+        SetRangeTreeNode(tree, node);
+    }
+}
+
+// Update the tree after values [begin, end) have changed.
+void UpdateRangeTree(
+    RangeTree const& tree,
+    float const* values,
+    uint32_t valueCount,
+    uint32_t begin,
+    uint32_t end)
+{
+    if (begin >= end) {
+        return;
+    }
+
+    auto l = tree.mSize + begin / RANGE_TREE_BLOCK_SIZE;
+    auto r = tree.mSize + (end - 1) / RANGE_TREE_BLOCK_SIZE;
+    for (auto node = l; node <= r; ++node) {
+        SetRangeTreeLeaf(tree, values, valueCount, node - tree.mSize);
+    }
+    for (l >>= 1, r >>= 1; l > 0; l >>= 1, r >>= 1) {
+        for (auto node = l; node <= r; ++node) {
+            SetRangeTreeNode(tree, node);
+        }
+    }
+}
+
+// Accumulate the range of values [begin, end) into range.  Whole blocks are
+// taken from the tree, and only the partial blocks at either end are
+// scanned.
+void QueryRangeTree(
+    RangeTree const& tree,
+    float const* values,
+    uint32_t begin,
+    uint32_t end,
+    ValueRange* range)
+{
+    auto computeSum = tree.mSum != nullptr;
+    auto blockBegin = (begin + RANGE_TREE_BLOCK_SIZE - 1) / RANGE_TREE_BLOCK_SIZE;
+    auto blockEnd   = end / RANGE_TREE_BLOCK_SIZE;
+    if (blockBegin >= blockEnd) {
+        range->Add(values + begin, end - begin, computeSum);
+        return;
+    }
+
+    range->Add(values + begin, blockBegin * RANGE_TREE_BLOCK_SIZE - begin, computeSum);
+    range->Add(values + blockEnd * RANGE_TREE_BLOCK_SIZE, end - blockEnd * RANGE_TREE_BLOCK_SIZE, computeSum);
+
+    auto l = tree.mSize + blockBegin;
+    auto r = tree.mSize + blockEnd;
+    for (; l < r; l >>= 1, r >>= 1) {
+        if (l & 1) range->Add(tree, l++);
+        if (r & 1) range->Add(tree, --r);
+    }
+}
+
+// Accumulate the range of history values [begin, end), where index 0 is the
+// oldest value.
+void QueryHistoryRange(
+    MetricsGuiMetric const* metric,
+    uint32_t begin,
+    uint32_t end,
+    ValueRange* range)
+{
+    auto tree = GetHistoryTree(metric);
+    auto b = (uint32_t) GetHistoryIndex(metric, begin);
+    auto e = b + (end - begin);
+    if (e <= metric->mHistorySize) {
+        QueryRangeTree(tree, metric->mHistory, b, e, range);
+    } else {
+        QueryRangeTree(tree, metric->mHistory, b, metric->mHistorySize, range);
+        QueryRangeTree(tree, metric->mHistory, 0, e - metric->mHistorySize, range);
+    }
+}
+
+// Timestamps are allocated from the history pool as two floats each.
+void ResizeTimestamps(
+    MetricsGuiMetric* metric,
+    bool recordTimestamps)
+{
+    if (recordTimestamps == (metric->mTimestamps != nullptr)) {
+        return;
+    }
+
+    if (recordTimestamps) {
+        metric->mTimestamps = (uint64_t*) AllocateHistory(2 * metric->mHistorySize);
+    } else {
+        FreeHistory((float*) metric->mTimestamps, 2 * metric->mHistorySize);
+        metric->mTimestamps = nullptr;
+    }
+}
+
+// Find the first history value in [begin, mHistorySize), where index 0 is
+// the oldest value, whose timestamp is not before time.  Timestamps don't
+// decrease, so this gallops forward from begin and then binary searches;
+// finding the boundaries of successive time buckets costs O(log n) for a
+// bucket of n values, rather than O(log mHistorySize).  begin must not be
+// before the oldest valid value.
+uint32_t FindHistoryTime(
+    MetricsGuiMetric const* metric,
+    uint64_t time,
+    uint32_t begin)
+{
+    auto end = metric->mHistorySize;
+    auto lo = begin;
+    auto hi = begin;
+    for (uint32_t step = 1; hi < end && metric->mTimestamps[GetHistoryIndex(metric, hi)] < time; step *= 2) {
+        lo = hi + 1;
+        hi = end - lo > step ? lo + step : end;
+    }
+    while (lo < hi) {
+        auto mid = lo + (hi - lo) / 2;
+        if (metric->mTimestamps[GetHistoryIndex(metric, mid)] < time) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+void ResizeHistory(
+    MetricsGuiMetric* metric,
+    uint32_t historySize)
+{
+    if (metric->mHistorySize == historySize) {
+        return;
+    }
+
+    ResizeTimestamps(metric, false);
+
+    if (metric->mRegistryHistory) {
+        metric->mRegistryHistory = false;
+    } else {
+        FreeHistory(metric->mHistory, metric->mHistorySize);
+        FreeHistory(metric->mHistoryMinTree, 6 * metric->mHistoryTreeSize);
+    }
+
+    // The min, max, and sum trees share one allocation
+    metric->mHistorySize     = historySize;
+    metric->mHistoryTreeSize = GetRangeTreeSize(historySize);
+    metric->mHistory         = historySize == 0 ? nullptr : AllocateHistory(historySize);
+    metric->mHistoryMinTree  = historySize == 0 ? nullptr : AllocateHistory(6 * metric->mHistoryTreeSize);
+    metric->mHistoryMaxTree  = historySize == 0 ? nullptr : metric->mHistoryMinTree + 2 * metric->mHistoryTreeSize;
+    metric->mHistorySumTree  = historySize == 0 ? nullptr : metric->mHistoryMinTree + 4 * metric->mHistoryTreeSize;
+}
+
+// Map a value to a key that orders the same way as the values, from the
+// value's float representation: negative values have all their bits
+// flipped, and positive values have their sign bit set.
+inline uint32_t GetPercentileKey(
+    float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return (bits & 0x80000000u) != 0 ? ~bits : (bits | 0x80000000u);
+}
+
+inline float GetPercentileKeyValue(
+    uint32_t key)
+{
+    auto bits = (key & 0x80000000u) != 0 ? (key & 0x7fffffffu) : ~key;
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+void AddPercentileValue(
+    MetricsGuiMetric::PercentileHistogram* histogram,
+    float value,
+    int32_t count)
+{
+    typedef MetricsGuiMetric::PercentileHistogram PercentileHistogram;
+
+    auto key = GetPercentileKey(value);
+    auto bucket = key >> 23;
+    auto subBucket = (key >> (23 - PercentileHistogram::SUB_BUCKET_BITS)) & (PercentileHistogram::SUB_BUCKET_COUNT - 1);
+    auto block = &histogram->mSubBucketBlocks[bucket];
+    if (*block == 0) {
+        *block = (uint16_t) (histogram->mSubBucketCounts.size() / PercentileHistogram::SUB_BUCKET_COUNT + 1);
+        histogram->mSubBucketCounts.resize(histogram->mSubBucketCounts.size() + PercentileHistogram::SUB_BUCKET_COUNT, 0);
+    }
+    histogram->mSubBucketCounts[(*block - 1) * PercentileHistogram::SUB_BUCKET_COUNT + subBucket] += count;
+    histogram->mBucketCounts[bucket] += count;
+    histogram->mCount += count;
 }
 
+// Clear the counts, keeping the allocated sub-buckets.
+void ClearPercentileHistogram(
+    MetricsGuiMetric::PercentileHistogram* histogram)
+{
+    std::fill(histogram->mSubBucketCounts.begin(), histogram->mSubBucketCounts.end(), 0);
+    memset(histogram->mBucketCounts, 0, sizeof(histogram->mBucketCounts));
+    histogram->mCount = 0;
+}
+
+void BuildPercentileHistogram(
+    MetricsGuiMetric* metric)
+{
+    auto histogram = metric->mPercentileHistogram;
+    ClearPercentileHistogram(histogram);
+    for (auto i = metric->mHistorySize - metric->mHistoryCount; i < metric->mHistorySize; ++i) {
+        AddPercentileValue(histogram, metric->mHistory[GetHistoryIndex(metric, i)], 1);
+    }
+}
+
+// Get the range of the values in a percentile histogram, from the low edge of
+// its lowest non-empty sub-bucket to the high edge of its highest.  If
+// positiveOnly, zero and the sub-bucket holding it are ignored, as well as
+// negative values.  Returns false if there are no values.
+bool GetPercentileHistogramRange(
+    MetricsGuiMetric::PercentileHistogram const* histogram,
+    bool positiveOnly,
+    float* minValue,
+    float* maxValue)
+{
+    typedef MetricsGuiMetric::PercentileHistogram PercentileHistogram;
+
+    auto shift = 23 - PercentileHistogram::SUB_BUCKET_BITS;
+    auto firstKey = positiveOnly ? (0x80000000u + (1u << shift)) : 0u;
+    auto found = false;
+    uint32_t lowKey = 0;
+    uint32_t highKey = 0;
+    for (auto bucket = firstKey >> 23; bucket < PercentileHistogram::BUCKET_COUNT; ++bucket) {
+        if (histogram->mBucketCounts[bucket] == 0) {
+            continue;
+        }
+        auto subBucketCounts = &histogram->mSubBucketCounts[(histogram->mSubBucketBlocks[bucket] - 1) * PercentileHistogram::SUB_BUCKET_COUNT];
+        for (uint32_t subBucket = 0; subBucket < PercentileHistogram::SUB_BUCKET_COUNT; ++subBucket) {
+            auto key = (bucket << 23) | (subBucket << shift);
+            if (subBucketCounts[subBucket] == 0 || key < firstKey) {
+                continue;
+            }
+            if (!found) {
+                lowKey = key;
+                found = true;
+            }
+            highKey = key | ((1u << shift) - 1);
+        }
+    }
+
+    if (found) {
+        *minValue = GetPercentileKeyValue(lowKey);
+        *maxValue = GetPercentileKeyValue(highKey);
+    }
+    return found;
+}
+
+// Get the bin that position x falls in, where bin i spans [i, i+1) and
+// positions outside of the bins fall in the first or last bin.
+inline uint32_t GetBinIndex(
+    float x,
+    uint32_t binCount)
+{
+    return x > 0.f ? std::min(binCount - 1, (uint32_t) std::min(x, (float) binCount)) : 0;
+}
+
+// Compute the fraction of a percentile histogram's values in each of
+// binCount bins spanning [minValue, maxValue].  Values outside of the range
+// are counted in the first or last bin.  Each sub-bucket's count is spread
+// over the bins it overlaps, as if its values were evenly distributed.  The
+// cost depends on the number of buckets used, not on the number of values.
+void GetPercentileHistogramBins(
+    MetricsGuiMetric::PercentileHistogram const* histogram,
+    float minValue,
+    float maxValue,
+    bool logBins,
+    uint32_t binCount,
+    float* binFractions)
+{
+    typedef MetricsGuiMetric::PercentileHistogram PercentileHistogram;
+
+    std::fill(binFractions, binFractions + binCount, 0.f);
+    if (histogram->mCount == 0) {
+        return;
+    }
+
+    auto lo = logBins ? logf(minValue) : minValue;
+    auto hi = logBins ? logf(maxValue) : maxValue;
+    auto scale = binCount / (hi - lo);
+    auto weight = 1.f / histogram->mCount;
+    auto shift = 23 - PercentileHistogram::SUB_BUCKET_BITS;
+    for (uint32_t bucket = 0; bucket < PercentileHistogram::BUCKET_COUNT; ++bucket) {
+        if (histogram->mBucketCounts[bucket] == 0) {
+            continue;
+        }
+        auto subBucketCounts = &histogram->mSubBucketCounts[(histogram->mSubBucketBlocks[bucket] - 1) * PercentileHistogram::SUB_BUCKET_COUNT];
+        for (uint32_t subBucket = 0; subBucket < PercentileHistogram::SUB_BUCKET_COUNT; ++subBucket) {
+            if (subBucketCounts[subBucket] == 0) {
+                continue;
+            }
+            auto key = (bucket << 23) | (subBucket << shift);
+            auto v0 = GetPercentileKeyValue(key);
+            auto v1 = GetPercentileKeyValue(key | ((1u << shift) - 1));
+            auto x0 = ((logBins ? (v0 > 0.f ? logf(v0) : -FLT_MAX) : v0) - lo) * scale;
+            auto x1 = ((logBins ? (v1 > 0.f ? logf(v1) : -FLT_MAX) : v1) - lo) * scale;
+            auto fraction = subBucketCounts[subBucket] * weight;
+            if (!(x1 - x0 > 0.f && x1 - x0 < FLT_MAX)) {
+                binFractions[GetBinIndex(x1, binCount)] += fraction;
+                continue;
+            }
+
+            auto density = fraction / (x1 - x0);
+            for (auto bin = GetBinIndex(x0, binCount), lastBin = GetBinIndex(x1, binCount); bin <= lastBin; ++bin) {
+                auto binX0 = bin == 0 ? x0 : std::max(x0, (float) bin);
+                auto binX1 = bin + 1 == binCount ? x1 : std::min(x1, (float) (bin + 1));
+                binFractions[bin] += (binX1 - binX0) * density;
+            }
+        }
+    }
+}
+
+void AppendHistoryValue(
+    MetricsGuiMetric* metric,
+    float value,
+    uint64_t timestamp)
+{
+    auto i = metric->mHistoryHead;
+    if (metric->mTimestamps != nullptr) {
+        metric->mTimestamps[i] = timestamp;
+    }
+    if (metric->mPercentileHistogram != nullptr) {
+        if (metric->mHistoryCount == metric->mHistorySize) {
+            AddPercentileValue(metric->mPercentileHistogram, metric->mHistory[i], -1);
+        }
+        AddPercentileValue(metric->mPercentileHistogram, value, 1);
+    }
+    metric->mTotalInHistory -= metric->mHistory[i];
+    metric->mHistory[i] = value;
+    metric->mTotalInHistory += value;
+    metric->mHistoryHead = i + 1 == metric->mHistorySize ? 0 : i + 1;
+    metric->mHistoryCount = std::min(metric->mHistorySize, metric->mHistoryCount + 1);
+    metric->mValueCount += 1;
+    UpdateRangeTree(GetHistoryTree(metric), metric->mHistory, metric->mHistorySize, i);
+}
+
+// Draw prefix, quantity, and units, reusing label's text and size if they
+// are unchanged.  prefix is cached by address, so it must not be changed in
+// place (e.g., it can be a string literal).
 void DrawQuantityLabel(
+    MetricsGuiPlot::QuantityLabel* label,
     float quantity,
+    MetricsGuiMetric::UnitInfo const& unitInfo,
     char const* units,
-    char const* prefix,
-    bool useSiUnitPrefix)
+    char const* prefix)
 {
-    char s[512] = {};
-    CreateQuantityLabel(s, _countof(s), quantity, units, prefix, useSiUnitPrefix);
-    ImGui::TextUnformatted(s);
+    auto window = ImGui::GetCurrentWindow();
+    if (window->SkipItems) {
+        return;
+    }
+
+    // Wrapped text depends on the cursor position, so it isn't cached
+    if (window->DC.TextWrapPos >= 0.f) {
+        char s[512] = {};
+        MetricsGuiCreateQuantityLabel(s, _countof(s), quantity, unitInfo, units, prefix);
+        ImGui::TextUnformatted(s);
+        return;
+    }
+
+    uint32_t quantityBits;
+    memcpy(&quantityBits, &quantity, sizeof(quantityBits));
+    if (!label->mFormatted ||
+        label->mQuantityBits != quantityBits ||
+        label->mUnitsId != unitInfo.mUnitsId ||
+        label->mPrefix != prefix) {
+        char s[512];
+        auto n = MetricsGuiCreateQuantityLabel(s, _countof(s), quantity, unitInfo, units, prefix);
+        n = std::min(n, (int) _countof(s) - 1);
+
+        // Many quantities display the same text, so only re-measure if the
+        // text changed.
+        if (!label->mFormatted || label->mText.compare(0, std::string::npos, s, n) != 0) {
+            label->mText.assign(s, n);
+            label->mFont = nullptr;
+        }
+        label->mPrefix = prefix;
+        label->mUnitsId = unitInfo.mUnitsId;
+        label->mQuantityBits = quantityBits;
+        label->mFormatted = true;
+    }
+
+    auto text = label->mText.c_str();
+    auto textEnd = text + label->mText.size();
+    auto font = ImGui::GetFont();
+    auto fontSize = ImGui::GetFontSize();
+    if (label->mFont != font || label->mFontSize != fontSize) {
+        auto size = ImGui::CalcTextSize(text, textEnd, false);
+        label->mFont = font;
+        label->mFontSize = fontSize;
+        label->mWidth = size.x;
+        label->mHeight = size.y;
+    }
+
+    // Same as ImGui::TextUnformatted(), but with the cached size
+    ImVec2 size(label->mWidth, label->mHeight);
+    ImVec2 pos(window->DC.CursorPos.x, window->DC.CursorPos.y + window->DC.CurrentLineTextBaseOffset);
+    ImRect bb(pos, pos + size);
+    ImGui::ItemSize(size);
+    if (!ImGui::ItemAdd(bb, NULL)) {
+        return;
+    }
+    ImGui::RenderTextWrapped(bb.Min, text, textEnd, 0.f);
 }
 
 } // anon namespace
 
 MetricsGuiMetric::MetricsGuiMetric()
+    : mHistorySize(0)
+    , mHistoryTreeSize(0)
+    , mModifyCount(0)
+    , mHistory(nullptr)
+    , mHistoryMinTree(nullptr)
+    , mHistoryMaxTree(nullptr)
+    , mHistorySumTree(nullptr)
+    , mTimestamps(nullptr)
+    , mPercentileHistogram(nullptr)
+    , mRegistryHistory(false)
 {
     auto c = ImColor::HSV(0.2f * gConstructedMetricIndex++, 0.8f, 0.8f);
     mColor[0] = c.Value.x;
@@ -151,73 +956,396 @@ MetricsGuiMetric::MetricsGuiMetric()
     mColor[2] = c.Value.z;
     mColor[3] = c.Value.w;
 
-    Initialize("", "", NONE);
+    Initialize("", "", NONE);
+}
+
+MetricsGuiMetric::MetricsGuiMetric(
+    char const* description,
+    char const* units,
+    uint32_t flags,
+    uint32_t historySize)
+    : mHistorySize(0)
+    , mHistoryTreeSize(0)
+    , mModifyCount(0)
+    , mHistory(nullptr)
+    , mHistoryMinTree(nullptr)
+    , mHistoryMaxTree(nullptr)
+    , mHistorySumTree(nullptr)
+    , mTimestamps(nullptr)
+    , mPercentileHistogram(nullptr)
+    , mRegistryHistory(false)
+{
+    auto c = ImColor::HSV(0.2f * gConstructedMetricIndex++, 0.8f, 0.8f);
+    mColor[0] = c.Value.x;
+    mColor[1] = c.Value.y;
+    mColor[2] = c.Value.z;
+    mColor[3] = c.Value.w;
+
+    Initialize(description, units, flags, historySize);
+}
+
+MetricsGuiMetric::MetricsGuiMetric(
+    char const* description,
+    char const* units,
+    uint32_t flags,
+    uint32_t historySize,
+    float* registryHistory,
+    float* registryTrees)
+    : mHistorySize(historySize)
+    , mHistoryTreeSize(GetRangeTreeSize(historySize))
+    , mModifyCount(0)
+    , mHistory(registryHistory)
+    , mHistoryMinTree(registryTrees)
+    , mHistoryMaxTree(mHistoryMinTree + 2 * mHistoryTreeSize)
+    , mHistorySumTree(mHistoryMinTree + 4 * mHistoryTreeSize)
+    , mTimestamps(nullptr)
+    , mPercentileHistogram(nullptr)
+    , mRegistryHistory(true)
+{
+    auto c = ImColor::HSV(0.2f * gConstructedMetricIndex++, 0.8f, 0.8f);
+    mColor[0] = c.Value.x;
+    mColor[1] = c.Value.y;
+    mColor[2] = c.Value.z;
+    mColor[3] = c.Value.w;
+
+    // The history is already the right size, so this doesn't reallocate it
+    Initialize(description, units, flags, historySize);
+}
+
+MetricsGuiMetric::MetricsGuiMetric(
+    MetricsGuiMetric const& copy)
+    : mHistorySize(0)
+    , mHistoryTreeSize(0)
+    , mModifyCount(0)
+    , mHistory(nullptr)
+    , mHistoryMinTree(nullptr)
+    , mHistoryMaxTree(nullptr)
+    , mHistorySumTree(nullptr)
+    , mTimestamps(nullptr)
+    , mPercentileHistogram(nullptr)
+    , mRegistryHistory(false)
+{
+    *this = copy;
+}
+
+MetricsGuiMetric::~MetricsGuiMetric()
+{
+    ResizeHistory(this, 0);
+    delete mPercentileHistogram;
+}
+
+MetricsGuiMetric::PercentileHistogram::PercentileHistogram()
+    : mSubBucketCounts()
+    , mCount(0)
+{
+    memset(mBucketCounts, 0, sizeof(mBucketCounts));
+    memset(mSubBucketBlocks, 0, sizeof(mSubBucketBlocks));
+}
+
+MetricsGuiMetric& MetricsGuiMetric::operator=(
+    MetricsGuiMetric const& copy)
+{
+    if (this == &copy) {
+        return *this;
+    }
+
+    ResizeHistory(this, copy.mHistorySize);
+    ResizeTimestamps(this, copy.mTimestamps != nullptr);
+
+    mDescription    = copy.mDescription;
+    mUnits          = copy.mUnits;
+    mUnitInfo       = copy.mUnitInfo;
+    mTotalInHistory = copy.mTotalInHistory;
+    mHistoryCount   = copy.mHistoryCount;
+    mHistoryHead    = copy.mHistoryHead;
+    mValueCount     = copy.mValueCount;
+    mModifyCount   += 1;
+    mColor[0]       = copy.mColor[0];
+    mColor[1]       = copy.mColor[1];
+    mColor[2]       = copy.mColor[2];
+    mColor[3]       = copy.mColor[3];
+    mKnownMinValue  = copy.mKnownMinValue;
+    mKnownMaxValue  = copy.mKnownMaxValue;
+    mFlags          = copy.mFlags;
+    mSelected       = copy.mSelected;
+    memcpy(mHistory, copy.mHistory, mHistorySize * sizeof(float));
+    memcpy(mHistoryMinTree, copy.mHistoryMinTree, 6 * mHistoryTreeSize * sizeof(float));
+    if (mTimestamps != nullptr) {
+        memcpy(mTimestamps, copy.mTimestamps, mHistorySize * sizeof(uint64_t));
+    }
+    if (copy.mPercentileHistogram == nullptr) {
+        delete mPercentileHistogram;
+        mPercentileHistogram = nullptr;
+    } else if (mPercentileHistogram == nullptr) {
+        mPercentileHistogram = new PercentileHistogram(*copy.mPercentileHistogram);
+    } else {
+        *mPercentileHistogram = *copy.mPercentileHistogram;
+    }
+    return *this;
+}
+
+void MetricsGuiMetric::Initialize(
+    char const* description,
+    char const* units,
+    uint32_t flags,
+    uint32_t historySize)
+{
+    assert(historySize > 0);
+    ResizeHistory(this, historySize);
+    ResizeTimestamps(this, (flags & RECORD_TIMESTAMPS) != 0);
+
+    mDescription = description == nullptr ? "" : description;
+    mUnits = units == nullptr ? "" : units;
+    mUnitInfo = ParseUnits(mUnits.c_str(), flags);
+    gLastUnitsId = gLastUnitsId == UINT32_MAX ? 1 : gLastUnitsId + 1;
+    mUnitInfo.mUnitsId = gLastUnitsId;
+    mTotalInHistory = 0.;
+    mHistoryCount = 0;
+    mHistoryHead = 0;
+    mValueCount = 0;
+    mModifyCount += 1;  // not reset, so that a refilled history doesn't look unchanged
+    memset(mHistory, 0, mHistorySize * sizeof(float));
+    if (mTimestamps != nullptr) {
+        memset(mTimestamps, 0, mHistorySize * sizeof(uint64_t));
+    }
+    BuildRangeTree(GetHistoryTree(this), mHistory, mHistorySize);
+    if ((flags & TRACK_PERCENTILES) == 0) {
+        delete mPercentileHistogram;
+        mPercentileHistogram = nullptr;
+    } else if (mPercentileHistogram == nullptr) {
+        mPercentileHistogram = new PercentileHistogram();
+    } else {
+        ClearPercentileHistogram(mPercentileHistogram);
+    }
+    mKnownMinValue = 0.f;
+    mKnownMaxValue = 0.f;
+    mFlags = flags;
+    mSelected = false;
+}
+
+void MetricsGuiMetric::RebuildHistoryStatistics()
+{
+    mTotalInHistory = MetricsGuiReduceSumDouble(mHistory, mHistorySize);
+    BuildRangeTree(GetHistoryTree(this), mHistory, mHistorySize);
+    if (mPercentileHistogram != nullptr) {
+        BuildPercentileHistogram(this);
+    }
+    mModifyCount += 1;
+}
+
+void MetricsGuiMetric::SetLastValue(
+    float value,
+    uint32_t prevIndex)
+{
+    assert(prevIndex < mHistorySize);
+    auto i = (uint32_t) GetHistoryIndex(this, mHistorySize - 1 - prevIndex);
+    if (mPercentileHistogram != nullptr && prevIndex < mHistoryCount) {
+        AddPercentileValue(mPercentileHistogram, mHistory[i], -1);
+        AddPercentileValue(mPercentileHistogram, value, 1);
+    }
+    mTotalInHistory -= mHistory[i];
+    mHistory[i] = value;
+    mTotalInHistory += value;
+    mModifyCount += 1;
+    UpdateRangeTree(GetHistoryTree(this), mHistory, mHistorySize, i);
+}
+
+void MetricsGuiMetric::AddNewValue(
+    float value)
+{
+    AppendHistoryValue(this, value, mTimestamps == nullptr ? 0 : GetPerfTimerCount());
+}
+
+void MetricsGuiMetric::AddNewValue(
+    float value,
+    uint64_t timestamp)
+{
+    AppendHistoryValue(this, value, timestamp);
+}
+
+void MetricsGuiMetric::AddNewValues(
+    float const* values,
+    uint32_t valueCount)
+{
+    mValueCount += valueCount;
+
+    // Only the most recent mHistorySize values are kept, but the head still
+    // advances past the skipped values.
+    if (valueCount > mHistorySize) {
+        auto skipCount = valueCount - mHistorySize;
+        mHistoryHead = (uint32_t) ((mHistoryHead + (uint64_t) skipCount) % mHistorySize);
+        values += skipCount;
+        valueCount = mHistorySize;
+    }
+
+    // If the whole history is replaced, none of the old values remain.
+    if (valueCount == mHistorySize) {
+        mHistoryCount = 0;
+        if (mPercentileHistogram != nullptr) {
+            ClearPercentileHistogram(mPercentileHistogram);
+        }
+    }
+
+    // Copy the values in at most two runs (before and after the buffer
+    // wraps), updating the total and range tree once per run.
+    auto tree = GetHistoryTree(this);
+    auto timestamp = mTimestamps == nullptr ? 0 : GetPerfTimerCount();
+    while (valueCount > 0) {
+        auto i = mHistoryHead;
+        auto n = std::min(valueCount, mHistorySize - i);
+        if (mPercentileHistogram != nullptr) {
+            // The first mHistorySize - mHistoryCount slots being written
+            // don't hold values yet.
+            for (auto j = std::min(n, mHistorySize - mHistoryCount); j < n; ++j) {
+                AddPercentileValue(mPercentileHistogram, mHistory[i + j], -1);
+            }
+            for (uint32_t j = 0; j < n; ++j) {
+                AddPercentileValue(mPercentileHistogram, values[j], 1);
+            }
+        }
+        mTotalInHistory -= MetricsGuiReduceSumDouble(mHistory + i, n);
+        memcpy(mHistory + i, values, n * sizeof(float));
+        if (mTimestamps != nullptr) {
+            std::fill(mTimestamps + i, mTimestamps + i + n, timestamp);
+        }
+        mTotalInHistory += MetricsGuiReduceSumDouble(mHistory + i, n);
+        UpdateRangeTree(tree, mHistory, mHistorySize, i, i + n);
+        mHistoryHead = i + n == mHistorySize ? 0 : i + n;
+        mHistoryCount = std::min(mHistorySize, mHistoryCount + n);
+        values += n;
+        valueCount -= n;
+    }
+}
+
+float MetricsGuiMetric::GetLastValue(
+    uint32_t prevIndex) const
+{
+    assert(prevIndex < mHistorySize);
+    return mHistory[GetHistoryIndex(this, mHistorySize - 1 - prevIndex)];
+}
+
+float MetricsGuiMetric::GetAverageValue() const
+{
+    return mHistoryCount == 0 ? 0.f : ((float) mTotalInHistory / mHistoryCount);
+}
+
+float MetricsGuiMetric::GetHistoryMinValue() const
+{
+    return mHistoryMinTree[1];
+}
+
+float MetricsGuiMetric::GetHistoryMaxValue() const
+{
+    return mHistoryMaxTree[1];
 }
 
-MetricsGuiMetric::MetricsGuiMetric(
-    char const* description,
-    char const* units,
-    uint32_t flags)
+float MetricsGuiMetric::GetPercentileValue(
+    float fraction) const
 {
-    auto c = ImColor::HSV(0.2f * gConstructedMetricIndex++, 0.8f, 0.8f);
-    mColor[0] = c.Value.x;
-    mColor[1] = c.Value.y;
-    mColor[2] = c.Value.z;
-    mColor[3] = c.Value.w;
+    auto histogram = mPercentileHistogram;
+    if (histogram == nullptr || histogram->mCount == 0) {
+        return 0.f;
+    }
+
+    // Find the sub-bucket holding the value of rank ceil(fraction * count)
+    // (the nearest-rank percentile), and estimate the value as the middle
+    // of the sub-bucket.
+    auto rank = (uint32_t) ceil((double) fraction * histogram->mCount);
+    rank = std::min(histogram->mCount, std::max(1u, rank));
+
+    uint32_t bucket = 0;
+    for (; rank > histogram->mBucketCounts[bucket]; ++bucket) {
+        rank -= histogram->mBucketCounts[bucket];
+    }
+    auto subBucketCounts = &histogram->mSubBucketCounts[(histogram->mSubBucketBlocks[bucket] - 1) * PercentileHistogram::SUB_BUCKET_COUNT];
+    uint32_t subBucket = 0;
+    for (; rank > subBucketCounts[subBucket]; ++subBucket) {
+        rank -= subBucketCounts[subBucket];
+    }
 
-    Initialize(description, units, flags);
+    auto shift = 23 - PercentileHistogram::SUB_BUCKET_BITS;
+    auto key = (bucket << 23) | (subBucket << shift);
+    auto low = GetPercentileKeyValue(key);
+    auto high = GetPercentileKeyValue(key | ((1u << shift) - 1));
+    // The sub-buckets either side of zero also hold denormals, but zero is
+    // far more likely than any of them.
+    auto value = low == 0.f || high == 0.f ? 0.f : 0.5f * (low + high);
+
+    // The history range is exact, e.g., if all of the values are the same.
+    return std::min(GetHistoryMaxValue(), std::max(GetHistoryMinValue(), value));
 }
 
-void MetricsGuiMetric::Initialize(
-    char const* description,
-    char const* units,
-    uint32_t flags)
+namespace {
+
+// Allocate bytes from the slab [*cursor, *end), starting a new slab if they
+// don't fit.
+float* AllocateRegistrySlabStorage(
+    std::vector<void*>* slabs,
+    uintptr_t* cursor,
+    uintptr_t* end,
+    uintptr_t bytes)
 {
-    mDescription = description == nullptr ? "" : description;
-    mUnits = units == nullptr ? "" : units;
-    mTotalInHistory = 0.;
-    mHistoryCount = 0;
-    memset(mHistory, 0, NUM_HISTORY_SAMPLES * sizeof(float));
-    mKnownMinValue = 0.f;
-    mKnownMaxValue = 0.f;
-    mFlags = flags;
-    mSelected = false;
+    auto alignment = (uintptr_t) MetricsGuiRegistry::HISTORY_ALIGNMENT;
+    bytes = (bytes + alignment - 1) & ~(alignment - 1);
+    if (*end - *cursor < bytes) {
+        auto slabBytes = std::max(bytes, (uintptr_t) MetricsGuiRegistry::HISTORY_SLAB_BYTES);
+        auto slab = malloc(slabBytes + alignment);
+        slabs->emplace_back(slab);
+        *cursor = ((uintptr_t) slab + alignment - 1) & ~(alignment - 1);
+        *end = *cursor + slabBytes;
+    }
+    auto storage = (float*) *cursor;
+    *cursor += bytes;
+    return storage;
 }
 
-void MetricsGuiMetric::SetLastValue(
-    float value,
-    uint32_t prevIndex)
-{
-    assert(prevIndex < NUM_HISTORY_SAMPLES);
-    auto p = &mHistory[NUM_HISTORY_SAMPLES - 1 - prevIndex];
-    mTotalInHistory -= *p;
-    *p = value;
-    mTotalInHistory += value;
 }
 
-void MetricsGuiMetric::AddNewValue(
-    float value)
+MetricsGuiRegistry::MetricsGuiRegistry()
+    : mMetricBlocks()
+    , mHistorySlabs()
+    , mHistorySlabCursor(0)
+    , mHistorySlabEnd(0)
+    , mTreeSlabCursor(0)
+    , mTreeSlabEnd(0)
+    , mMetricCount(0)
 {
-    mTotalInHistory -= mHistory[0];
-    memmove(
-        mHistory,
-        mHistory + 1,
-        (NUM_HISTORY_SAMPLES - 1) * sizeof(mHistory[0]));
-    mHistory[NUM_HISTORY_SAMPLES - 1] = value;
-    mTotalInHistory += value;
-    mHistoryCount = std::min((uint32_t) NUM_HISTORY_SAMPLES, mHistoryCount + 1);
 }
 
-float MetricsGuiMetric::GetLastValue(
-    uint32_t prevIndex) const
+MetricsGuiRegistry::~MetricsGuiRegistry()
 {
-    assert(prevIndex < NUM_HISTORY_SAMPLES);
-    return mHistory[NUM_HISTORY_SAMPLES - 1 - prevIndex];
+    for (uint32_t i = 0; i < mMetricCount; ++i) {
+        GetMetric(i)->~MetricsGuiMetric();
+    }
+    for (auto block : mMetricBlocks) {
+        free(block);
+    }
+    for (auto slab : mHistorySlabs) {
+        free(slab);
+    }
 }
 
-float MetricsGuiMetric::GetAverageValue() const
+MetricsGuiMetricHandle MetricsGuiRegistry::AddMetric(
+    char const* description,
+    char const* units,
+    uint32_t flags,
+    uint32_t historySize)
 {
-    return mHistoryCount == 0 ? 0.f : ((float) mTotalInHistory / mHistoryCount);
+    assert(historySize > 0);
+
+    // The histories and trees are allocated from separate slabs, so that
+    // the trees are packed together.
+    auto treeSize = GetRangeTreeSize(historySize);
+    auto history = AllocateRegistrySlabStorage(&mHistorySlabs, &mHistorySlabCursor, &mHistorySlabEnd, (uintptr_t) historySize * sizeof(float));
+    auto trees = AllocateRegistrySlabStorage(&mHistorySlabs, &mTreeSlabCursor, &mTreeSlabEnd, (uintptr_t) 6 * treeSize * sizeof(float));
+
+    auto handle = mMetricCount;
+    if (handle % METRIC_BLOCK_SIZE == 0) {
+        mMetricBlocks.emplace_back((MetricsGuiMetric*) malloc(METRIC_BLOCK_SIZE * sizeof(MetricsGuiMetric)));
+    }
+    new (&mMetricBlocks.back()[handle % METRIC_BLOCK_SIZE]) MetricsGuiMetric(description, units, flags, historySize, history, trees);
+    mMetricCount += 1;
+    return handle;
 }
 
 // Note: we defer computing the sizes because ImGui doesn't load the font until
@@ -244,11 +1372,12 @@ void MetricsGuiPlot::WidthInfo::Initialize()
     auto prefixWidth = ImGui::CalcTextSize("XXX").x;
     auto sepWidth    = ImGui::CalcTextSize(": ").x;
     auto valueWidth  = ImGui::CalcTextSize("888. X").x;
+    auto binaryWidth = ImGui::CalcTextSize("888. Xi").x;
     for (auto linkedPlot : mLinkedPlots) {
         for (auto metric : linkedPlot->mMetrics) {
             auto descWidth  = ImGui::CalcTextSize(metric->mDescription.c_str()).x;
             auto unitsWidth = ImGui::CalcTextSize(metric->mUnits.c_str()).x;
-            auto quantWidth = valueWidth + unitsWidth;
+            auto quantWidth = (metric->mUnitInfo.mBinaryPrefix ? binaryWidth : valueWidth) + unitsWidth;
 
             mDescWidth   = std::max(mDescWidth,   descWidth);
             mValueWidth  = std::max(mValueWidth,  quantWidth);
@@ -259,12 +1388,46 @@ void MetricsGuiPlot::WidthInfo::Initialize()
     mInitialized = true;
 }
 
+MetricsGuiPlot::StackedHistory::StackedHistory()
+    : mMetricState()
+    , mTotals()
+    , mMinTree()
+    , mMaxTree()
+    , mHead(0)
+    , mTreeSize(0)
+{
+}
+
+MetricsGuiPlot::QuantityLabel::QuantityLabel()
+    : mText()
+    , mPrefix(nullptr)
+    , mUnitsId(0)
+    , mFont(nullptr)
+    , mFontSize(0.f)
+    , mWidth(0.f)
+    , mHeight(0.f)
+    , mQuantityBits(0)
+    , mFormatted(false)
+{
+}
+
 MetricsGuiPlot::MetricsGuiPlot()
     : mMetrics()
     , mMetricRange()
+    , mMetricLabels()
+    , mLegendMaxLabel()
+    , mLegendMinLabel()
+    , mDistributionMaxLabel()
+    , mDistributionMinLabel()
+    , mStackedHistory()
+    , mDrawScratch()
     , mWidthInfo(new MetricsGuiPlot::WidthInfo(this))
     , mMinValue(0.f)
     , mMaxValue(0.f)
+    , mTimeAxisBegin(0)
+    , mTimeAxisEnd(0)
+    , mListRowHeight(0.f)
+    , mListInlineRowHeight(0.f)
     , mRangeInitialized(false)
     , mBarRounding(0.f)
     , mRangeDampening(0.95f)
@@ -272,6 +1435,12 @@ MetricsGuiPlot::MetricsGuiPlot()
     , mPlotRowCount(5)
     , mVBarMinWidth(6)
     , mVBarGapWidth(1)
+    , mShowPercentiles(0)
+    , mShowLegendPercentiles(0)
+    , mDistributionBinCount(32)
+    , mDistributionMinValue(0.f)
+    , mDistributionMaxValue(0.f)
+    , mTimeWindow(0.f)
     , mShowAverage(false)
     , mShowInlineGraphs(false)
     , mShowOnlyIfSelected(false)
@@ -285,6 +1454,8 @@ MetricsGuiPlot::MetricsGuiPlot()
     , mStacked(false)
     , mSharedAxis(false)
     , mFilterHistory(true)
+    , mShowFilteredRange(false)
+    , mDistributionLogBins(false)
 {
 }
 
@@ -292,9 +1463,20 @@ MetricsGuiPlot::MetricsGuiPlot(
     MetricsGuiPlot const& copy)
     : mMetrics(copy.mMetrics)
     , mMetricRange(copy.mMetricRange)
+    , mMetricLabels()
+    , mLegendMaxLabel()
+    , mLegendMinLabel()
+    , mDistributionMaxLabel()
+    , mDistributionMinLabel()
+    , mStackedHistory(copy.mStackedHistory)
+    , mDrawScratch()
     , mWidthInfo(copy.mWidthInfo)
     , mMinValue(copy.mMinValue)
     , mMaxValue(copy.mMaxValue)
+    , mTimeAxisBegin(copy.mTimeAxisBegin)
+    , mTimeAxisEnd(copy.mTimeAxisEnd)
+    , mListRowHeight(copy.mListRowHeight)
+    , mListInlineRowHeight(copy.mListInlineRowHeight)
     , mRangeInitialized(copy.mRangeInitialized)
     , mBarRounding(copy.mBarRounding)
     , mRangeDampening(copy.mRangeDampening)
@@ -302,6 +1484,12 @@ MetricsGuiPlot::MetricsGuiPlot(
     , mPlotRowCount(copy.mPlotRowCount)
     , mVBarMinWidth(copy.mVBarMinWidth)
     , mVBarGapWidth(copy.mVBarGapWidth)
+    , mShowPercentiles(copy.mShowPercentiles)
+    , mShowLegendPercentiles(copy.mShowLegendPercentiles)
+    , mDistributionBinCount(copy.mDistributionBinCount)
+    , mDistributionMinValue(copy.mDistributionMinValue)
+    , mDistributionMaxValue(copy.mDistributionMaxValue)
+    , mTimeWindow(copy.mTimeWindow)
     , mShowAverage(copy.mShowAverage)
     , mShowInlineGraphs(copy.mShowInlineGraphs)
     , mShowOnlyIfSelected(copy.mShowOnlyIfSelected)
@@ -315,6 +1503,8 @@ MetricsGuiPlot::MetricsGuiPlot(
     , mStacked(copy.mStacked)
     , mSharedAxis(copy.mSharedAxis)
     , mFilterHistory(copy.mFilterHistory)
+    , mShowFilteredRange(copy.mShowFilteredRange)
+    , mDistributionLogBins(copy.mDistributionLogBins)
 {
     mWidthInfo->mLinkedPlots.emplace_back(this);
 }
@@ -359,6 +1549,170 @@ void MetricsGuiPlot::LinkLegends(
     delete otherWidthInfo;
 }
 
+namespace {
+
+// Whether metrics are plotted against time, rather than aligned by their
+// most recent value.
+bool UseTimeAxis(
+    MetricsGuiPlot const* plot,
+    std::vector<MetricsGuiMetric*> const& metrics)
+{
+    if (!(plot->mTimeWindow > 0.f) || metrics.empty()) {
+        return false;
+    }
+    for (auto metric : metrics) {
+        if (metric->mTimestamps == nullptr) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Accumulate the range of the values that a metric shows in the plot's time
+// window: the values in the window, and the value before the window (which
+// is shown until the first value in the window) or zero if there is none.
+void QueryTimeAxisRange(
+    MetricsGuiPlot const* plot,
+    MetricsGuiMetric const* metric,
+    ValueRange* range)
+{
+    auto first = metric->mHistorySize - metric->mHistoryCount;
+    auto begin = FindHistoryTime(metric, plot->mTimeAxisBegin, first);
+    if (begin > first) {
+        begin -= 1;
+    } else {
+        range->Add(0.f, 0.f, 0.f);
+    }
+    if (begin < metric->mHistorySize) {
+        QueryHistoryRange(metric, begin, metric->mHistorySize, range);
+    }
+}
+
+// Sum the metric values at history position index, where position
+// historySize-1 holds the most recent value of every metric.
+float GetStackedValue(
+    std::vector<MetricsGuiMetric*> const& metrics,
+    uint32_t historySize,
+    uint32_t index)
+{
+    float stackedValue = 0.f;
+    for (auto metric : metrics) {
+        auto offset = historySize - metric->mHistorySize;
+        if (index >= offset) {
+            stackedValue += metric->mHistory[GetHistoryIndex(metric, index - offset)];
+        }
+    }
+    return stackedValue;
+}
+
+RangeTree GetStackedTree(
+    MetricsGuiPlot::StackedHistory* stacked)
+{
+    RangeTree tree;
+    tree.mMin  = stacked->mMinTree.data();
+    tree.mMax  = stacked->mMaxTree.data();
+    tree.mSum  = nullptr;
+    tree.mSize = stacked->mTreeSize;
+    return tree;
+}
+
+void SetStackedValue(
+    MetricsGuiPlot::StackedHistory* stacked,
+    std::vector<MetricsGuiMetric*> const& metrics,
+    uint32_t index)
+{
+    auto historySize = (uint32_t) stacked->mTotals.size();
+    auto i = stacked->mHead + index;
+    i = i < historySize ? i : (i - historySize);
+    stacked->mTotals[i] = GetStackedValue(metrics, historySize, index);
+    UpdateRangeTree(GetStackedTree(stacked), stacked->mTotals.data(), historySize, i);
+}
+
+// Bring the stacked totals up to date with the plot's metrics.  In the
+// common case, where every metric has had the same number of values added
+// since the last update, only the totals at the newest positions need to be
+// computed.  Otherwise (e.g., the metrics changed or a history was modified)
+// the totals are rebuilt from scratch.
+void UpdateStackedHistory(
+    MetricsGuiPlot* plot)
+{
+    auto const& metrics = plot->mMetrics;
+    auto stacked = &plot->mStackedHistory;
+    auto historySize = GetMaxHistorySize(metrics);
+    auto metricCount = metrics.size();
+
+    auto rebuild =
+        stacked->mTotals.size() != historySize ||
+        stacked->mMetricState.size() != metricCount;
+    uint64_t addCount = 0;
+    for (size_t i = 0; i < metricCount && !rebuild; ++i) {
+        auto metric = metrics[i];
+        auto const& state = stacked->mMetricState[i];
+        auto metricAddCount = metric->mValueCount - state.mValueCount;
+        rebuild =
+            state.mMetric != metric ||
+            state.mModifyCount != metric->mModifyCount ||
+            metric->mValueCount < state.mValueCount ||
+            (i > 0 && metricAddCount != addCount);
+        addCount = metricAddCount;
+    }
+    rebuild = rebuild || addCount >= historySize;
+
+    stacked->mMetricState.resize(metricCount);
+    for (size_t i = 0; i < metricCount; ++i) {
+        auto metric = metrics[i];
+        auto state = &stacked->mMetricState[i];
+        state->mMetric      = metric;
+        state->mValueCount  = metric->mValueCount;
+        state->mModifyCount = metric->mModifyCount;
+    }
+
+    if (rebuild) {
+        stacked->mTotals.resize(historySize);
+        stacked->mTreeSize = GetRangeTreeSize(historySize);
+        stacked->mMinTree.resize(2 * stacked->mTreeSize);
+        stacked->mMaxTree.resize(2 * stacked->mTreeSize);
+        stacked->mHead = 0;
+        // Sum each metric's history into the totals, in two parts since
+        // each history is a circular buffer.
+        auto totals = stacked->mTotals.data();
+        std::fill(totals, totals + historySize, 0.f);
+        for (auto metric : metrics) {
+            auto metricTotals = totals + (historySize - metric->mHistorySize);
+            auto oldCount = metric->mHistorySize - metric->mHistoryHead;
+            MetricsGuiAccumulate(metricTotals, metric->mHistory + metric->mHistoryHead, oldCount);
+            MetricsGuiAccumulate(metricTotals + oldCount, metric->mHistory, metric->mHistoryHead);
+        }
+        BuildRangeTree(GetStackedTree(stacked), totals, historySize);
+        return;
+    }
+
+    if (addCount == 0) {
+        return;
+    }
+
+    // Advance the circular buffer, so the oldest totals become the newest
+    // positions, and compute them.
+    auto newCount = (uint32_t) addCount;
+    stacked->mHead += newCount;
+    stacked->mHead = stacked->mHead < historySize ? stacked->mHead : (stacked->mHead - historySize);
+    for (uint32_t i = historySize - newCount; i < historySize; ++i) {
+        SetStackedValue(stacked, metrics, i);
+    }
+
+    // Values leaving shorter histories also change the totals at the
+    // positions just older than those histories.
+    for (auto metric : metrics) {
+        auto end = historySize - metric->mHistorySize;
+        auto begin = end - std::min(end, newCount);
+        for (auto i = begin; i < end; ++i) {
+            SetStackedValue(stacked, metrics, i);
+        }
+    }
+}
+
+}
+
 void MetricsGuiPlot::UpdateAxes()
 {
     float oldWeight;
@@ -370,35 +1724,57 @@ void MetricsGuiPlot::UpdateAxes()
     }
     auto newWeight = 1.f - oldWeight;
 
+    // The time axis ends at the newest value of any metric.
+    auto timeAxis = UseTimeAxis(this, mMetrics);
+    if (timeAxis) {
+        uint64_t timeAxisEnd = 0;
+        for (auto metric : mMetrics) {
+            if (metric->mHistoryCount > 0) {
+                timeAxisEnd = std::max(timeAxisEnd, metric->mTimestamps[GetHistoryIndex(metric, metric->mHistorySize - 1)]);
+            }
+        }
+        auto f = GetPerfTimerFrequency();
+        auto timeWindow = (uint64_t) (mTimeWindow * (double) f.Numerator / (double) f.Denominator);
+        mTimeAxisBegin = timeAxisEnd > timeWindow ? (timeAxisEnd - timeWindow) : 0;
+        mTimeAxisEnd = timeAxisEnd;
+    }
+
     float minPlotValue = FLT_MAX;
     float maxPlotValue = FLT_MIN;
+    float stackedMaxValue = 0.f;
     for (size_t i = 0, N = mMetrics.size(); i < N; ++i) {
         auto metric = mMetrics[i];
         auto metricRange = &mMetricRange[i];
 
         auto knownMinValue = 0 != (metric->mFlags & MetricsGuiMetric::KNOWN_MIN_VALUE);
         auto knownMaxValue = 0 != (metric->mFlags & MetricsGuiMetric::KNOWN_MAX_VALUE);
+        ValueRange timeRange;
+        if (timeAxis && !(knownMinValue && knownMaxValue)) {
+            QueryTimeAxisRange(this, metric, &timeRange);
+        }
         auto historyRange = std::make_pair(
-            knownMinValue ? &metric->mKnownMinValue : std::min_element(metric->mHistory, metric->mHistory + MetricsGuiMetric::NUM_HISTORY_SAMPLES),
-            knownMaxValue ? &metric->mKnownMaxValue : std::max_element(metric->mHistory, metric->mHistory + MetricsGuiMetric::NUM_HISTORY_SAMPLES));
-        metricRange->first  = metricRange->first  * oldWeight + *historyRange.first  * newWeight;
-        metricRange->second = metricRange->second * oldWeight + *historyRange.second * newWeight;
-
-        minPlotValue = std::min(minPlotValue, *historyRange.first);
-        maxPlotValue = std::max(maxPlotValue, *historyRange.second);
+            knownMinValue ? metric->mKnownMinValue : timeAxis ? timeRange.mMin : metric->GetHistoryMinValue(),
+            knownMaxValue ? metric->mKnownMaxValue : timeAxis ? timeRange.mMax : metric->GetHistoryMaxValue());
+        metricRange->first  = metricRange->first  * oldWeight + historyRange.first  * newWeight;
+        metricRange->second = metricRange->second * oldWeight + historyRange.second * newWeight;
+
+        minPlotValue = std::min(minPlotValue, historyRange.first);
+        maxPlotValue = std::max(maxPlotValue, historyRange.second);
+        stackedMaxValue += historyRange.second;
     }
 
     if (mSharedAxis) {
         minPlotValue = mMetricRange[0].first;
         maxPlotValue = mMetricRange[0].second;
+    } else if (mStacked && timeAxis) {
+        // The stacked totals are kept by history position, which doesn't
+        // correspond to time, so bound them by the sum of the maximums.
+        maxPlotValue = stackedMaxValue;
     } else if (mStacked) {
+        UpdateStackedHistory(this);
         maxPlotValue = FLT_MIN;
-        for (size_t i = 0; i < MetricsGuiMetric::NUM_HISTORY_SAMPLES; ++i) {
-            float stackedValue = 0.f;
-            for (auto metric : mMetrics) {
-                stackedValue += metric->mHistory[i];
-            }
-            maxPlotValue = std::max(maxPlotValue, stackedValue);
+        if (!mStackedHistory.mTotals.empty()) {
+            maxPlotValue = std::max(maxPlotValue, mStackedHistory.mMaxTree[1]);
         }
     }
 
@@ -446,9 +1822,120 @@ bool DrawPrefix(
     return true;
 }
 
+// Draw rectCount filled rects, where rect i has corners corners[2i] and
+// corners[2i+1].  Unrounded rects are emitted with a single PrimReserve()
+// rather than one AddRectFilled() call each.
+void AddRectsFilled(
+    ImDrawList* drawList,
+    ImVec2 const* corners,
+    size_t rectCount,
+    ImU32 color,
+    float rounding)
+{
+    if ((color & IM_COL32_A_MASK) == 0 || rectCount == 0) {
+        return;
+    }
+
+    if (rounding > 0.f) {
+        for (size_t i = 0; i < rectCount; ++i) {
+            drawList->AddRectFilled(corners[2 * i], corners[2 * i + 1], color, rounding);
+        }
+        return;
+    }
+
+    drawList->PrimReserve((int) (6 * rectCount), (int) (4 * rectCount));
+    for (size_t i = 0; i < rectCount; ++i) {
+        drawList->PrimRect(corners[2 * i], corners[2 * i + 1], color);
+    }
+}
+
+// Fill the area between the y coordinates ranges[i].x and ranges[i].y
+// along points[i].x, as a single strip of quads.
+void AddBandFilled(
+    ImDrawList* drawList,
+    ImVec2 const* points,
+    ImVec2 const* ranges,
+    size_t pointCount,
+    ImU32 color)
+{
+    if ((color & IM_COL32_A_MASK) == 0 || pointCount < 2) {
+        return;
+    }
+
+    auto uv = GImGui->FontTexUvWhitePixel;
+    drawList->PrimReserve((int) (6 * (pointCount - 1)), (int) (2 * pointCount));
+    for (size_t i = 0; i < pointCount; ++i) {
+        if (i > 0) {
+            auto idx = (ImDrawIdx) drawList->_VtxCurrentIdx;
+            drawList->PrimWriteIdx((ImDrawIdx) (idx - 2));
+            drawList->PrimWriteIdx((ImDrawIdx) (idx));
+            drawList->PrimWriteIdx((ImDrawIdx) (idx + 1));
+            drawList->PrimWriteIdx((ImDrawIdx) (idx - 2));
+            drawList->PrimWriteIdx((ImDrawIdx) (idx + 1));
+            drawList->PrimWriteIdx((ImDrawIdx) (idx - 1));
+        }
+        drawList->PrimWriteVtx(ImVec2(points[i].x, ranges[i].x), uv, color);
+        drawList->PrimWriteVtx(ImVec2(points[i].x, ranges[i].y), uv, color);
+    }
+}
+
+// Draw a line through all points with a single AddPolyline() call, using
+// the same pixel-center offset as AddLine().
+void AddPolyline(
+    ImDrawList* drawList,
+    ImVec2* points,
+    size_t pointCount,
+    ImU32 color)
+{
+    for (size_t i = 0; i < pointCount; ++i) {
+        points[i] = points[i] + ImVec2(0.5f, 0.5f);
+    }
+    drawList->AddPolyline(points, (int) pointCount, color, false, 1.f, GImGui->Style.AntiAliasedLines);
+}
+
+// Percentiles in the order they are listed in legends, which is also the
+// order of LegendLabels::mPercentiles.
+struct PercentileInfo {
+    uint32_t mFlag;
+    float mFraction;
+    char const* mLegendPrefix;
+};
+
+PercentileInfo const PERCENTILES[] = {
+    { MetricsGuiPlot::PERCENTILE_99, 0.99f, "P99: " },
+    { MetricsGuiPlot::PERCENTILE_95, 0.95f, "P95: " },
+    { MetricsGuiPlot::PERCENTILE_50, 0.50f, "P50: " },
+};
+static_assert(_countof(PERCENTILES) == MetricsGuiPlot::PERCENTILE_COUNT, "PERCENTILES doesn't match PERCENTILE_COUNT");
+
+// Draw the legend labels of the metric's percentiles that are selected by
+// plot->mShowLegendPercentiles.
+void DrawLegendPercentiles(
+    MetricsGuiPlot const* plot,
+    MetricsGuiMetric const* metric,
+    MetricsGuiPlot::LegendLabels* labels,
+    MetricsGuiMetric::UnitInfo const& unitInfo,
+    char const* units)
+{
+    if (metric->mPercentileHistogram == nullptr) {
+        return;
+    }
+    for (uint32_t i = 0; i < MetricsGuiPlot::PERCENTILE_COUNT; ++i) {
+        auto const& percentile = PERCENTILES[i];
+        if ((plot->mShowLegendPercentiles & percentile.mFlag) != 0) {
+            auto percentileValue = metric->GetPercentileValue(percentile.mFraction);
+            DrawQuantityLabel(&labels->mPercentiles[i], percentileValue, unitInfo, units, percentile.mLegendPrefix);
+        }
+    }
+}
+
+// legendLabels[i] holds the legend labels of metrics[i].
 void DrawMetrics(
     MetricsGuiPlot* plot,
     std::vector<MetricsGuiMetric*> const& metrics,
+    MetricsGuiPlot::QuantityLabel* maxLabel,
+    MetricsGuiPlot::QuantityLabel* minLabel,
+    MetricsGuiPlot::LegendLabels* const* legendLabels,
     uint32_t plotRowCount,
     float plotMinValue,
     float plotMaxValue)
@@ -473,23 +1960,30 @@ void DrawMetrics(
         frame_bb.Max - style.FramePadding);
 
     ImGui::ItemSize(frame_bb, style.FramePadding.y);
-    if (!ImGui::ItemAdd(frame_bb, NULL)) {
-        return;
+    // The legend is laid out even if the plot is clipped, so that the
+    // height of the plot doesn't depend on whether it is visible.
+    auto visible = ImGui::ItemAdd(frame_bb, NULL);
+    if (visible) {
+        ImGui::RenderFrame(frame_bb.Min, frame_bb.Max, ImGui::GetColorU32(ImGuiCol_FrameBg), true, style.FrameRounding);
     }
 
-    ImGui::RenderFrame(frame_bb.Min, frame_bb.Max, ImGui::GetColorU32(ImGuiCol_FrameBg), true, style.FrameRounding);
-
     plotWidth = inner_bb.GetWidth();
     plotHeight = inner_bb.GetHeight();
 
-    size_t pointCount = MetricsGuiMetric::NUM_HISTORY_SAMPLES;
+    // Series are aligned by their most recent value, with the plot spanning
+    // the longest history.  On a time axis, each plot point instead
+    // represents an equal span of the plot's time window.
+    size_t historySize = GetMaxHistorySize(metrics);
+    size_t pointCount = historySize;
     size_t maxBarCount = (size_t) (plotWidth / (plot->mVBarMinWidth + plot->mVBarGapWidth));
+    auto timeAxis = plot->mTimeAxisEnd > plot->mTimeAxisBegin && UseTimeAxis(plot, metrics);
+    auto timeSpan = (double) (plot->mTimeAxisEnd - plot->mTimeAxisBegin);
 
     if (plotMaxValue == plotMinValue) {
         pointCount = 0;
     }
 
-    bool useFilterPath = plot->mFilterHistory || (maxBarCount > pointCount);
+    bool useFilterPath = timeAxis || plot->mFilterHistory || (maxBarCount > pointCount);
     if (!useFilterPath) {
         pointCount = maxBarCount;
     } else if (plot->mBarGraph) {
@@ -497,70 +1991,120 @@ void DrawMetrics(
     } else {
         pointCount = std::min(pointCount, (size_t) (plotWidth));
     }
-    if (pointCount > 0) {
-        std::vector<float> baseValue(pointCount, 0.f);
+    if (visible && pointCount > 0) {
+        // Each series' points are computed into scratch buffers and then
+        // emitted with as few draw list calls as possible.  For line plots,
+        // points[i] is the position of point i and ranges[i] holds the y
+        // coordinates of its max and min.  For bar graphs, points[2i] and
+        // points[2i+1] are the corners of bar i and ranges[2i] and
+        // ranges[2i+1] are the corners of its min/max range.
+        auto scratch = &plot->mDrawScratch;
+        scratch->mBaseValues.assign(pointCount, 0.f);
+        scratch->mPoints.resize(2 * (plot->mBarGraph ? 2 * pointCount : pointCount));
+        scratch->mRanges.resize(2 * (plot->mBarGraph ? 2 * pointCount : pointCount));
+        auto baseValue = scratch->mBaseValues.data();
+        auto points = (ImVec2*) scratch->mPoints.data();
+        auto ranges = (ImVec2*) scratch->mRanges.data();
         auto hScale = plotWidth / (float) (plot->mBarGraph ? pointCount : (pointCount - 1));
         auto vScale = plotHeight / (plotMaxValue - plotMinValue);
+        auto showRange = plot->mShowFilteredRange && useFilterPath && !plot->mStacked && pointCount < historySize;
         for (auto metric : metrics) {
             if (plot->mShowOnlyIfSelected && !metric->mSelected) {
                 continue;
             }
 
             auto color = ImGui::ColorConvertFloat4ToU32(*(ImVec4*) &metric->mColor);
+            auto rangeColor = (color & ~IM_COL32_A_MASK) | (((color >> 2) & IM_COL32_A_MASK));
 
+            // Plot positions before historyOffset are older than this
+            // metric's history, and are treated as zero.
+            size_t historyOffset = historySize - metric->mHistorySize;
             size_t historyBeginIdx = useFilterPath
                 ? 0
-                : (MetricsGuiMetric::NUM_HISTORY_SAMPLES - pointCount);
-            ImVec2 p;
-            float prevB = 0.f;
+                : (historySize - pointCount);
+
+            // On a time axis, a point with no values shows the value before
+            // it, or zero if that is older than the history.
+            uint32_t timeFirstIdx = 0;
+            uint32_t timeBeginIdx = 0;
+            if (timeAxis) {
+                timeFirstIdx = metric->mHistorySize - metric->mHistoryCount;
+                timeBeginIdx = FindHistoryTime(metric, plot->mTimeAxisBegin, timeFirstIdx);
+            }
             for (size_t i = 0; i < pointCount; ++i) {
-                size_t historyEndIdx = useFilterPath
-                    ? ((i + 1) * MetricsGuiMetric::NUM_HISTORY_SAMPLES / pointCount)
-                    : (historyBeginIdx + 1);
-                size_t N = historyEndIdx - historyBeginIdx;
                 float v = 0.f;
-                if (N > 0) {
-                    do {
-                        v += metric->mHistory[historyBeginIdx];
-                        ++historyBeginIdx;
-                    } while (historyBeginIdx < historyEndIdx);
-                    v = v / (float) N;
+                ValueRange range;
+                if (timeAxis) {
+                    auto timeEnd = i + 1 < pointCount
+                        ? (plot->mTimeAxisBegin + (uint64_t) (timeSpan * (i + 1) / pointCount))
+                        : (plot->mTimeAxisEnd + 1);
+                    auto timeEndIdx = FindHistoryTime(metric, timeEnd, timeBeginIdx);
+                    if (timeEndIdx - timeBeginIdx > 1) {
+                        QueryHistoryRange(metric, timeBeginIdx, timeEndIdx, &range);
+                        v = range.mSum / (float) (timeEndIdx - timeBeginIdx);
+                    } else {
+                        auto idx = timeEndIdx > timeBeginIdx ? timeBeginIdx : (timeBeginIdx - 1);
+                        v = timeEndIdx > timeFirstIdx ? metric->mHistory[GetHistoryIndex(metric, idx)] : 0.f;
+                        range.Add(v, v, v);
+                    }
+                    timeBeginIdx = timeEndIdx;
+                } else {
+                    size_t historyEndIdx = useFilterPath
+                        ? ((i + 1) * historySize / pointCount)
+                        : (historyBeginIdx + 1);
+                    size_t N = historyEndIdx - historyBeginIdx;
+                    if (N > 0) {
+                        if (historyBeginIdx < historyOffset) {
+                            range.Add(0.f, 0.f, 0.f);
+                            historyBeginIdx = std::min(historyEndIdx, historyOffset);
+                        }
+                        if (historyBeginIdx == historyEndIdx) {
+                        } else if (historyEndIdx - historyBeginIdx == 1) {
+                            auto value = metric->mHistory[GetHistoryIndex(metric, historyBeginIdx - historyOffset)];
+                            range.Add(value, value, value);
+                        } else {
+                            QueryHistoryRange(metric, (uint32_t) (historyBeginIdx - historyOffset), (uint32_t) (historyEndIdx - historyOffset), &range);
+                        }
+                        historyBeginIdx = historyEndIdx;
+                        v = range.mSum / (float) N;
+                    }
                 }
                 float b = baseValue[i];
                 v += b;
 
-                ImVec2 pn(
-                    inner_bb.Min.x + hScale * i,
-                    inner_bb.Max.y - vScale * (v - plotMinValue));
-
-                if (i > 0) {
-                    if (plot->mBarGraph) {
-                        ImVec2 p1(
-                            pn.x - plot->mVBarGapWidth,
-                            inner_bb.Max.y - vScale * (prevB - plotMinValue));
-                        p  = ImClamp(p,  inner_bb.Min, inner_bb.Max);
-                        p1 = ImClamp(p1, inner_bb.Min, inner_bb.Max);
-                        window->DrawList->AddRectFilled(p, p1, color, plot->mBarRounding);
-                    } else {
-                        pn = ImClamp(pn, inner_bb.Min, inner_bb.Max);
-                        window->DrawList->AddLine(p, pn, color);
-                    }
+                auto x = inner_bb.Min.x + hScale * i;
+                auto y = inner_bb.Max.y - vScale * (v - plotMinValue);
+                auto maxY = inner_bb.Max.y - vScale * (range.mMax - plotMinValue);
+                auto minY = inner_bb.Max.y - vScale * (range.mMin - plotMinValue);
+                if (plot->mBarGraph) {
+                    auto x1 = (i + 1 < pointCount ? (inner_bb.Min.x + hScale * (i + 1)) : inner_bb.Max.x) - plot->mVBarGapWidth;
+                    auto y1 = inner_bb.Max.y - vScale * (b - plotMinValue);
+                    points[2 * i]     = ImClamp(ImVec2(x,  y),    inner_bb.Min, inner_bb.Max);
+                    points[2 * i + 1] = ImClamp(ImVec2(x1, y1),   inner_bb.Min, inner_bb.Max);
+                    ranges[2 * i]     = ImClamp(ImVec2(x,  maxY), inner_bb.Min, inner_bb.Max);
+                    ranges[2 * i + 1] = ImClamp(ImVec2(x1, minY), inner_bb.Min, inner_bb.Max);
+                } else {
+                    points[i] = ImClamp(ImVec2(x, y), inner_bb.Min, inner_bb.Max);
+                    ranges[i] = ImVec2(
+                        ImClamp(maxY, inner_bb.Min.y, inner_bb.Max.y),
+                        ImClamp(minY, inner_bb.Min.y, inner_bb.Max.y));
                 }
 
-                p = pn;
-                prevB = b;
                 if (plot->mStacked) {
                     baseValue[i] = v;
                 }
             }
 
             if (plot->mBarGraph) {
-                ImVec2 p1(
-                    inner_bb.Max.x - plot->mVBarGapWidth,
-                    inner_bb.Max.y - vScale * (prevB - plotMinValue));
-                p  = ImClamp(p,  inner_bb.Min, inner_bb.Max);
-                p1 = ImClamp(p1, inner_bb.Min, inner_bb.Max);
-                window->DrawList->AddRectFilled(p, p1, color, plot->mBarRounding);
+                if (showRange) {
+                    AddRectsFilled(window->DrawList, ranges, pointCount, rangeColor, plot->mBarRounding);
+                }
+                AddRectsFilled(window->DrawList, points, pointCount, color, plot->mBarRounding);
+            } else {
+                if (showRange) {
+                    AddBandFilled(window->DrawList, points, ranges, pointCount, rangeColor);
+                }
+                AddPolyline(window->DrawList, points, pointCount, color);
             }
 
             if (plot->mShowAverage) {
@@ -572,15 +2116,30 @@ void DrawMetrics(
                     ImVec2(inner_bb.Max.x, y),
                     color);
             }
+
+            if (plot->mShowPercentiles != 0 && metric->mPercentileHistogram != nullptr) {
+                auto percentileColor = (color & ~IM_COL32_A_MASK) | (((color >> 1) & IM_COL32_A_MASK));
+                for (auto const& percentile : PERCENTILES) {
+                    if ((plot->mShowPercentiles & percentile.mFlag) != 0) {
+                        auto percentileValue = metric->GetPercentileValue(percentile.mFraction);
+                        auto y = inner_bb.Max.y - vScale * (percentileValue - plotMinValue);
+                        y = ImClamp(y, inner_bb.Min.y, inner_bb.Max.y);
+                        window->DrawList->AddLine(
+                            ImVec2(inner_bb.Min.x, y),
+                            ImVec2(inner_bb.Max.x, y),
+                            percentileColor);
+                    }
+                }
+            }
         }
     }
 
     ImGui::SameLine();
 
-    auto useSiUnitPrefix = false;
+    auto unitInfo = &NO_UNIT_INFO;
     auto units = "";
     if (plot->mShowLegendUnits) {
-        useSiUnitPrefix = (metrics[0]->mFlags & MetricsGuiMetric::USE_SI_UNIT_PREFIX) != 0;
+        unitInfo = &metrics[0]->mUnitInfo;
         units = metrics[0]->mUnits.c_str();
     }
 
@@ -605,16 +2164,15 @@ void DrawMetrics(
             ImGui::TextUnformatted(metrics[0]->mDescription.c_str());
         }
         if (plot->mShowLegendMax) {
-            DrawQuantityLabel(plotMaxValue, units, "Max: ", useSiUnitPrefix);
+            DrawQuantityLabel(maxLabel, plotMaxValue, *unitInfo, units, "Max: ");
         }
+        DrawLegendPercentiles(plot, metrics[0], legendLabels[0], *unitInfo, units);
         if (plot->mShowLegendAverage) {
-            for (auto metric : metrics) {
-                auto plotAvgValue = metric->GetAverageValue();
-                DrawQuantityLabel(plotAvgValue, units, "Avg: ", useSiUnitPrefix);
-            }
+            auto plotAvgValue = metrics[0]->GetAverageValue();
+            DrawQuantityLabel(&legendLabels[0]->mAvg, plotAvgValue, *unitInfo, units, "Avg: ");
         }
         if (plot->mShowLegendMin) {
-            DrawQuantityLabel(plotMinValue, units, "Min: ", useSiUnitPrefix);
+            DrawQuantityLabel(minLabel, plotMinValue, *unitInfo, units, "Min: ");
         }
         if (plot->mShowLegendColor) {
             ImGui::PopStyleColor();
@@ -627,35 +2185,43 @@ void DrawMetrics(
         //    |
         // ---| Min: xxx
         if (plot->mShowLegendMax) {
-            DrawQuantityLabel(plotMaxValue, units, "Max: ", useSiUnitPrefix);
+            DrawQuantityLabel(maxLabel, plotMaxValue, *unitInfo, units, "Max: ");
         }
-        if (plot->mShowLegendDesc || plot->mShowLegendAverage) {
+        if (plot->mShowLegendDesc || plot->mShowLegendAverage || plot->mShowLegendPercentiles != 0) {
             // Order series based on value and/or stack order
-            std::vector<MetricsGuiMetric*> ordered(metrics.begin(), metrics.end());
+            auto& ordered = plot->mDrawScratch.mLegendOrder;
+            ordered.resize(metrics.size());
+            for (size_t i = 0, N = metrics.size(); i < N; ++i) {
+                ordered[i] = (uint32_t) i;
+            }
             if (plot->mStacked) {
                 std::reverse(ordered.begin(), ordered.end());
             } else {
-                std::sort(ordered.begin(), ordered.end(), [](MetricsGuiMetric* a, MetricsGuiMetric* b) {
-                    return b->GetAverageValue() < a->GetAverageValue();
+                std::sort(ordered.begin(), ordered.end(), [&metrics](uint32_t a, uint32_t b) {
+                    return metrics[b]->GetAverageValue() < metrics[a]->GetAverageValue();
                 });
             }
-            for (auto metric : ordered) {
+            for (auto i : ordered) {
+                auto metric = metrics[i];
                 if (plot->mShowLegendColor) {
                     ImGui::PushStyleColor(ImGuiCol_Text, *(ImVec4*) &metric->mColor);
                 }
                 if (plot->mShowLegendDesc) {
                     if (plot->mShowLegendAverage) {
-                        char prefix[128];
-                        snprintf(prefix, _countof(prefix), "%s ", metric->mDescription.c_str());
+                        // The description can be changed at any time, so
+                        // it isn't part of the cached label
+                        ImGui::TextUnformatted(metric->mDescription.c_str());
+                        ImGui::SameLine(0.f, 0.f);
                         auto plotAvgValue = metric->GetAverageValue();
-                        DrawQuantityLabel(plotAvgValue, units, prefix, useSiUnitPrefix);
+                        DrawQuantityLabel(&legendLabels[i]->mAvg, plotAvgValue, *unitInfo, units, " ");
                     } else {
                         ImGui::TextUnformatted(metric->mDescription.c_str());
                     }
-                } else {
+                } else if (plot->mShowLegendAverage) {
                     auto plotAvgValue = metric->GetAverageValue();
-                    DrawQuantityLabel(plotAvgValue, units, "Avg: ", useSiUnitPrefix);
+                    DrawQuantityLabel(&legendLabels[i]->mAvg, plotAvgValue, *unitInfo, units, "Avg: ");
                 }
+                DrawLegendPercentiles(plot, metric, legendLabels[i], *unitInfo, units);
                 if (plot->mShowLegendColor) {
                     ImGui::PopStyleColor();
                 }
@@ -667,7 +2233,7 @@ void DrawMetrics(
             if (cy < ty) {
                 ImGui::ItemSize(ImVec2(0.f, ty - cy));
             }
-            DrawQuantityLabel(plotMinValue, units, "Min: ", useSiUnitPrefix);
+            DrawQuantityLabel(minLabel, plotMinValue, *unitInfo, units, "Min: ");
         }
     }
 
@@ -692,20 +2258,63 @@ void MetricsGuiPlot::DrawList()
 
     ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(1, 0));
 
-    for (size_t i = 0, N = mMetrics.size(); i < N; ++i) {
+    // Rows that are entirely outside the clip rect are not drawn, and the
+    // cursor is moved past them with a single ItemSize() so that the
+    // window's content size (and so its scrollbar) is unchanged.  This
+    // needs the height of each kind of row, which is measured whenever one
+    // is drawn; rows of a kind that hasn't been measured yet are drawn.
+    //
+    // When every row is the same kind, the visible rows are found directly.
+    // Otherwise (i.e., inline graphs of only selected metrics), finding them
+    // requires a pass over the metrics' selection state, but no other work
+    // is done for rows that aren't visible.
+    auto clipMinY = window->ClipRect.Min.y;
+    auto clipMaxY = window->ClipRect.Max.y;
+    auto uniformRows = !mShowInlineGraphs || !mShowOnlyIfSelected;
+    auto uniformRowHeight = mShowInlineGraphs ? mListInlineRowHeight : mListRowHeight;
+    auto N = mMetrics.size();
+    size_t i = 0;
+    float skipHeight = 0.f;
+
+    if (uniformRows && uniformRowHeight > 0.f && clipMinY > window->DC.CursorPos.y) {
+        i = std::min(N, (size_t) ((clipMinY - window->DC.CursorPos.y) / uniformRowHeight));
+        skipHeight = i * uniformRowHeight;
+    }
+
+    mMetricLabels.resize(N);
+    for (; i < N; ++i) {
         auto metric = mMetrics[i];
         auto const& metricRange = mMetricRange[i];
+        auto labels = &mMetricLabels[i];
+        auto showInlineGraph = mShowInlineGraphs && (!mShowOnlyIfSelected || metric->mSelected);
+
+        auto rowHeight = showInlineGraph ? mListInlineRowHeight : mListRowHeight;
+        if (rowHeight > 0.f) {
+            auto rowY = window->DC.CursorPos.y + skipHeight;
+            if (rowY >= clipMaxY && uniformRows) {
+                skipHeight += (N - i) * rowHeight;
+                break;
+            }
+            if (rowY >= clipMaxY || rowY + rowHeight <= clipMinY) {
+                skipHeight += rowHeight;
+                continue;
+            }
+        }
+
+        if (skipHeight > 0.f) {
+            ImGui::ItemSize(ImVec2(0.f, skipHeight));
+            skipHeight = 0.f;
+        }
 
         // Draw description and value
         auto x = window->DC.CursorPos.x;
         auto y = window->DC.CursorPos.y;
         ImGui::Selectable(metric->mDescription.c_str(), &metric->mSelected, ImGuiSelectableFlags_DrawFillAvailWidth);
         if (valueX >= barStartX) {
-            auto useSiUnitPrefix  = 0 != (metric->mFlags & MetricsGuiMetric::USE_SI_UNIT_PREFIX);
             auto lastValue = metric->GetLastValue();
             ImGui::SameLine(x + valueX - (window->Pos.x - window->Scroll.x));
 
-            DrawQuantityLabel(lastValue, metric->mUnits.c_str(), "", useSiUnitPrefix);
+            DrawQuantityLabel(&labels->mValue, lastValue, metric->mUnitInfo, metric->mUnits.c_str(), "");
 
             // Draw bar
             if (barEndX > barStartX) {
@@ -724,13 +2333,23 @@ void MetricsGuiPlot::DrawList()
             }
         }
 
+        // Clicking the row may have changed whether it has an inline graph
         if (mShowInlineGraphs &&
             (!mShowOnlyIfSelected || metric->mSelected)) {
-            std::vector<MetricsGuiMetric*> m(1, metric);
-            DrawMetrics(this, m, mInlinePlotRowCount, metricRange.first, metricRange.second);
+            mDrawScratch.mInlineMetrics.assign(1, metric);
+            mDrawScratch.mLegendLabels.assign(1, &labels->mInlineLegend);
+            DrawMetrics(this, mDrawScratch.mInlineMetrics, &labels->mInlineMax, &labels->mInlineMin, mDrawScratch.mLegendLabels.data(),
+                mInlinePlotRowCount, metricRange.first, metricRange.second);
+            mListInlineRowHeight = window->DC.CursorPos.y - y;
+        } else {
+            mListRowHeight = window->DC.CursorPos.y - y;
         }
     }
 
+    if (skipHeight > 0.f) {
+        ImGui::ItemSize(ImVec2(0.f, skipHeight));
+    }
+
     ImGui::PopStyleVar();
 }
 
@@ -740,6 +2359,181 @@ void MetricsGuiPlot::DrawHistory()
         return;
     }
 
-    DrawMetrics(this, mMetrics, mPlotRowCount, mMinValue, mMaxValue);
+    mMetricLabels.resize(mMetrics.size());
+    mDrawScratch.mLegendLabels.resize(mMetrics.size());
+    for (size_t i = 0, N = mMetrics.size(); i < N; ++i) {
+        mDrawScratch.mLegendLabels[i] = &mMetricLabels[i].mLegend;
+    }
+    DrawMetrics(this, mMetrics, &mLegendMaxLabel, &mLegendMinLabel, mDrawScratch.mLegendLabels.data(),
+        mPlotRowCount, mMinValue, mMaxValue);
 }
 
+void MetricsGuiPlot::DrawDistribution()
+{
+    if (!DrawPrefix(this)) {
+        return;
+    }
+
+    auto window = ImGui::GetCurrentWindow();
+    auto const& style = GImGui->Style;
+
+    auto textHeight = ImGui::GetTextLineHeight();
+
+    auto plotWidth = std::max(0.f,
+        ImGui::GetContentRegionAvailWidth() -
+        window->WindowPadding.x -
+        mWidthInfo->mLegendWidth -
+        PLOT_LEGEND_PADDING);
+    auto plotHeight = std::max(0.f, (textHeight + LEGEND_TEXT_VERTICAL_SPACING) * mPlotRowCount);
+
+    ImRect frame_bb(
+        window->DC.CursorPos,
+        window->DC.CursorPos + ImVec2(plotWidth, plotHeight));
+    ImRect inner_bb(
+        frame_bb.Min + style.FramePadding,
+        frame_bb.Max - style.FramePadding);
+
+    ImGui::ItemSize(frame_bb, style.FramePadding.y);
+    auto visible = ImGui::ItemAdd(frame_bb, NULL);
+    if (visible) {
+        ImGui::RenderFrame(frame_bb.Min, frame_bb.Max, ImGui::GetColorU32(ImGuiCol_FrameBg), true, style.FrameRounding);
+    }
+
+    plotWidth = inner_bb.GetWidth();
+    plotHeight = inner_bb.GetHeight();
+
+    // Fit the bins to the values of the metrics being drawn, unless a range
+    // was given.  Log bins need a positive lower bound, so it is fit if the
+    // given one isn't positive.
+    auto minValue = mDistributionMinValue;
+    auto maxValue = mDistributionMaxValue;
+    auto fixedRange = minValue < maxValue;
+    if (!fixedRange || (mDistributionLogBins && !(minValue > 0.f))) {
+        auto fitMinValue = FLT_MAX;
+        auto fitMaxValue = -FLT_MAX;
+        for (auto metric : mMetrics) {
+            float metricMinValue = 0.f;
+            float metricMaxValue = 0.f;
+            if ((!mShowOnlyIfSelected || metric->mSelected) &&
+                metric->mPercentileHistogram != nullptr &&
+                GetPercentileHistogramRange(metric->mPercentileHistogram, mDistributionLogBins, &metricMinValue, &metricMaxValue)) {
+                fitMinValue = std::min(fitMinValue, metricMinValue);
+                fitMaxValue = std::max(fitMaxValue, metricMaxValue);
+            }
+        }
+        if (fitMinValue > fitMaxValue) {
+            fitMinValue = mDistributionLogBins ? 1.f : 0.f;
+            fitMaxValue = fitMinValue;
+        }
+        minValue = fitMinValue;
+        if (!fixedRange) {
+            maxValue = fitMaxValue;
+        }
+    }
+    if (!(minValue < maxValue)) {
+        if (mDistributionLogBins) {
+            minValue = maxValue * 0.5f;
+            maxValue = maxValue * 2.f;
+        } else {
+            auto d = minValue == 0.f ? 1.f : (0.5f * fabsf(minValue));
+            minValue -= d;
+            maxValue += d;
+        }
+    }
+
+    auto maxBarCount = (uint32_t) (plotWidth / (mVBarMinWidth + mVBarGapWidth));
+    auto binCount = mDistributionBinCount == 0 ? maxBarCount : mDistributionBinCount;
+    if (visible && binCount > 0) {
+        // Compute every metric's bins first, so that the bars can be scaled
+        // to the largest.
+        auto scratch = &mDrawScratch;
+        scratch->mBinFractions.resize(binCount * mMetrics.size());
+        auto maxFraction = 0.f;
+        auto drawCount = 0u;
+        for (size_t i = 0, N = mMetrics.size(); i < N; ++i) {
+            auto metric = mMetrics[i];
+            if ((mShowOnlyIfSelected && !metric->mSelected) || metric->mPercentileHistogram == nullptr) {
+                continue;
+            }
+            auto binFractions = &scratch->mBinFractions[i * binCount];
+            GetPercentileHistogramBins(metric->mPercentileHistogram, minValue, maxValue, mDistributionLogBins, binCount, binFractions);
+            for (uint32_t j = 0; j < binCount; ++j) {
+                maxFraction = std::max(maxFraction, binFractions[j]);
+            }
+            drawCount += 1;
+        }
+
+        // Overlapping series are drawn translucent.
+        scratch->mPoints.resize(4 * binCount);
+        auto corners = (ImVec2*) scratch->mPoints.data();
+        auto hScale = plotWidth / (float) binCount;
+        auto vScale = maxFraction > 0.f ? (plotHeight / maxFraction) : 0.f;
+        for (size_t i = 0, N = mMetrics.size(); i < N && drawCount > 0; ++i) {
+            auto metric = mMetrics[i];
+            if ((mShowOnlyIfSelected && !metric->mSelected) || metric->mPercentileHistogram == nullptr) {
+                continue;
+            }
+
+            auto color = ImGui::ColorConvertFloat4ToU32(*(ImVec4*) &metric->mColor);
+            if (drawCount > 1) {
+                color = (color & ~IM_COL32_A_MASK) | (((color >> 1) & IM_COL32_A_MASK));
+            }
+
+            auto binFractions = &scratch->mBinFractions[i * binCount];
+            for (uint32_t j = 0; j < binCount; ++j) {
+                auto x0 = inner_bb.Min.x + hScale * j;
+                auto x1 = (j + 1 < binCount ? (inner_bb.Min.x + hScale * (j + 1)) : inner_bb.Max.x) - mVBarGapWidth;
+                auto y0 = inner_bb.Max.y - vScale * binFractions[j];
+                corners[2 * j]     = ImClamp(ImVec2(x0, y0), inner_bb.Min, inner_bb.Max);
+                corners[2 * j + 1] = ImClamp(ImVec2(x1, inner_bb.Max.y), inner_bb.Min, inner_bb.Max);
+            }
+            AddRectsFilled(window->DrawList, corners, binCount, color, mBarRounding);
+        }
+    }
+
+    ImGui::SameLine();
+
+    auto unitInfo = &NO_UNIT_INFO;
+    auto units = "";
+    if (mShowLegendUnits && !mMetrics.empty()) {
+        unitInfo = &mMetrics[0]->mUnitInfo;
+        units = mMetrics[0]->mUnits.c_str();
+    }
+
+    // ---| Max: xxx
+    //    | Desc
+    //    |
+    //    |
+    // ---| Min: xxx
+    ImGui::BeginGroup();
+    ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(0.f, LEGEND_TEXT_VERTICAL_SPACING));
+
+    if (mShowLegendMax) {
+        DrawQuantityLabel(&mDistributionMaxLabel, maxValue, *unitInfo, units, "Max: ");
+    }
+    if (mShowLegendDesc) {
+        for (auto metric : mMetrics) {
+            if (mShowOnlyIfSelected && !metric->mSelected) {
+                continue;
+            }
+            if (mShowLegendColor) {
+                ImGui::PushStyleColor(ImGuiCol_Text, *(ImVec4*) &metric->mColor);
+            }
+            ImGui::TextUnformatted(metric->mDescription.c_str());
+            if (mShowLegendColor) {
+                ImGui::PopStyleColor();
+            }
+        }
+    }
+    if (mShowLegendMin) {
+        auto cy = window->DC.CursorPos.y;
+        auto ty = frame_bb.Max.y - textHeight;
+        if (cy < ty) {
+            ImGui::ItemSize(ImVec2(0.f, ty - cy));
+        }
+        DrawQuantityLabel(&mDistributionMinLabel, minValue, *unitInfo, units, "Min: ");
+    }
+
+    ImGui::PopStyleVar(1);
+    ImGui::EndGroup();
+}
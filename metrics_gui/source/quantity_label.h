@@ -0,0 +1,41 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#ifndef METRICS_GUI_QUANTITY_LABEL_H
+#define METRICS_GUI_QUANTITY_LABEL_H
+
+#include "../include/metrics_gui/metrics_gui.h"
+
+#include <stddef.h>
+
+// Write prefix, quantity (4 characters, scaled to a unit prefix allowed by
+// unitInfo), and units to memory, e.g., "Avg 12.3 ms".  Truncates and
+// returns the untruncated length like snprintf(), and produces the same
+// text as formatting the number with snprintf(" %.3lf") would.
+int MetricsGuiCreateQuantityLabel(
+    char* memory,
+    size_t memorySize,
+    float quantity,
+    MetricsGuiMetric::UnitInfo const& unitInfo,
+    char const* units,
+    char const* prefix);
+
+#endif // ifndef METRICS_GUI_QUANTITY_LABEL_H
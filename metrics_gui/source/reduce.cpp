@@ -0,0 +1,498 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "reduce.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <stdint.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define METRICS_GUI_REDUCE_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_SSE2
+#define TARGET_AVX2
+#else
+#include <cpuid.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#else
+#define METRICS_GUI_REDUCE_X86 0
+#endif
+
+namespace {
+
+struct ReduceFunctions {
+    float (*mMin)(float const*, size_t);
+    float (*mMax)(float const*, size_t);
+    float (*mSum)(float const*, size_t);
+    double (*mSumDouble)(float const*, size_t);
+    void (*mAccumulate)(float*, float const*, size_t);
+};
+
+// ----------------------------------------------------------------------------
+// Scalar
+
+float MinScalar(
+    float const* values,
+    size_t count)
+{
+    auto r = values[0];
+    for (size_t i = 1; i < count; ++i) {
+        r = std::min(r, values[i]);
+    }
+    return r;
+}
+
+float MaxScalar(
+    float const* values,
+    size_t count)
+{
+    auto r = values[0];
+    for (size_t i = 1; i < count; ++i) {
+        r = std::max(r, values[i]);
+    }
+    return r;
+}
+
+float SumScalar(
+    float const* values,
+    size_t count)
+{
+    float r = 0.f;
+    for (size_t i = 0; i < count; ++i) {
+        r += values[i];
+    }
+    return r;
+}
+
+double SumDoubleScalar(
+    float const* values,
+    size_t count)
+{
+    double r = 0.;
+    for (size_t i = 0; i < count; ++i) {
+        r += values[i];
+    }
+    return r;
+}
+
+void AccumulateScalar(
+    float* totals,
+    float const* values,
+    size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        totals[i] += values[i];
+    }
+}
+
+ReduceFunctions const SCALAR_FUNCTIONS = {
+    MinScalar,
+    MaxScalar,
+    SumScalar,
+    SumDoubleScalar,
+    AccumulateScalar,
+};
+
+#if METRICS_GUI_REDUCE_X86
+
+// ----------------------------------------------------------------------------
+// SSE2
+
+TARGET_SSE2 float HorizontalMin(
+    __m128 v)
+{
+    v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(v);
+}
+
+TARGET_SSE2 float HorizontalMax(
+    __m128 v)
+{
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(v);
+}
+
+TARGET_SSE2 float HorizontalSum(
+    __m128 v)
+{
+    v = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(v);
+}
+
+TARGET_SSE2 double HorizontalSum(
+    __m128d v)
+{
+    v = _mm_add_pd(v, _mm_unpackhi_pd(v, v));
+    return _mm_cvtsd_f64(v);
+}
+
+TARGET_SSE2 float MinSSE2(
+    float const* values,
+    size_t count)
+{
+    if (count < 8) {
+        return MinScalar(values, count);
+    }
+    auto r0 = _mm_loadu_ps(values);
+    auto r1 = _mm_loadu_ps(values + 4);
+    size_t i = 8;
+    for (; i + 8 <= count; i += 8) {
+        r0 = _mm_min_ps(r0, _mm_loadu_ps(values + i));
+        r1 = _mm_min_ps(r1, _mm_loadu_ps(values + i + 4));
+    }
+    auto r = HorizontalMin(_mm_min_ps(r0, r1));
+    for (; i < count; ++i) {
+        r = std::min(r, values[i]);
+    }
+    return r;
+}
+
+TARGET_SSE2 float MaxSSE2(
+    float const* values,
+    size_t count)
+{
+    if (count < 8) {
+        return MaxScalar(values, count);
+    }
+    auto r0 = _mm_loadu_ps(values);
+    auto r1 = _mm_loadu_ps(values + 4);
+    size_t i = 8;
+    for (; i + 8 <= count; i += 8) {
+        r0 = _mm_max_ps(r0, _mm_loadu_ps(values + i));
+        r1 = _mm_max_ps(r1, _mm_loadu_ps(values + i + 4));
+    }
+    auto r = HorizontalMax(_mm_max_ps(r0, r1));
+    for (; i < count; ++i) {
+        r = std::max(r, values[i]);
+    }
+    return r;
+}
+
+TARGET_SSE2 float SumSSE2(
+    float const* values,
+    size_t count)
+{
+    auto r0 = _mm_setzero_ps();
+    auto r1 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        r0 = _mm_add_ps(r0, _mm_loadu_ps(values + i));
+        r1 = _mm_add_ps(r1, _mm_loadu_ps(values + i + 4));
+    }
+    auto r = HorizontalSum(_mm_add_ps(r0, r1));
+    for (; i < count; ++i) {
+        r += values[i];
+    }
+    return r;
+}
+
+TARGET_SSE2 double SumDoubleSSE2(
+    float const* values,
+    size_t count)
+{
+    auto r0 = _mm_setzero_pd();
+    auto r1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        auto v = _mm_loadu_ps(values + i);
+        r0 = _mm_add_pd(r0, _mm_cvtps_pd(v));
+        r1 = _mm_add_pd(r1, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+    }
+    auto r = HorizontalSum(_mm_add_pd(r0, r1));
+    for (; i < count; ++i) {
+        r += values[i];
+    }
+    return r;
+}
+
+TARGET_SSE2 void AccumulateSSE2(
+    float* totals,
+    float const* values,
+    size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(totals + i, _mm_add_ps(_mm_loadu_ps(totals + i), _mm_loadu_ps(values + i)));
+    }
+    for (; i < count; ++i) {
+        totals[i] += values[i];
+    }
+}
+
+ReduceFunctions const SSE2_FUNCTIONS = {
+    MinSSE2,
+    MaxSSE2,
+    SumSSE2,
+    SumDoubleSSE2,
+    AccumulateSSE2,
+};
+
+// ----------------------------------------------------------------------------
+// AVX2
+
+TARGET_AVX2 float MinAVX2(
+    float const* values,
+    size_t count)
+{
+    if (count < 16) {
+        return MinSSE2(values, count);
+    }
+    auto r0 = _mm256_loadu_ps(values);
+    auto r1 = _mm256_loadu_ps(values + 8);
+    size_t i = 16;
+    for (; i + 16 <= count; i += 16) {
+        r0 = _mm256_min_ps(r0, _mm256_loadu_ps(values + i));
+        r1 = _mm256_min_ps(r1, _mm256_loadu_ps(values + i + 8));
+    }
+    r0 = _mm256_min_ps(r0, r1);
+    auto r = HorizontalMin(_mm_min_ps(_mm256_castps256_ps128(r0), _mm256_extractf128_ps(r0, 1)));
+    for (; i < count; ++i) {
+        r = std::min(r, values[i]);
+    }
+    return r;
+}
+
+TARGET_AVX2 float MaxAVX2(
+    float const* values,
+    size_t count)
+{
+    if (count < 16) {
+        return MaxSSE2(values, count);
+    }
+    auto r0 = _mm256_loadu_ps(values);
+    auto r1 = _mm256_loadu_ps(values + 8);
+    size_t i = 16;
+    for (; i + 16 <= count; i += 16) {
+        r0 = _mm256_max_ps(r0, _mm256_loadu_ps(values + i));
+        r1 = _mm256_max_ps(r1, _mm256_loadu_ps(values + i + 8));
+    }
+    r0 = _mm256_max_ps(r0, r1);
+    auto r = HorizontalMax(_mm_max_ps(_mm256_castps256_ps128(r0), _mm256_extractf128_ps(r0, 1)));
+    for (; i < count; ++i) {
+        r = std::max(r, values[i]);
+    }
+    return r;
+}
+
+TARGET_AVX2 float SumAVX2(
+    float const* values,
+    size_t count)
+{
+    auto r0 = _mm256_setzero_ps();
+    auto r1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        r0 = _mm256_add_ps(r0, _mm256_loadu_ps(values + i));
+        r1 = _mm256_add_ps(r1, _mm256_loadu_ps(values + i + 8));
+    }
+    r0 = _mm256_add_ps(r0, r1);
+    auto r = HorizontalSum(_mm_add_ps(_mm256_castps256_ps128(r0), _mm256_extractf128_ps(r0, 1)));
+    for (; i < count; ++i) {
+        r += values[i];
+    }
+    return r;
+}
+
+TARGET_AVX2 double SumDoubleAVX2(
+    float const* values,
+    size_t count)
+{
+    auto r0 = _mm256_setzero_pd();
+    auto r1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        r0 = _mm256_add_pd(r0, _mm256_cvtps_pd(_mm_loadu_ps(values + i)));
+        r1 = _mm256_add_pd(r1, _mm256_cvtps_pd(_mm_loadu_ps(values + i + 4)));
+    }
+    r0 = _mm256_add_pd(r0, r1);
+    auto r = HorizontalSum(_mm_add_pd(_mm256_castpd256_pd128(r0), _mm256_extractf128_pd(r0, 1)));
+    for (; i < count; ++i) {
+        r += values[i];
+    }
+    return r;
+}
+
+TARGET_AVX2 void AccumulateAVX2(
+    float* totals,
+    float const* values,
+    size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(totals + i, _mm256_add_ps(_mm256_loadu_ps(totals + i), _mm256_loadu_ps(values + i)));
+    }
+    for (; i < count; ++i) {
+        totals[i] += values[i];
+    }
+}
+
+ReduceFunctions const AVX2_FUNCTIONS = {
+    MinAVX2,
+    MaxAVX2,
+    SumAVX2,
+    SumDoubleAVX2,
+    AccumulateAVX2,
+};
+
+void CpuId(
+    uint32_t leaf,
+    uint32_t regs[4])
+{
+#ifdef _MSC_VER
+    __cpuidex((int*) regs, (int) leaf, 0);
+#else
+    __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+uint64_t GetXCR0()
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((uint64_t) edx << 32) | eax;
+#endif
+}
+
+#endif // if METRICS_GUI_REDUCE_X86
+
+MetricsGuiReduceLevel GetSupportedReduceLevel()
+{
+#if METRICS_GUI_REDUCE_X86
+    uint32_t regs[4] = {};
+    CpuId(0, regs);
+    auto maxLeaf = regs[0];
+
+    CpuId(1, regs);
+    auto sse2    = (regs[3] & (1u << 26)) != 0;
+    auto osxsave = (regs[2] & (1u << 27)) != 0;
+    auto avx     = (regs[2] & (1u << 28)) != 0;
+
+    // AVX also requires the OS to save the YMM registers.
+    auto avx2 = false;
+    if (osxsave && avx && (GetXCR0() & 6) == 6 && maxLeaf >= 7) {
+        CpuId(7, regs);
+        avx2 = (regs[1] & (1u << 5)) != 0;
+    }
+
+    return avx2 ? METRICS_GUI_REDUCE_AVX2 :
+           sse2 ? METRICS_GUI_REDUCE_SSE2 :
+                  METRICS_GUI_REDUCE_SCALAR;
+#else
+    return METRICS_GUI_REDUCE_SCALAR;
+#endif
+}
+
+ReduceFunctions const* GetReduceFunctions(
+    MetricsGuiReduceLevel level)
+{
+    switch (level) {
+#if METRICS_GUI_REDUCE_X86
+    case METRICS_GUI_REDUCE_AVX2: return &AVX2_FUNCTIONS;
+    case METRICS_GUI_REDUCE_SSE2: return &SSE2_FUNCTIONS;
+#endif
+    default: return &SCALAR_FUNCTIONS;
+    }
+}
+
+// The implementation is selected on first use, rather than during static
+// initialization, so that metrics can be used from other static
+// initializers.
+struct ReduceState {
+    MetricsGuiReduceLevel mLevel;
+    ReduceFunctions const* mFunctions;
+    ReduceState()
+        : mLevel(GetSupportedReduceLevel())
+        , mFunctions(GetReduceFunctions(mLevel))
+    {
+    }
+};
+
+ReduceState* GetReduceState()
+{
+    static ReduceState state;
+    return &state;
+}
+
+} // anon namespace
+
+MetricsGuiReduceLevel MetricsGuiGetReduceLevel()
+{
+    return GetReduceState()->mLevel;
+}
+
+MetricsGuiReduceLevel MetricsGuiSetReduceLevel(
+    MetricsGuiReduceLevel level)
+{
+    auto state = GetReduceState();
+    state->mLevel = std::min(level, GetSupportedReduceLevel());
+    state->mFunctions = GetReduceFunctions(state->mLevel);
+    return state->mLevel;
+}
+
+float MetricsGuiReduceMin(
+    float const* values,
+    size_t count)
+{
+    assert(count > 0);
+    return GetReduceState()->mFunctions->mMin(values, count);
+}
+
+float MetricsGuiReduceMax(
+    float const* values,
+    size_t count)
+{
+    assert(count > 0);
+    return GetReduceState()->mFunctions->mMax(values, count);
+}
+
+float MetricsGuiReduceSum(
+    float const* values,
+    size_t count)
+{
+    return GetReduceState()->mFunctions->mSum(values, count);
+}
+
+double MetricsGuiReduceSumDouble(
+    float const* values,
+    size_t count)
+{
+    return GetReduceState()->mFunctions->mSumDouble(values, count);
+}
+
+void MetricsGuiAccumulate(
+    float* totals,
+    float const* values,
+    size_t count)
+{
+    GetReduceState()->mFunctions->mAccumulate(totals, values, count);
+}
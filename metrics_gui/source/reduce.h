@@ -0,0 +1,54 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#ifndef METRICS_GUI_REDUCE_H
+#define METRICS_GUI_REDUCE_H
+
+#include <stddef.h>
+
+// Reductions over arrays of history values.  The implementation is selected
+// at runtime based on the instruction sets supported by the CPU (AVX2 or
+// SSE2 on x86, with a scalar fallback elsewhere).  Results may differ from a
+// sequential loop in the last bits since values are summed in a different
+// order.
+
+enum MetricsGuiReduceLevel {
+    METRICS_GUI_REDUCE_SCALAR,
+    METRICS_GUI_REDUCE_SSE2,
+    METRICS_GUI_REDUCE_AVX2,
+};
+
+// Get the implementation in use, or limit it to (at most) level, e.g., to
+// compare implementations.  MetricsGuiSetReduceLevel() returns the level
+// actually selected.
+MetricsGuiReduceLevel MetricsGuiGetReduceLevel();
+MetricsGuiReduceLevel MetricsGuiSetReduceLevel(MetricsGuiReduceLevel level);
+
+// count must be > 0 for min/max.
+float MetricsGuiReduceMin(float const* values, size_t count);
+float MetricsGuiReduceMax(float const* values, size_t count);
+float MetricsGuiReduceSum(float const* values, size_t count);
+double MetricsGuiReduceSumDouble(float const* values, size_t count);
+
+// totals[i] += values[i] for i in [0, count)
+void MetricsGuiAccumulate(float* totals, float const* values, size_t count);
+
+#endif // ifndef METRICS_GUI_REDUCE_H
@@ -0,0 +1,720 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "../include/metrics_gui/shared.h"
+#include "../../portable/perf_timer.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <atomic>
+#include <deque>
+#include <new>
+#include <string.h>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+namespace {
+
+enum {
+    CACHE_LINE_SIZE = 64,
+    SHARED_MAGIC    = 0x4d48534d,   // "MSHM"
+    SHARED_VERSION  = 2,
+};
+
+// The shared memory object is a SharedHeader, followed by mMetricCapacity
+// SharedMetrics, followed by a ring of mRingSize SharedSamples.
+//
+// As in the per-thread value queues, mWrite is only written by the writer
+// and mRead only by the reader.  Samples are published by the release store
+// to mWrite, and slots are returned to the writer by the release store to
+// mRead.  The indices are free-running, and wrap into the ring.  Metrics
+// are published by the release store to mMetricCount before any of their
+// samples are written.
+//
+// A reader about to block sets mWaiting, and then checks for samples again.
+// A writer checks mWaiting after publishing samples, and if it is set
+// increments mWakeCount and wakes the futex on it.  The seq_cst fences
+// between each side's store and load ensure that at least one of them sees
+// the other's store, so a wake-up can't be missed.
+//
+// The writer's timer may not be the reader's (e.g., each process may have
+// calibrated its own TSC frequency), so the writer also records a reference
+// pair: its GetPerfTimerCount() and the reference clock read together.  The
+// reader takes its own pair, and converts timestamps relative to them.
+struct SharedHeader {
+    std::atomic<uint32_t> mMagic;           // SHARED_MAGIC once the writer has initialized the object
+    uint32_t mVersion;
+    uint32_t mMetricCapacity;
+    uint32_t mRingSize;                     // power of two
+    uint64_t mTimerNumerator;               // the writer's GetPerfTimerFrequency()
+    uint64_t mTimerDenominator;
+    uint64_t mReferenceCount;               // the writer's GetPerfTimerCount() at mReferenceNanoseconds
+    uint64_t mReferenceNanoseconds;         // GetReferenceNanoseconds() time
+    std::atomic<uint32_t> mMetricCount;
+    char mPad0[CACHE_LINE_SIZE - 52];
+
+    // Written by the writer
+    std::atomic<uint64_t> mWrite;
+    std::atomic<uint64_t> mDroppedValueCount;
+    std::atomic<uint32_t> mWakeCount;       // futex word
+    char mPad1[CACHE_LINE_SIZE - 20];
+
+    // Written by the reader
+    std::atomic<uint64_t> mRead;
+    std::atomic<uint32_t> mWaiting;
+    char mPad2[CACHE_LINE_SIZE - 12];
+
+    SharedHeader()
+        : mMagic(0)
+        , mVersion(SHARED_VERSION)
+        , mMetricCapacity(0)
+        , mRingSize(0)
+        , mTimerNumerator(0)
+        , mTimerDenominator(0)
+        , mReferenceCount(0)
+        , mReferenceNanoseconds(0)
+        , mMetricCount(0)
+        , mWrite(0)
+        , mDroppedValueCount(0)
+        , mWakeCount(0)
+        , mRead(0)
+        , mWaiting(0)
+    {
+    }
+};
+
+struct SharedMetric {
+    char mDescription[MetricsGuiSharedWriter::MAX_DESCRIPTION_BYTES];
+    char mUnits[MetricsGuiSharedWriter::MAX_UNITS_BYTES];
+    uint32_t mFlags;
+    float mKnownMinValue;
+    float mKnownMaxValue;
+    uint32_t mPad;
+};
+
+struct SharedSample {
+    uint64_t mTimestamp;    // the writer's GetPerfTimerCount() time
+    uint32_t mMetricIndex;
+    float mValue;
+};
+
+static_assert(sizeof(SharedHeader) == 3 * CACHE_LINE_SIZE, "Unexpected SharedHeader padding");
+static_assert(sizeof(SharedMetric) == 176, "Unexpected SharedMetric padding");
+static_assert(sizeof(SharedSample) == 16, "Unexpected SharedSample padding");
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2,
+              "Shared memory indices must be lock-free atomics");
+
+// The clock that relates the writer's and reader's timers: nanoseconds of
+// CLOCK_MONOTONIC_RAW, or of QueryPerformanceCounter() on Windows, which
+// read the same in every process on the machine.
+uint64_t GetReferenceNanoseconds()
+{
+#ifdef _WIN32
+    LARGE_INTEGER t;
+    LARGE_INTEGER f;
+    QueryPerformanceCounter(&t);
+    QueryPerformanceFrequency(&f);
+    auto count = (uint64_t) t.QuadPart;
+    auto frequency = (uint64_t) f.QuadPart;
+    return count / frequency * 1000000000ull + count % frequency * 1000000000ull / frequency;
+#else
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &t);
+    return (uint64_t) t.tv_sec * 1000000000ull + (uint64_t) t.tv_nsec;
+#endif
+}
+
+// Read GetPerfTimerCount() and GetReferenceNanoseconds() together, taking
+// the count halfway between two reads around the reference clock.
+void GetTimeReference(
+    uint64_t* count,
+    uint64_t* nanoseconds)
+{
+    auto c0 = GetPerfTimerCount();
+    *nanoseconds = GetReferenceNanoseconds();
+    auto c1 = GetPerfTimerCount();
+    *count = c0 + (c1 - c0) / 2;
+}
+
+uint64_t GetSharedSize(
+    uint32_t metricCapacity,
+    uint32_t ringSize)
+{
+    return sizeof(SharedHeader) + (uint64_t) metricCapacity * sizeof(SharedMetric) + (uint64_t) ringSize * sizeof(SharedSample);
+}
+
+struct SharedMapping {
+    char* mData;
+    uint64_t mSize;
+#ifdef _WIN32
+    HANDLE mHandle;
+#endif
+};
+
+// Create a zero-filled shared memory object.  On Windows the object only
+// exists while it is open, so an existing object belongs to a live writer
+// or reader and is not replaced.
+bool CreateMapping(
+    char const* name,
+    uint64_t size,
+    SharedMapping* mapping)
+{
+#ifdef _WIN32
+    auto handle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, (DWORD) (size >> 32), (DWORD) size, name);
+    if (handle == nullptr) {
+        return false;
+    }
+    if (GetLastError() == ERROR_ALREADY_EXISTS) {
+        CloseHandle(handle);
+        return false;
+    }
+    auto data = MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T) size);
+    if (data == nullptr) {
+        CloseHandle(handle);
+        return false;
+    }
+    mapping->mHandle = handle;
+#else
+    shm_unlink(name);
+    auto fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd == -1) {
+        return false;
+    }
+    void* data = MAP_FAILED;
+    if (ftruncate(fd, (off_t) size) == 0) {
+        data = mmap(nullptr, (size_t) size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED) {
+        shm_unlink(name);
+        return false;
+    }
+#endif
+    mapping->mData = (char*) data;
+    mapping->mSize = size;
+    return true;
+}
+
+bool OpenMapping(
+    char const* name,
+    SharedMapping* mapping)
+{
+#ifdef _WIN32
+    auto handle = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name);
+    if (handle == nullptr) {
+        return false;
+    }
+    auto data = MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    MEMORY_BASIC_INFORMATION info = {};
+    if (data == nullptr || VirtualQuery(data, &info, sizeof(info)) == 0) {
+        if (data != nullptr) {
+            UnmapViewOfFile(data);
+        }
+        CloseHandle(handle);
+        return false;
+    }
+    mapping->mHandle = handle;
+    mapping->mSize = (uint64_t) info.RegionSize;
+#else
+    auto fd = shm_open(name, O_RDWR, 0);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        data = mmap(nullptr, (size_t) st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    mapping->mSize = (uint64_t) st.st_size;
+#endif
+    mapping->mData = (char*) data;
+    return true;
+}
+
+void CloseMapping(
+    SharedMapping* mapping)
+{
+#ifdef _WIN32
+    UnmapViewOfFile(mapping->mData);
+    CloseHandle(mapping->mHandle);
+#else
+    munmap(mapping->mData, (size_t) mapping->mSize);
+#endif
+}
+
+#ifdef __linux__
+void WakeFutex(
+    std::atomic<uint32_t>* word)
+{
+    syscall(SYS_futex, (uint32_t*) word, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+}
+
+void WaitFutex(
+    std::atomic<uint32_t>* word,
+    uint32_t value,
+    uint32_t timeoutMilliseconds)
+{
+    timespec timeout;
+    timeout.tv_sec = (time_t) (timeoutMilliseconds / 1000);
+    timeout.tv_nsec = (long) (timeoutMilliseconds % 1000) * 1000000;
+    syscall(SYS_futex, (uint32_t*) word, FUTEX_WAIT, value, &timeout, nullptr, 0);
+}
+#else
+void SleepOneMillisecond()
+{
+#ifdef _WIN32
+    Sleep(1);
+#else
+    timespec t = { 0, 1000000 };
+    nanosleep(&t, nullptr);
+#endif
+}
+#endif
+
+void CopyString(
+    char* dst,
+    size_t dstSize,
+    char const* src)
+{
+    auto size = std::min(strlen(src), dstSize - 1);
+    memcpy(dst, src, size);
+    dst[size] = '\0';
+}
+
+}
+
+struct MetricsGuiSharedWriter::State {
+    SharedMapping mMapping;
+    SharedHeader* mHeader;
+    SharedMetric* mMetrics;
+    SharedSample* mRing;
+    uint64_t mReadCache;    // last-seen mHeader->mRead
+    uint32_t mRingMask;
+    uint32_t mMetricCount;
+    std::string mName;
+};
+
+struct MetricsGuiSharedReader::State {
+    SharedMapping mMapping;
+    SharedHeader* mHeader;
+    SharedMetric const* mSharedMetrics;
+    SharedSample const* mRing;
+    uint32_t mRingMask;
+    uint32_t mMetricCapacity;
+    uint32_t mHistorySize;
+    uint32_t mSpinCount;    // WAIT_SPIN_COUNT, or 0 if the writer can't run while this thread spins
+    bool mConvertTimestamps;        // false if the writer's timer is this process's timer
+    uint64_t mWriterReferenceCount; // the header's mReferenceCount
+    uint64_t mLocalReferenceCount;  // local timer count at the same time
+    double mTimeScale;              // local timer counts per writer timer count
+    std::deque<MetricsGuiMetric> mMetrics;
+};
+
+namespace {
+
+typedef MetricsGuiSharedWriter::State WriterState;
+typedef MetricsGuiSharedReader::State ReaderState;
+
+// Number of free slots in the ring.  mRead is only reloaded if fewer than
+// count slots were free the last time it was loaded.
+uint32_t GetFreeCount(
+    WriterState* state,
+    uint32_t count)
+{
+    auto header = state->mHeader;
+    auto ringSize = (uint64_t) state->mRingMask + 1;
+    auto write = header->mWrite.load(std::memory_order_relaxed);
+    if (write - state->mReadCache + count > ringSize) {
+        state->mReadCache = header->mRead.load(std::memory_order_acquire);
+    }
+    auto used = write - state->mReadCache;
+    return used >= ringSize ? 0u : (uint32_t) (ringSize - used);
+}
+
+void WriteSamples(
+    WriterState* state,
+    uint32_t first,
+    uint32_t count,
+    float const* values,
+    uint64_t timestamp)
+{
+    assert(first < state->mMetricCount && count <= state->mMetricCount - first);
+
+    auto header = state->mHeader;
+    auto write = header->mWrite.load(std::memory_order_relaxed);
+    auto writeCount = std::min(count, GetFreeCount(state, count));
+    if (writeCount < count) {
+        header->mDroppedValueCount.fetch_add(count - writeCount, std::memory_order_relaxed);
+    }
+    if (writeCount == 0) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < writeCount; ++i) {
+        auto sample = &state->mRing[(write + i) & state->mRingMask];
+        sample->mTimestamp = timestamp;
+        sample->mMetricIndex = first + i;
+        sample->mValue = values[i];
+    }
+    header->mWrite.store(write + writeCount, std::memory_order_release);
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (header->mWaiting.load(std::memory_order_relaxed) != 0) {
+        header->mWakeCount.fetch_add(1, std::memory_order_relaxed);
+#ifdef __linux__
+        WakeFutex(&header->mWakeCount);
+#endif
+    }
+}
+
+bool HasSamples(
+    ReaderState const* state)
+{
+    return state->mHeader->mWrite.load(std::memory_order_relaxed) != state->mHeader->mRead.load(std::memory_order_relaxed);
+}
+
+uint64_t GetLocalTime(
+    ReaderState const* state,
+    uint64_t timestamp)
+{
+    if (!state->mConvertTimestamps) {
+        return timestamp;
+    }
+    auto elapsed = (double) (int64_t) (timestamp - state->mWriterReferenceCount) * state->mTimeScale;
+    return state->mLocalReferenceCount + (uint64_t) (int64_t) elapsed;
+}
+
+}
+
+MetricsGuiSharedWriter::MetricsGuiSharedWriter()
+    : mState(nullptr)
+{
+}
+
+MetricsGuiSharedWriter::~MetricsGuiSharedWriter()
+{
+    Close();
+}
+
+bool MetricsGuiSharedWriter::Open(
+    char const* name,
+    uint32_t maxMetricCount,
+    uint32_t ringSize)
+{
+    Close();
+
+    if (ringSize == 0 || (ringSize & (ringSize - 1)) != 0) {
+        return false;
+    }
+
+    SharedMapping mapping = {};
+    if (!CreateMapping(name, GetSharedSize(maxMetricCount, ringSize), &mapping)) {
+        return false;
+    }
+
+    auto f = GetPerfTimerFrequency();
+    auto header = new (mapping.mData) SharedHeader();
+    header->mMetricCapacity = maxMetricCount;
+    header->mRingSize = ringSize;
+    header->mTimerNumerator = f.Numerator;
+    header->mTimerDenominator = f.Denominator;
+    GetTimeReference(&header->mReferenceCount, &header->mReferenceNanoseconds);
+    header->mMagic.store(SHARED_MAGIC, std::memory_order_release);
+
+    auto state = new State();
+    state->mMapping = mapping;
+    state->mHeader = header;
+    state->mMetrics = (SharedMetric*) (header + 1);
+    state->mRing = (SharedSample*) (state->mMetrics + maxMetricCount);
+    state->mReadCache = 0;
+    state->mRingMask = ringSize - 1;
+    state->mMetricCount = 0;
+    state->mName = name;
+    mState = state;
+    return true;
+}
+
+void MetricsGuiSharedWriter::Close()
+{
+    if (mState == nullptr) {
+        return;
+    }
+
+    CloseMapping(&mState->mMapping);
+#ifndef _WIN32
+    shm_unlink(mState->mName.c_str());
+#endif
+
+    delete mState;
+    mState = nullptr;
+}
+
+uint32_t MetricsGuiSharedWriter::AddMetric(
+    char const* description,
+    char const* units,
+    uint32_t flags,
+    float knownMinValue,
+    float knownMaxValue)
+{
+    if (mState == nullptr || mState->mMetricCount == mState->mHeader->mMetricCapacity) {
+        return INVALID_METRIC_INDEX;
+    }
+
+    auto index = mState->mMetricCount;
+    auto metric = &mState->mMetrics[index];
+    CopyString(metric->mDescription, sizeof(metric->mDescription), description);
+    CopyString(metric->mUnits, sizeof(metric->mUnits), units);
+    metric->mFlags = flags;
+    metric->mKnownMinValue = knownMinValue;
+    metric->mKnownMaxValue = knownMaxValue;
+
+    mState->mMetricCount = index + 1;
+    mState->mHeader->mMetricCount.store(index + 1, std::memory_order_release);
+    return index;
+}
+
+void MetricsGuiSharedWriter::WriteValue(
+    uint32_t metricIndex,
+    float value)
+{
+    WriteValues(metricIndex, 1, &value, GetPerfTimerCount());
+}
+
+void MetricsGuiSharedWriter::WriteValue(
+    uint32_t metricIndex,
+    float value,
+    uint64_t timestamp)
+{
+    WriteValues(metricIndex, 1, &value, timestamp);
+}
+
+void MetricsGuiSharedWriter::WriteValues(
+    uint32_t first,
+    uint32_t count,
+    float const* values)
+{
+    WriteValues(first, count, values, GetPerfTimerCount());
+}
+
+void MetricsGuiSharedWriter::WriteValues(
+    uint32_t first,
+    uint32_t count,
+    float const* values,
+    uint64_t timestamp)
+{
+    if (mState != nullptr && count > 0) {
+        WriteSamples(mState, first, count, values, timestamp);
+    }
+}
+
+uint32_t MetricsGuiSharedWriter::GetFreeValueCount()
+{
+    return mState == nullptr ? 0 : GetFreeCount(mState, mState->mRingMask + 1);
+}
+
+uint64_t MetricsGuiSharedWriter::GetDroppedValueCount() const
+{
+    return mState == nullptr ? 0 : mState->mHeader->mDroppedValueCount.load(std::memory_order_relaxed);
+}
+
+MetricsGuiSharedReader::MetricsGuiSharedReader()
+    : mState(nullptr)
+{
+}
+
+MetricsGuiSharedReader::~MetricsGuiSharedReader()
+{
+    Close();
+}
+
+bool MetricsGuiSharedReader::Open(
+    char const* name,
+    uint32_t historySize)
+{
+    Close();
+
+    SharedMapping mapping = {};
+    if (!OpenMapping(name, &mapping)) {
+        return false;
+    }
+
+    // The object is written by another process, so check that everything
+    // the header describes is inside the mapping.
+    auto header = (SharedHeader*) mapping.mData;
+    if (mapping.mSize < sizeof(SharedHeader) ||
+        header->mMagic.load(std::memory_order_acquire) != SHARED_MAGIC ||
+        header->mVersion != SHARED_VERSION ||
+        header->mRingSize == 0 ||
+        (header->mRingSize & (header->mRingSize - 1)) != 0 ||
+        GetSharedSize(header->mMetricCapacity, header->mRingSize) > mapping.mSize ||
+        header->mTimerNumerator == 0 ||
+        header->mTimerDenominator == 0) {
+        CloseMapping(&mapping);
+        return false;
+    }
+
+    auto f = GetPerfTimerFrequency();
+    auto state = new State();
+    state->mMapping = mapping;
+    state->mHeader = header;
+    state->mSharedMetrics = (SharedMetric const*) (header + 1);
+    state->mRing = (SharedSample const*) (state->mSharedMetrics + header->mMetricCapacity);
+    state->mRingMask = header->mRingSize - 1;
+    state->mMetricCapacity = header->mMetricCapacity;
+    state->mHistorySize = historySize;
+    state->mSpinCount = std::thread::hardware_concurrency() > 1 ? WAIT_SPIN_COUNT : 0;
+
+    // Find the local timer count at the writer's reference time.  If the
+    // writer's timer runs at the same rate and reads the same as this
+    // process's (within 10us, allowing for the jitter of reading the
+    // reference pairs), it is the same clock and timestamps are used as-is.
+    uint64_t localCount = 0;
+    uint64_t localNanoseconds = 0;
+    GetTimeReference(&localCount, &localNanoseconds);
+    auto localCountsPerNanosecond = (double) f.Numerator / (double) f.Denominator * 1e-9;
+    auto referenceOffset = (double) (int64_t) (header->mReferenceNanoseconds - localNanoseconds) * localCountsPerNanosecond;
+    state->mWriterReferenceCount = header->mReferenceCount;
+    state->mLocalReferenceCount = localCount + (uint64_t) (int64_t) referenceOffset;
+    state->mTimeScale = (double) f.Numerator / (double) f.Denominator *
+                        (double) header->mTimerDenominator / (double) header->mTimerNumerator;
+
+    auto sameRate = header->mTimerNumerator == f.Numerator && header->mTimerDenominator == f.Denominator;
+    auto countOffset = (double) (int64_t) (state->mLocalReferenceCount - state->mWriterReferenceCount);
+    auto maxOffset = 10000. * localCountsPerNanosecond;
+    state->mConvertTimestamps = !sameRate || countOffset > maxOffset || countOffset < -maxOffset;
+    mState = state;
+    return true;
+}
+
+void MetricsGuiSharedReader::Close()
+{
+    if (mState == nullptr) {
+        return;
+    }
+
+    CloseMapping(&mState->mMapping);
+
+    delete mState;
+    mState = nullptr;
+}
+
+uint32_t MetricsGuiSharedReader::Drain()
+{
+    if (mState == nullptr) {
+        return 0;
+    }
+
+    // Load mWrite before mMetricCount, so that every metric with a sample
+    // before write has been published.
+    auto state = mState;
+    auto header = state->mHeader;
+    auto write = header->mWrite.load(std::memory_order_acquire);
+    auto metricCount = std::min(header->mMetricCount.load(std::memory_order_acquire), state->mMetricCapacity);
+    while (state->mMetrics.size() < metricCount) {
+        auto const& shared = state->mSharedMetrics[state->mMetrics.size()];
+        std::string description(shared.mDescription, strnlen(shared.mDescription, sizeof(shared.mDescription)));
+        std::string units(shared.mUnits, strnlen(shared.mUnits, sizeof(shared.mUnits)));
+        state->mMetrics.emplace_back(description.c_str(), units.c_str(), shared.mFlags | MetricsGuiMetric::RECORD_TIMESTAMPS, state->mHistorySize);
+        state->mMetrics.back().mKnownMinValue = shared.mKnownMinValue;
+        state->mMetrics.back().mKnownMaxValue = shared.mKnownMaxValue;
+    }
+
+    auto read = header->mRead.load(std::memory_order_relaxed);
+    if (write - read > (uint64_t) state->mRingMask + 1) {
+        read = write - state->mRingMask - 1;
+    }
+    auto count = (uint32_t) (write - read);
+    for (; read != write; ++read) {
+        auto const& sample = state->mRing[read & state->mRingMask];
+        if (sample.mMetricIndex < state->mMetrics.size()) {
+            state->mMetrics[sample.mMetricIndex].AddNewValue(sample.mValue, GetLocalTime(state, sample.mTimestamp));
+        }
+    }
+    header->mRead.store(write, std::memory_order_release);
+    return count;
+}
+
+bool MetricsGuiSharedReader::Wait(
+    uint32_t timeoutMilliseconds)
+{
+    if (mState == nullptr) {
+        return false;
+    }
+    for (uint32_t i = 0; i < mState->mSpinCount; ++i) {
+        if (HasSamples(mState)) {
+            return true;
+        }
+    }
+    if (HasSamples(mState) || timeoutMilliseconds == 0) {
+        return HasSamples(mState);
+    }
+
+#ifdef __linux__
+    auto header = mState->mHeader;
+    auto wakeCount = header->mWakeCount.load(std::memory_order_relaxed);
+    header->mWaiting.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!HasSamples(mState)) {
+        WaitFutex(&header->mWakeCount, wakeCount, timeoutMilliseconds);
+    }
+    header->mWaiting.store(0, std::memory_order_relaxed);
+#else
+    for (uint32_t i = 0; i < timeoutMilliseconds && !HasSamples(mState); ++i) {
+        SleepOneMillisecond();
+    }
+#endif
+    return HasSamples(mState);
+}
+
+uint32_t MetricsGuiSharedReader::GetMetricCount() const
+{
+    return mState == nullptr ? 0 : (uint32_t) mState->mMetrics.size();
+}
+
+MetricsGuiMetric* MetricsGuiSharedReader::GetMetric(
+    uint32_t index) const
+{
+    assert(index < GetMetricCount());
+    return &mState->mMetrics[index];
+}
+
+uint64_t MetricsGuiSharedReader::GetDroppedValueCount() const
+{
+    return mState == nullptr ? 0 : mState->mHeader->mDroppedValueCount.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,311 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "../include/metrics_gui/trace.h"
+#include "../../portable/perf_timer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+struct MetricsGuiTraceWriter::State {
+    FILE* mFile;
+    double mNanosecondsPerCount;
+    uint64_t mEventCount;
+    uint32_t mBufferSize;
+    bool mFailed;
+    char mName[MAX_NAME_BYTES];     // JSON-escaped track name of the metric being written
+    uint32_t mNameSize;
+    char mBuffer[BUFFER_BYTES];
+};
+
+namespace {
+
+typedef MetricsGuiTraceWriter::State TraceState;
+
+enum {
+    MAX_EVENT_BYTES = MetricsGuiTraceWriter::MAX_NAME_BYTES + 128,
+};
+
+void FlushBuffer(
+    TraceState* state)
+{
+    if (!state->mFailed && state->mBufferSize > 0 &&
+        fwrite(state->mBuffer, 1, state->mBufferSize, state->mFile) != state->mBufferSize) {
+        state->mFailed = true;
+    }
+    state->mBufferSize = 0;
+}
+
+void WriteString(
+    TraceState* state,
+    char const* s)
+{
+    auto size = (uint32_t) strlen(s);
+    if (state->mBufferSize + size > sizeof(state->mBuffer)) {
+        FlushBuffer(state);
+    }
+    memcpy(state->mBuffer + state->mBufferSize, s, size);
+    state->mBufferSize += size;
+}
+
+// Append s to the track name, escaped for a JSON string.  The name is
+// truncated at MAX_NAME_BYTES, without splitting a UTF-8 sequence, in
+// which case AppendName() returns false.
+bool AppendName(
+    TraceState* state,
+    char const* s)
+{
+    auto const capacity = (uint32_t) sizeof(state->mName);
+    for (; *s != '\0'; ++s) {
+        char escaped[8];
+        auto c = (unsigned char) *s;
+        if (c == '"' || c == '\\') {
+            escaped[0] = '\\';
+            escaped[1] = (char) c;
+            escaped[2] = '\0';
+        } else if (c < 0x20) {
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+        } else {
+            escaped[0] = (char) c;
+            escaped[1] = '\0';
+        }
+        auto size = (uint32_t) strlen(escaped);
+        if (state->mNameSize + size > capacity) {
+            // Drop the start of a UTF-8 sequence that doesn't fit.
+            if ((c & 0xc0) == 0x80) {
+                while (state->mNameSize > 0 && ((unsigned char) state->mName[state->mNameSize - 1] & 0xc0) == 0x80) {
+                    state->mNameSize -= 1;
+                }
+                if (state->mNameSize > 0 && (unsigned char) state->mName[state->mNameSize - 1] >= 0xc0) {
+                    state->mNameSize -= 1;
+                }
+            }
+            return false;
+        }
+        memcpy(state->mName + state->mNameSize, escaped, size);
+        state->mNameSize += size;
+    }
+    return true;
+}
+
+void SetName(
+    TraceState* state,
+    MetricsGuiMetric const* metric)
+{
+    state->mNameSize = 0;
+    if (AppendName(state, metric->mDescription.c_str()) &&
+        !metric->mUnits.empty() &&
+        AppendName(state, " (") &&
+        AppendName(state, metric->mUnits.c_str())) {
+        AppendName(state, ")");
+    }
+}
+
+template<size_t N>
+char* WriteLiteral(
+    char* p,
+    char const (&s)[N])
+{
+    memcpy(p, s, N - 1);
+    return p + N - 1;
+}
+
+// Write value in decimal, returning the end of the digits.
+char* WriteUInt(
+    char* p,
+    uint64_t value)
+{
+    char digits[20];
+    uint32_t count = 0;
+    do {
+        digits[count++] = (char) ('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    while (count > 0) {
+        *p++ = digits[--count];
+    }
+    return p;
+}
+
+// Format a counter event for value with the current track name.  Timestamps
+// and integer values are formatted by hand, which is several times faster
+// than snprintf().
+void WriteEvent(
+    TraceState* state,
+    uint32_t processId,
+    float value,
+    uint64_t timestamp)
+{
+    if (!std::isfinite(value)) {
+        return;
+    }
+    if (state->mBufferSize + MAX_EVENT_BYTES > sizeof(state->mBuffer)) {
+        FlushBuffer(state);
+    }
+
+    auto p = state->mBuffer + state->mBufferSize;
+    if (state->mEventCount > 0) {
+        *p++ = ',';
+    }
+    p = WriteLiteral(p, "\n{\"name\":\"");
+    memcpy(p, state->mName, state->mNameSize);
+    p += state->mNameSize;
+    p = WriteLiteral(p, "\",\"ph\":\"C\",\"ts\":");
+    auto ns = (uint64_t) ((double) timestamp * state->mNanosecondsPerCount + 0.5);
+    p = WriteUInt(p, ns / 1000);
+    *p++ = '.';
+    *p++ = (char) ('0' + ns / 100 % 10);
+    *p++ = (char) ('0' + ns / 10 % 10);
+    *p++ = (char) ('0' + ns % 10);
+    p = WriteLiteral(p, ",\"pid\":");
+    p = WriteUInt(p, processId);
+    p = WriteLiteral(p, ",\"args\":{\"value\":");
+    if (std::fabs(value) < 1e9f && value == (float) (int32_t) value) {
+        if (value < 0.f) {
+            *p++ = '-';
+        }
+        p = WriteUInt(p, (uint64_t) std::fabs(value));
+    } else {
+        p += snprintf(p, state->mBuffer + sizeof(state->mBuffer) - p, "%.9g", value);
+    }
+    p = WriteLiteral(p, "}}");
+
+    state->mBufferSize = (uint32_t) (p - state->mBuffer);
+    state->mEventCount += 1;
+}
+
+}
+
+MetricsGuiTraceWriter::MetricsGuiTraceWriter()
+    : mState(nullptr)
+#ifdef _WIN32
+    , mProcessId((uint32_t) GetCurrentProcessId())
+#else
+    , mProcessId((uint32_t) getpid())
+#endif
+{
+}
+
+MetricsGuiTraceWriter::~MetricsGuiTraceWriter()
+{
+    Close();
+}
+
+bool MetricsGuiTraceWriter::Open(
+    char const* path)
+{
+    Close();
+
+    auto file = fopen(path, "wb");
+    if (file == nullptr) {
+        return false;
+    }
+
+    auto f = GetPerfTimerFrequency();
+    auto state = new State();
+    state->mFile = file;
+    state->mNanosecondsPerCount = 1e9 * (double) f.Denominator / (double) f.Numerator;
+    state->mEventCount = 0;
+    state->mBufferSize = 0;
+    state->mFailed = false;
+    state->mNameSize = 0;
+    mState = state;
+
+    WriteString(state, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    return true;
+}
+
+void MetricsGuiTraceWriter::WriteHistory(
+    MetricsGuiMetric const* metric)
+{
+    if (mState == nullptr || metric->mTimestamps == nullptr || metric->mHistoryCount == 0) {
+        return;
+    }
+
+    // The history is circular, so write it as the oldest values up to the
+    // end of the buffer, then the rest.
+    auto size = metric->mHistorySize;
+    auto count = metric->mHistoryCount;
+    auto first = (metric->mHistoryHead + size - count) % size;
+    auto firstCount = std::min(count, size - first);
+    WriteValues(metric, metric->mHistory + first, metric->mTimestamps + first, firstCount);
+    WriteValues(metric, metric->mHistory, metric->mTimestamps, count - firstCount);
+}
+
+void MetricsGuiTraceWriter::WriteHistories(
+    MetricsGuiMetric const* const* metrics,
+    uint32_t metricCount)
+{
+    for (uint32_t i = 0; i < metricCount; ++i) {
+        WriteHistory(metrics[i]);
+    }
+}
+
+void MetricsGuiTraceWriter::WriteHistories(
+    MetricsGuiRegistry const& registry)
+{
+    for (uint32_t i = 0, N = registry.GetMetricCount(); i < N; ++i) {
+        WriteHistory(registry.GetMetric(i));
+    }
+}
+
+void MetricsGuiTraceWriter::WriteValues(
+    MetricsGuiMetric const* metric,
+    float const* values,
+    uint64_t const* timestamps,
+    uint32_t count)
+{
+    if (mState == nullptr || count == 0) {
+        return;
+    }
+
+    SetName(mState, metric);
+    for (uint32_t i = 0; i < count; ++i) {
+        WriteEvent(mState, mProcessId, values[i], timestamps[i]);
+    }
+}
+
+bool MetricsGuiTraceWriter::Close()
+{
+    if (mState == nullptr) {
+        return true;
+    }
+
+    WriteString(mState, "\n]}\n");
+    FlushBuffer(mState);
+    auto ok = fclose(mState->mFile) == 0 && !mState->mFailed;
+
+    delete mState;
+    mState = nullptr;
+    return ok;
+}
+
+uint64_t MetricsGuiTraceWriter::GetEventCount() const
+{
+    return mState == nullptr ? 0 : mState->mEventCount;
+}
@@ -0,0 +1,158 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include "../include/metrics_gui/value_queue.h"
+#include "../../portable/perf_timer.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace {
+
+enum { CACHE_LINE_SIZE = 64 };
+
+static_assert((METRICS_GUI_VALUE_QUEUE_SIZE & (METRICS_GUI_VALUE_QUEUE_SIZE - 1)) == 0,
+              "METRICS_GUI_VALUE_QUEUE_SIZE must be a power of two");
+
+// mWrite is only written by the owning thread and mRead only by the
+// draining thread.  Values are published by the release store to mWrite,
+// and slots are returned to the producer by the release store to mRead.
+// The indices are free-running, and wrap into mValues.
+struct ValueQueue {
+    struct Value {
+        MetricsGuiMetric* mMetric;
+        uint64_t mTimestamp;    // GetPerfTimerCount() time the value was recorded
+        float mValue;
+    };
+
+    // Producer and consumer indices are kept on separate cache lines.
+    std::atomic<uint32_t> mWrite;
+    uint32_t mReadCache;                    // producer's last-seen mRead
+    char mPad0[CACHE_LINE_SIZE - 2 * sizeof(uint32_t)];
+    std::atomic<uint32_t> mRead;
+    char mPad1[CACHE_LINE_SIZE - sizeof(uint32_t)];
+    std::atomic<bool> mOwned;               // whether a thread is recording into the queue
+    ValueQueue* mNext;                      // next queue in gValueQueues, immutable once published
+    Value mValues[METRICS_GUI_VALUE_QUEUE_SIZE];
+
+    ValueQueue()
+        : mWrite(0)
+        , mReadCache(0)
+        , mRead(0)
+        , mOwned(true)
+        , mNext(nullptr)
+    {
+    }
+};
+
+std::atomic<ValueQueue*> gValueQueues(nullptr);
+std::atomic<uint64_t> gDroppedValueCount(0);
+
+// Releases the thread's queue for reuse when the thread exits.
+struct ValueQueueOwner {
+    ValueQueue* mQueue;
+
+    ~ValueQueueOwner()
+    {
+        if (mQueue != nullptr) {
+            mQueue->mOwned.store(false, std::memory_order_release);
+        }
+    }
+};
+
+thread_local ValueQueueOwner tValueQueueOwner = { nullptr };
+
+ValueQueue* AcquireValueQueue()
+{
+    // Reuse the queue of a thread that has exited, if any.  Its remaining
+    // values are drained as usual.
+    for (auto queue = gValueQueues.load(std::memory_order_acquire); queue != nullptr; queue = queue->mNext) {
+        auto owned = false;
+        if (!queue->mOwned.load(std::memory_order_relaxed) &&
+            queue->mOwned.compare_exchange_strong(owned, true, std::memory_order_acquire)) {
+            return queue;
+        }
+    }
+
+    auto queue = new ValueQueue();
+    auto head = gValueQueues.load(std::memory_order_relaxed);
+    do {
+        queue->mNext = head;
+    } while (!gValueQueues.compare_exchange_weak(head, queue, std::memory_order_release, std::memory_order_relaxed));
+    return queue;
+}
+
+}
+
+bool MetricsGuiRecordValue(
+    MetricsGuiMetric* metric,
+    float value)
+{
+    auto queue = tValueQueueOwner.mQueue;
+    if (queue == nullptr) {
+        queue = AcquireValueQueue();
+        tValueQueueOwner.mQueue = queue;
+    }
+
+    auto write = queue->mWrite.load(std::memory_order_relaxed);
+    if (write - queue->mReadCache == METRICS_GUI_VALUE_QUEUE_SIZE) {
+        queue->mReadCache = queue->mRead.load(std::memory_order_acquire);
+        if (write - queue->mReadCache == METRICS_GUI_VALUE_QUEUE_SIZE) {
+            gDroppedValueCount.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+
+    auto v = &queue->mValues[write & (METRICS_GUI_VALUE_QUEUE_SIZE - 1)];
+    v->mMetric = metric;
+    v->mTimestamp = GetPerfTimerCount();
+    v->mValue = value;
+    queue->mWrite.store(write + 1, std::memory_order_release);
+    return true;
+}
+
+void MetricsGuiDrainValues()
+{
+    for (auto queue = gValueQueues.load(std::memory_order_acquire); queue != nullptr; queue = queue->mNext) {
+        auto read = queue->mRead.load(std::memory_order_relaxed);
+        auto write = queue->mWrite.load(std::memory_order_acquire);
+        for (; read != write; ++read) {
+            auto const& v = queue->mValues[read & (METRICS_GUI_VALUE_QUEUE_SIZE - 1)];
+            auto metric = v.mMetric;
+
+            // Queues are drained one after another, so a metric recorded
+            // by several threads may get an earlier timestamp after a later
+            // one.  Timestamps must not decrease, so those are clamped.
+            auto timestamp = v.mTimestamp;
+            if (metric->mTimestamps != nullptr && metric->mHistoryCount > 0) {
+                auto last = metric->mHistoryHead == 0 ? metric->mHistorySize - 1 : metric->mHistoryHead - 1;
+                timestamp = std::max(timestamp, metric->mTimestamps[last]);
+            }
+            metric->AddNewValue(v.mValue, timestamp);
+        }
+        queue->mRead.store(read, std::memory_order_release);
+    }
+}
+
+uint64_t MetricsGuiGetDroppedValueCount()
+{
+    return gDroppedValueCount.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,89 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include "../include/metrics_gui/zone_timer.h"
+#include <string.h>
+
+namespace {
+
+std::vector<MetricsGuiZone*>& GetZones()
+{
+    static std::vector<MetricsGuiZone*> zones;
+    return zones;
+}
+
+}
+
+MetricsGuiZone::MetricsGuiZone(
+    char const* description)
+    : mMetric(description, "s", MetricsGuiMetric::USE_SI_UNIT_PREFIX)
+    , mTicks(0)
+    , mStart(0)
+    , mDepth(0)
+{
+}
+
+void MetricsGuiZone::Commit(
+    double secondsPerTick)
+{
+    if (mDepth > 0) {
+        auto t = GetPerfTimerCount();
+        mTicks += t - mStart;
+        mStart = t;
+    }
+
+    mMetric.AddNewValue((float) (mTicks * secondsPerTick));
+    mTicks = 0;
+}
+
+MetricsGuiZone* MetricsGuiGetZone(
+    char const* description)
+{
+    auto& zones = GetZones();
+    for (auto zone : zones) {
+        if (strcmp(zone->mMetric.mDescription.c_str(), description) == 0) {
+            return zone;
+        }
+    }
+
+    auto zone = new MetricsGuiZone(description);
+    zones.emplace_back(zone);
+    return zone;
+}
+
+size_t MetricsGuiGetZoneCount()
+{
+    return GetZones().size();
+}
+
+MetricsGuiZone* const* MetricsGuiGetZones()
+{
+    return GetZones().data();
+}
+
+void MetricsGuiCommitZones()
+{
+    auto f = GetPerfTimerFrequency();
+    auto secondsPerTick = (double) f.Denominator / (double) f.Numerator;
+    for (auto zone : GetZones()) {
+        zone->Commit(secondsPerTick);
+    }
+}
@@ -19,8 +19,16 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
+#ifndef PERF_TIMER_H
+#define PERF_TIMER_H
+
 #ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
 #define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
 #include <stdint.h>
 #include <windows.h>
 
@@ -42,7 +50,13 @@ inline PerfTimerFrequency GetPerfTimerFrequency()
     QueryPerformanceFrequency((LARGE_INTEGER*) &f.Numerator);
     return f;
 }
-#else // ifdef _WIN32
+
+// QueryPerformanceCounter() already reads the TSC where it is usable
+inline bool SetPerfTimerUseTsc(bool useTsc)
+{
+    return !useTsc;
+}
+#elif defined(__APPLE__)
 #include <mach/mach_time.h>
 #include <stdint.h>
 
@@ -66,4 +80,147 @@ inline PerfTimerFrequency GetPerfTimerFrequency()
     f.Denominator = i.numer;
     return f;
 }
+
+inline bool SetPerfTimerUseTsc(bool useTsc)
+{
+    return !useTsc;
+}
+#else // ifdef _WIN32
+// Linux/POSIX.  Counts are nanoseconds from CLOCK_MONOTONIC_RAW, which is not
+// subject to NTP slewing.
+//
+// On x86, calling SetPerfTimerUseTsc(true) before the timer is first used
+// instead reads the time-stamp counter directly, which avoids the
+// clock_gettime() call.  The TSC frequency is calibrated against
+// CLOCK_MONOTONIC_RAW when the mode is chosen (taking 10ms), and the TSC is
+// only used if the CPU reports it as invariant.  TSC counts are only
+// comparable between cores on systems where the TSC is synchronized, which is
+// the norm for invariant TSCs.
+//
+// The mode is process-wide: it is held by function-local statics of inline
+// functions, which all translation units share, and it is fixed by the first
+// call to SetPerfTimerUseTsc(), GetPerfTimerCount() or
+// GetPerfTimerFrequency().  Counts and frequencies are therefore always in
+// the same units.
+#include <atomic>
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+#ifndef CLOCK_MONOTONIC_RAW
+#define CLOCK_MONOTONIC_RAW CLOCK_MONOTONIC
+#endif
+
+struct PerfTimerFrequency {
+    uint64_t Numerator;
+    uint32_t Denominator;
+};
+
+inline uint64_t GetPerfTimerClockCount()
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &t);
+    return (uint64_t) t.tv_sec * 1000000000ull + (uint64_t) t.tv_nsec;
+}
+
+struct PerfTimerTsc {
+    enum : uint64_t {
+        CALIBRATION_NS = 10000000,
+        UNKNOWN_FREQUENCY = ~0ull,
+    };
+
+    // TSC ticks per second once the mode is fixed, 0 if using
+    // clock_gettime(), or UNKNOWN_FREQUENCY before then.  This is
+    // constant-initialized, so reading it needs no guard.
+    static std::atomic<uint64_t>& Frequency()
+    {
+        static std::atomic<uint64_t> frequency(UNKNOWN_FREQUENCY);
+        return frequency;
+    }
+
+    // The mode requested by SetPerfTimerUseTsc() before the mode was fixed
+    static std::atomic<bool>& Requested()
+    {
+        static std::atomic<bool> requested(false);
+        return requested;
+    }
+
+    static uint64_t Calibrate()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        // Invariant TSC is reported in CPUID.80000007H:EDX[8]
+        unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+        if (__get_cpuid(0x80000000u, &eax, &ebx, &ecx, &edx) == 0 || eax < 0x80000007u ||
+            __get_cpuid(0x80000007u, &eax, &ebx, &ecx, &edx) == 0 || (edx & (1u << 8)) == 0) {
+            return 0;
+        }
+
+        auto t0 = GetPerfTimerClockCount();
+        auto c0 = __rdtsc();
+        uint64_t t1;
+        do {
+            t1 = GetPerfTimerClockCount();
+        } while (t1 - t0 < CALIBRATION_NS);
+        auto c1 = __rdtsc();
+
+        return (c1 - c0) * 1000000000ull / (t1 - t0);
+#else
+        return 0;
+#endif
+    }
+
+    // Fix the mode, if it isn't already, and return Frequency().  The static
+    // is initialized exactly once even if several threads race to get here.
+    static uint64_t Start()
+    {
+        static uint64_t const frequency = Requested().load() ? Calibrate() : 0;
+        Frequency().store(frequency, std::memory_order_relaxed);
+        return frequency;
+    }
+};
+
+// Use the TSC (or clock_gettime() if useTsc is false) for all perf timer
+// counts in the process.  Returns whether the timer uses the requested mode,
+// which is false if the TSC isn't supported or if the mode was already fixed
+// the other way by an earlier call or by the timer being used.
+inline bool SetPerfTimerUseTsc(bool useTsc)
+{
+    if (PerfTimerTsc::Frequency().load(std::memory_order_relaxed) == PerfTimerTsc::UNKNOWN_FREQUENCY) {
+        PerfTimerTsc::Requested().store(useTsc);
+    }
+    return (PerfTimerTsc::Start() != 0) == useTsc;
+}
+
+inline uint64_t GetPerfTimerCount()
+{
+    auto frequency = PerfTimerTsc::Frequency().load(std::memory_order_relaxed);
+    if (frequency == PerfTimerTsc::UNKNOWN_FREQUENCY) {
+        frequency = PerfTimerTsc::Start();
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    if (frequency != 0) {
+        return __rdtsc();
+    }
+#endif
+    return GetPerfTimerClockCount();
+}
+
+inline PerfTimerFrequency GetPerfTimerFrequency()
+{
+    auto frequency = PerfTimerTsc::Frequency().load(std::memory_order_relaxed);
+    if (frequency == PerfTimerTsc::UNKNOWN_FREQUENCY) {
+        frequency = PerfTimerTsc::Start();
+    }
+
+    PerfTimerFrequency f;
+    f.Numerator = frequency != 0 ? frequency : 1000000000ull;
+    f.Denominator = 1;
+    return f;
+}
 #endif // ifdef _WIN32
+
+#endif // ifndef PERF_TIMER_H
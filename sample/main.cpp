@@ -312,6 +312,7 @@ int main(
                         ImGui::Checkbox("mShowLegendMin##1",      &frameTimePlot.mShowLegendMin);
                         ImGui::Checkbox("mShowLegendMax##1",      &frameTimePlot.mShowLegendMax);
                         ImGui::Checkbox("mBarGraph##1",           &frameTimePlot.mBarGraph);
+                        ImGui::Checkbox("mShowFilteredRange##1",  &frameTimePlot.mShowFilteredRange);
                         ImGui::Spacing();
                         frameTimePlot.mPlotRowCount  = (uint32_t) plotRowCount;
                         frameTimePlot.mVBarMinWidth  = (uint32_t) vbarMinWidth;
@@ -330,6 +331,7 @@ int main(
                         sinePlot.mShowLegendMin      = frameTimePlot.mShowLegendMin;
                         sinePlot.mShowLegendMax      = frameTimePlot.mShowLegendMax;
                         sinePlot.mBarGraph           = frameTimePlot.mBarGraph;
+                        sinePlot.mShowFilteredRange  = frameTimePlot.mShowFilteredRange;
                         ImGui::TreePop();
                     }
                     frameTimePlot.DrawHistory();
@@ -359,6 +361,7 @@ int main(
                         ImGui::Checkbox("mShowLegendMax##2",      &combinedPlot.mShowLegendMax);
                         ImGui::Checkbox("mBarGraph##2",           &combinedPlot.mBarGraph);
                         ImGui::Checkbox("mStacked##2",            &combinedPlot.mStacked);
+                        ImGui::Checkbox("mShowFilteredRange##2",  &combinedPlot.mShowFilteredRange);
                         ImGui::Spacing();
                         combinedPlot.mPlotRowCount = (uint32_t) plotRowCount;
                         combinedPlot.mVBarMinWidth = (uint32_t) vbarMinWidth;